@@ -0,0 +1,165 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "KernelTls.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <algorithm>
+#include <cerrno>
+#include <log/Logger.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <nlohmann/json.hpp>
+#include <openssl/bio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#endif
+
+namespace mqtt::ktls {
+
+    KernelTls& KernelTls::instance() {
+        static KernelTls kernelTls;
+
+        return kernelTls;
+    }
+
+    void KernelTls::configure(const std::string& instances) {
+        std::size_t begin = 0;
+        while (begin < instances.size()) {
+            const std::size_t end = std::min(instances.find(',', begin), instances.size());
+            const std::string entry = instances.substr(begin, end - begin);
+            const std::size_t separator = entry.find('=');
+            const std::string value = separator != std::string::npos ? entry.substr(separator + 1) : "";
+
+            if (value == "on" || value == "off") {
+                const std::string instanceName = entry.substr(0, separator);
+
+                if (instanceName == "*") {
+                    enabledByDefault = value == "on";
+                } else {
+                    this->instances[instanceName].enabled = value == "on";
+                }
+            } else {
+                LOG(WARNING) << "KernelTls: Ignoring '" << entry << "'";
+            }
+
+            begin = end + 1;
+        }
+
+        const bool requested =
+            enabledByDefault || std::any_of(this->instances.begin(), this->instances.end(), [](const auto& entry) -> bool {
+                return entry.second.enabled;
+            });
+
+        if (requested) {
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+            available = probeKernel();
+            if (!available) {
+                LOG(WARNING) << "KernelTls: The kernel does not provide the 'tls' ULP (modprobe tls) - encrypting in user space";
+            }
+#else
+            LOG(WARNING) << "KernelTls: " << OPENSSL_VERSION_TEXT << " is built without kTLS - encrypting in user space";
+#endif
+        }
+    }
+
+    // Attaching the ULP to an unconnected socket loads the tls module on demand and fails with ENOTCONN if it is available
+    bool KernelTls::probeKernel() {
+        bool result = false;
+
+        const int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd >= 0) {
+            result = setsockopt(fd, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls")) == 0 || errno == ENOTCONN;
+            close(fd);
+        }
+
+        return result;
+    }
+
+    KernelTls::Instance& KernelTls::getInstance(const std::string& instanceName) {
+        std::map<std::string, Instance>::iterator it = instances.find(instanceName);
+        if (it == instances.end()) {
+            it = instances.emplace(instanceName, Instance{.enabled = enabledByDefault}).first;
+        }
+
+        return it->second;
+    }
+
+    void KernelTls::setup(const std::string& instanceName, SSL_CTX* sslCtx) {
+        if (sslCtx != nullptr && getInstance(instanceName).enabled && available) {
+#if defined(SSL_OP_ENABLE_KTLS)
+            if ((SSL_CTX_get_options(sslCtx) & SSL_OP_ENABLE_KTLS) == 0) {
+                SSL_CTX_set_options(sslCtx, SSL_OP_ENABLE_KTLS);
+                LOG(DEBUG) << instanceName << ": kTLS enabled";
+            }
+#endif
+        }
+    }
+
+    void KernelTls::handshake(const std::string& instanceName, SSL* ssl) {
+        if (ssl != nullptr) {
+            Instance& instance = getInstance(instanceName);
+
+            ++instance.connections;
+
+            if (instance.enabled && available) {
+#if defined(SSL_OP_ENABLE_KTLS)
+                const bool send = BIO_get_ktls_send(SSL_get_wbio(ssl)) != 0;
+                const bool receive = BIO_get_ktls_recv(SSL_get_rbio(ssl)) != 0;
+
+                instance.send += send ? 1 : 0;
+                instance.receive += receive ? 1 : 0;
+
+                if ((SSL_get_options(ssl) & SSL_OP_ENABLE_KTLS) != 0 && !send) {
+                    const std::string cipher = SSL_get_cipher_name(ssl);
+
+                    if (fallbacks.insert(instanceName + " " + cipher).second) {
+                        LOG(INFO) << instanceName << ": Cipher " << cipher << " (" << SSL_get_version(ssl)
+                                  << ") not offloaded by the kernel - encrypting in user space";
+                    }
+                }
+#endif
+            }
+        }
+    }
+
+    bool KernelTls::isAvailable() const {
+        return available;
+    }
+
+    const std::map<std::string, KernelTls::Instance>& KernelTls::getInstances() const {
+        return instances;
+    }
+
+    nlohmann::json KernelTls::toJson() const {
+        nlohmann::json json = nlohmann::json::object();
+
+        for (const auto& [instanceName, instance] : instances) {
+            json[instanceName] = {{"enabled", instance.enabled && available},
+                                  {"connections", instance.connections},
+                                  {"send", instance.send},
+                                  {"receive", instance.receive}};
+        }
+
+        return json;
+    }
+
+} // namespace mqtt::ktls
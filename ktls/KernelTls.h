@@ -0,0 +1,93 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KTLS_KERNELTLS_H
+#define KTLS_KERNELTLS_H
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <cstdint>
+#include <map>
+#include <nlohmann/json_fwd.hpp>
+#include <openssl/ssl.h>
+#include <set>
+#include <string>
+
+#endif
+
+namespace mqtt::ktls {
+
+    /* Opt-in kernel TLS (kTLS) offload of TLS connections.
+     *
+     * For an enabled instance OpenSSL hands the record encryption to the kernel once the handshake is done, thus SSL_write()
+     * becomes a plain send() of the application data without the user space encryption copy. Whether a connection is offloaded
+     * is decided per direction by OpenSSL and the kernel - for a cipher the kernel does not support, for an OpenSSL built
+     * without kTLS or a kernel without the "tls" ULP the connection silently stays in user space. Both are detected and the
+     * offloaded connections are counted per instance and direction.
+     *
+     * SSL_OP_ENABLE_KTLS must be set before the handshake derives the keys. It is set on the SSL_CTX of an instance before the
+     * first handshake - of a listener once it listens, of a client in onConnect before SNode.C starts TLS - thus all its
+     * connections including the first one are offloaded. */
+    class KernelTls {
+    private:
+        KernelTls() = default;
+
+    public:
+        struct Instance {
+            bool enabled = false;
+            uint64_t connections = 0; // completed handshakes
+            uint64_t send = 0;        // connections with kernel encryption
+            uint64_t receive = 0;     // connections with kernel decryption
+        };
+
+        KernelTls(const KernelTls&) = delete;
+        KernelTls& operator=(const KernelTls&) = delete;
+
+        static KernelTls& instance();
+
+        // instances: comma separated list of <instance>=on|off, "*" names the default - must be called after core::SNodeC::init()
+        void configure(const std::string& instances);
+
+        // Called once the SSL_CTX of an instance exists, before its first handshake
+        void setup(const std::string& instanceName, SSL_CTX* sslCtx);
+
+        // Called after each completed handshake
+        void handshake(const std::string& instanceName, SSL* ssl);
+
+        bool isAvailable() const;
+
+        const std::map<std::string, Instance>& getInstances() const;
+
+        nlohmann::json toJson() const;
+
+    private:
+        static bool probeKernel();
+
+        Instance& getInstance(const std::string& instanceName);
+
+        bool available = false;
+        bool enabledByDefault = false;
+
+        std::map<std::string, Instance> instances;
+        std::set<std::string> fallbacks; // "<instance> <cipher>" already logged
+    };
+
+} // namespace mqtt::ktls
+
+#endif // KTLS_KERNELTLS_H
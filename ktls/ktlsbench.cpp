@@ -0,0 +1,285 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ktls/KernelTls.h"
+
+#include <core/SNodeC.h>
+#include <utils/Config.h>
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <log/Logger.h>
+#include <netinet/in.h>
+#include <nlohmann/json.hpp>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <string>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#endif
+
+// Throughput of the TLS record layer with and without kernel TLS offload.
+//
+// The sending side is configured exactly like a broker listener: its SSL_CTX is set up by KernelTls before the handshake and
+// the bytes are written in blocks of the broker's write block size. A forked receiver decrypts in user space in all runs, thus
+// runs with --ktls on and off differ only in the sender. A run with --ktls on fails if the kernel did not take over the
+// encryption - a fallback to user space never shows up as a kTLS result.
+
+static const std::string instanceName = "ktlsbench";
+
+static double cpuSeconds() {
+    struct rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// A throwaway self-signed P-256 certificate - the benchmark does not depend on certificate files
+static bool useCertificate(SSL_CTX* sslCtx) {
+    bool success = false;
+
+    EVP_PKEY* key = nullptr;
+    EVP_PKEY_CTX* keyCtx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+    if (keyCtx != nullptr && EVP_PKEY_keygen_init(keyCtx) == 1 &&
+        EVP_PKEY_CTX_set_ec_paramgen_curve_nid(keyCtx, NID_X9_62_prime256v1) == 1) {
+        EVP_PKEY_keygen(keyCtx, &key);
+    }
+    EVP_PKEY_CTX_free(keyCtx);
+
+    X509* x509 = X509_new();
+    if (key != nullptr && x509 != nullptr) {
+        X509_set_version(x509, 2);
+        ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+        X509_gmtime_adj(X509_getm_notBefore(x509), 0);
+        X509_gmtime_adj(X509_getm_notAfter(x509), 24 * 3600);
+        X509_set_pubkey(x509, key);
+
+        X509_NAME* name = X509_get_subject_name(x509);
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("ktlsbench"), -1, -1, 0);
+        X509_set_issuer_name(x509, name);
+
+        success = X509_sign(x509, key, EVP_sha256()) > 0 && SSL_CTX_use_certificate(sslCtx, x509) == 1 &&
+                  SSL_CTX_use_PrivateKey(sslCtx, key) == 1;
+    }
+    X509_free(x509);
+    EVP_PKEY_free(key);
+
+    return success;
+}
+
+static SSL_CTX* newSslCtx(bool server, const std::string& tlsVersion) {
+    SSL_CTX* sslCtx = SSL_CTX_new(server ? TLS_server_method() : TLS_client_method());
+
+    if (sslCtx != nullptr) {
+        const int version = tlsVersion == "1.2" ? TLS1_2_VERSION : TLS1_3_VERSION;
+        SSL_CTX_set_min_proto_version(sslCtx, version);
+        SSL_CTX_set_max_proto_version(sslCtx, version);
+
+        // AES-GCM is offloaded by every kTLS capable kernel
+        SSL_CTX_set_ciphersuites(sslCtx, "TLS_AES_128_GCM_SHA256");
+        SSL_CTX_set_cipher_list(sslCtx, "ECDHE-ECDSA-AES128-GCM-SHA256");
+
+        if (server && !useCertificate(sslCtx)) {
+            LOG(ERROR) << "ktlsbench: Creating the certificate failed";
+            ERR_print_errors_fp(stderr);
+
+            SSL_CTX_free(sslCtx);
+            sslCtx = nullptr;
+        }
+    }
+
+    return sslCtx;
+}
+
+// Child process: reads and discards all bytes and acknowledges their receipt with a single byte
+static int runReceiver(uint16_t port, std::size_t bytes, const std::string& tlsVersion) {
+    int result = EXIT_FAILURE;
+
+    SSL_CTX* sslCtx = newSslCtx(false, tlsVersion);
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (sslCtx != nullptr && fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) {
+        SSL* ssl = SSL_new(sslCtx);
+        SSL_set_fd(ssl, fd);
+
+        if (SSL_connect(ssl) == 1) {
+            std::vector<char> buffer(256 * 1024);
+
+            std::size_t received = 0;
+            int ret = 1;
+            while (received < bytes && ret > 0) {
+                ret = SSL_read(ssl, buffer.data(), static_cast<int>(buffer.size()));
+                received += ret > 0 ? static_cast<std::size_t>(ret) : 0;
+            }
+
+            if (received == bytes && SSL_write(ssl, "!", 1) == 1) {
+                result = EXIT_SUCCESS;
+            }
+        }
+
+        SSL_free(ssl);
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+    SSL_CTX_free(sslCtx);
+
+    return result;
+}
+
+// Parent process: the measured side
+static int runSender(int listenFd, SSL_CTX* sslCtx, std::size_t bytes, std::size_t writeSize, bool ktls) {
+    int result = EXIT_FAILURE;
+
+    const int fd = accept(listenFd, nullptr, nullptr);
+    SSL* ssl = SSL_new(sslCtx);
+    SSL_set_fd(ssl, fd);
+
+    if (fd >= 0 && SSL_accept(ssl) == 1) {
+        mqtt::ktls::KernelTls& kernelTls = mqtt::ktls::KernelTls::instance();
+        kernelTls.handshake(instanceName, ssl);
+
+        const bool offloaded = kernelTls.getInstances().at(instanceName).send > 0;
+
+        if (ktls && !offloaded) {
+            LOG(ERROR) << "ktlsbench: The kernel did not take over the encryption (kTLS available: " << kernelTls.isAvailable()
+                       << ") - no kTLS result";
+        } else {
+            const std::vector<char> buffer(writeSize, 'x');
+
+            const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            const double cpuBegin = cpuSeconds();
+
+            std::size_t sent = 0;
+            int ret = 1;
+            while (sent < bytes && ret > 0) {
+                ret = SSL_write(ssl, buffer.data(), static_cast<int>(std::min(writeSize, bytes - sent)));
+                sent += ret > 0 ? static_cast<std::size_t>(ret) : 0;
+            }
+
+            char ack = 0;
+            if (sent == bytes && SSL_read(ssl, &ack, 1) == 1) {
+                const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+                const double cpu = cpuSeconds() - cpuBegin;
+
+                nlohmann::json json;
+                json["ktls"] = {{"requested", ktls}, {"offloaded", offloaded}};
+                json["cipher"] = SSL_get_cipher_name(ssl);
+                json["version"] = SSL_get_version(ssl);
+                json["bytes"] = bytes;
+                json["write_size"] = writeSize;
+                json["seconds"] = seconds;
+                json["throughput_mib_s"] = static_cast<double>(bytes) / seconds / (1024 * 1024);
+                json["sender_cpu_seconds"] = cpu;
+                json["sender_cpu_ns_per_byte"] = cpu * 1e9 / static_cast<double>(bytes);
+
+                std::cout << json.dump(2) << std::endl;
+
+                result = EXIT_SUCCESS;
+            }
+        }
+
+        SSL_shutdown(ssl);
+    }
+
+    SSL_free(ssl);
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    utils::Config::addStringOption("--ktls", "Kernel TLS offload of the sender, compare runs with on and off", "[on|off]", "off");
+    utils::Config::addStringOption("--bytes", "Bytes sent", "[bytes]", "1073741824");
+    utils::Config::addStringOption("--write-size", "Bytes per SSL_write(), the broker writes 64 KiB blocks", "[bytes]", "65536");
+    utils::Config::addStringOption("--tls", "TLS version", "[1.2|1.3]", "1.3");
+
+    core::SNodeC::init(argc, argv);
+
+    const bool ktls = utils::Config::getStringOptionValue("--ktls") == "on";
+    const std::size_t bytes = std::strtoull(utils::Config::getStringOptionValue("--bytes").data(), nullptr, 10);
+    const std::size_t writeSize =
+        std::max<std::size_t>(std::strtoull(utils::Config::getStringOptionValue("--write-size").data(), nullptr, 10), 1);
+    const std::string tlsVersion = utils::Config::getStringOptionValue("--tls");
+
+    mqtt::ktls::KernelTls::instance().configure(instanceName + "=" + (ktls ? "on" : "off"));
+
+    int result = EXIT_FAILURE;
+
+    SSL_CTX* sslCtx = newSslCtx(true, tlsVersion);
+    const int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addressLength = sizeof(address);
+
+    if (sslCtx != nullptr && listenFd >= 0 && bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0 &&
+        listen(listenFd, 1) == 0 && getsockname(listenFd, reinterpret_cast<sockaddr*>(&address), &addressLength) == 0) {
+        mqtt::ktls::KernelTls::instance().setup(instanceName, sslCtx);
+
+        const pid_t pid = fork();
+
+        if (pid == 0) {
+            close(listenFd);
+            _exit(runReceiver(ntohs(address.sin_port), bytes, tlsVersion));
+        } else if (pid > 0) {
+            result = runSender(listenFd, sslCtx, bytes, writeSize, ktls);
+
+            int status = 0;
+            waitpid(pid, &status, 0);
+            if (result == EXIT_SUCCESS && (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)) {
+                LOG(ERROR) << "ktlsbench: The receiver failed";
+                result = EXIT_FAILURE;
+            }
+        } else {
+            PLOG(ERROR) << "ktlsbench: fork";
+        }
+    } else {
+        PLOG(ERROR) << "ktlsbench: Setting up the sender failed";
+    }
+
+    if (listenFd >= 0) {
+        close(listenFd);
+    }
+    SSL_CTX_free(sslCtx);
+
+    return result;
+}
@@ -0,0 +1,178 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "LoopMonitor.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <algorithm>
+#include <log/Logger.h>
+#include <nlohmann/json.hpp>
+#include <sstream>
+
+#endif
+
+namespace mqtt::lib {
+
+    namespace {
+
+        constexpr double probeInterval = 0.1; // seconds
+        constexpr std::chrono::steady_clock::duration probePeriod =
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(probeInterval));
+        constexpr std::size_t reportedSites = 10;
+        constexpr std::size_t loggedSites = 3;
+
+    } // namespace
+
+    LoopMonitor::Probe::Probe(const char* site)
+        : site(site)
+        , begin(std::chrono::steady_clock::now()) {
+    }
+
+    LoopMonitor::Probe::~Probe() {
+        LoopMonitor::instance().record(site, std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+    }
+
+    LoopMonitor& LoopMonitor::instance() {
+        static LoopMonitor loopMonitor;
+
+        return loopMonitor;
+    }
+
+    void LoopMonitor::start(double stallThreshold, double logInterval) {
+        this->stallThreshold = stallThreshold;
+
+        if (!probeTimer) {
+            probeExpected = std::chrono::steady_clock::now() + probePeriod;
+
+            probeTimer = core::timer::Timer::intervalTimer(
+                [this]() -> void {
+                    probe();
+                },
+                probeInterval);
+        }
+
+        if (logInterval > 0 && !logTimer) {
+            logTimer = core::timer::Timer::intervalTimer(
+                [this]() -> void {
+                    logSummary();
+                },
+                logInterval);
+        }
+    }
+
+    void LoopMonitor::record(const char* site, double seconds) {
+        std::vector<Site>::iterator it = std::find_if(sites.begin(), sites.end(), [site](const Site& candidate) -> bool {
+            return candidate.name == site;
+        });
+
+        if (it == sites.end()) {
+            sites.push_back({site});
+            it = sites.end() - 1;
+        }
+
+        it->calls++;
+        it->total += seconds;
+        it->slowest = std::max(it->slowest, seconds);
+
+        if (seconds > stallThreshold) {
+            it->stalls++;
+            stalls++;
+        }
+    }
+
+    void LoopMonitor::probe() {
+        // The delay of an interval timer beyond its period is the time the event loop spent elsewhere
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        const double lag = std::max(0.0, std::chrono::duration<double>(now - probeExpected).count());
+
+        lagCounts[static_cast<std::size_t>(std::lower_bound(lagBounds.begin(), lagBounds.end(), lag) - lagBounds.begin())]++;
+        lagSum += lag;
+        maxLag = std::max(maxLag, lag);
+
+        probeExpected = now + probePeriod;
+    }
+
+    std::vector<const LoopMonitor::Site*> LoopMonitor::slowestSites(std::size_t count) const {
+        std::vector<const Site*> slowest;
+        for (const Site& site : sites) {
+            slowest.push_back(&site);
+        }
+
+        std::sort(slowest.begin(), slowest.end(), [](const Site* lhs, const Site* rhs) -> bool {
+            return lhs->slowest > rhs->slowest;
+        });
+        slowest.resize(std::min(count, slowest.size()));
+
+        return slowest;
+    }
+
+    const std::array<uint64_t, LoopMonitor::lagBounds.size() + 1>& LoopMonitor::getLagCounts() const {
+        return lagCounts;
+    }
+
+    double LoopMonitor::getLagSum() const {
+        return lagSum;
+    }
+
+    nlohmann::json LoopMonitor::toJson() const {
+        nlohmann::json json;
+
+        nlohmann::json& histogram = json["lag"]["histogram"];
+        for (std::size_t bucket = 0; bucket < lagCounts.size(); ++bucket) {
+            histogram.push_back({{"le", bucket < lagBounds.size() ? nlohmann::json(lagBounds[bucket]) : nlohmann::json("+Inf")},
+                                 {"count", lagCounts[bucket]}});
+        }
+        json["lag"]["max"] = maxLag;
+
+        json["stall_threshold"] = stallThreshold;
+        json["stalls"] = stalls;
+
+        json["sites"] = nlohmann::json::array();
+        for (const Site* site : slowestSites(reportedSites)) {
+            json["sites"].push_back({{"site", site->name},
+                                     {"calls", site->calls},
+                                     {"stalls", site->stalls},
+                                     {"average", site->total / static_cast<double>(site->calls)},
+                                     {"slowest", site->slowest}});
+        }
+
+        return json;
+    }
+
+    void LoopMonitor::logSummary() {
+        uint64_t probes = 0;
+        uint64_t lateProbes = 0; // later than the stall threshold
+        for (std::size_t bucket = 0; bucket < lagCounts.size(); ++bucket) {
+            probes += lagCounts[bucket];
+            if (bucket > 0 && lagBounds[bucket - 1] >= stallThreshold) {
+                lateProbes += lagCounts[bucket];
+            }
+        }
+
+        std::ostringstream slowest;
+        for (const Site* site : slowestSites(loggedSites)) {
+            slowest << " '" << site->name << "' " << site->slowest * 1000 << " ms (" << site->stalls << "/" << site->calls << ")";
+        }
+
+        LOG(INFO) << "LoopMonitor: lag max " << maxLag * 1000 << " ms, " << lateProbes << "/" << probes << " probes over "
+                  << stallThreshold * 1000 << " ms, " << stalls << " stalled callbacks, slowest:" << slowest.str();
+    }
+
+} // namespace mqtt::lib
@@ -0,0 +1,113 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MQTTBROKER_LIB_LOOPMONITOR_H
+#define MQTTBROKER_LIB_LOOPMONITOR_H
+
+#include <core/timer/Timer.h>
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <nlohmann/json_fwd.hpp>
+#include <optional>
+#include <string>
+#include <vector>
+
+#endif
+
+namespace mqtt::lib {
+
+    /* Event loop latency and stall instrumentation.
+     *
+     * A probe timer measures how late the event loop runs it. The lateness is the time the loop spent in other callbacks and
+     * is counted into a histogram. Callbacks of interest are wrapped into a Probe naming their site, e.g. "timer: shard bus" or
+     * "http: /api/clients". Per site the number of calls, the calls exceeding the stall threshold and the duration of the
+     * slowest call are kept. A probe costs two steady clock reads and a lookup among the few distinct sites, cheap enough to
+     * stay enabled in production. */
+    class LoopMonitor {
+    private:
+        LoopMonitor() = default;
+
+    public:
+        class Probe {
+        public:
+            explicit Probe(const char* site); // site must be a string literal - sites are identified by address
+
+            Probe(const Probe&) = delete;
+            Probe& operator=(const Probe&) = delete;
+
+            ~Probe();
+
+        private:
+            const char* site;
+            std::chrono::steady_clock::time_point begin;
+        };
+
+        LoopMonitor(const LoopMonitor&) = delete;
+        LoopMonitor& operator=(const LoopMonitor&) = delete;
+
+        static LoopMonitor& instance();
+
+        // Must be called after core::SNodeC::init() - logInterval 0 disables the periodic log summary
+        void start(double stallThreshold, double logInterval);
+
+        void record(const char* site, double seconds);
+
+        nlohmann::json toJson() const;
+
+        static constexpr std::array<double, 10> lagBounds = {0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 1};
+
+        const std::array<uint64_t, lagBounds.size() + 1>& getLagCounts() const; // last bucket is beyond the largest bound
+        double getLagSum() const;
+
+    private:
+        struct Site {
+            const char* name;
+            uint64_t calls = 0;
+            uint64_t stalls = 0; // calls longer than the stall threshold
+            double total = 0;
+            double slowest = 0;
+        };
+
+        void probe();
+        void logSummary();
+
+        std::vector<const Site*> slowestSites(std::size_t count) const;
+
+        double stallThreshold = 0.05;
+
+        std::vector<Site> sites;
+        uint64_t stalls = 0;
+
+        std::array<uint64_t, lagBounds.size() + 1> lagCounts{}; // last bucket is beyond the largest bound
+        double lagSum = 0;
+        double maxLag = 0;
+        std::chrono::steady_clock::time_point probeExpected;
+
+        std::optional<core::timer::Timer> probeTimer;
+        std::optional<core::timer::Timer> logTimer;
+    };
+
+} // namespace mqtt::lib
+
+#endif // MQTTBROKER_LIB_LOOPMONITOR_H
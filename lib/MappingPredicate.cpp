@@ -0,0 +1,344 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MappingPredicate.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <cctype>
+#include <compare>
+#include <stdexcept>
+
+#endif
+
+namespace mqtt::lib {
+
+    MappingPredicate::MappingPredicate(const std::string& expression)
+        : expression(expression) {
+        root = parseOr();
+
+        skipSpace();
+        if (position != expression.size()) {
+            fail("unexpected trailing input");
+        }
+
+        this->expression.clear();
+    }
+
+    bool MappingPredicate::evaluate(const nlohmann::json& json) const {
+        return evaluate(root, json);
+    }
+
+    void MappingPredicate::fail(const std::string& what) const {
+        throw std::invalid_argument(what + " at position " + std::to_string(position) + " in '" + expression + "'");
+    }
+
+    void MappingPredicate::skipSpace() {
+        while (position < expression.size() && std::isspace(static_cast<unsigned char>(expression[position])) != 0) {
+            ++position;
+        }
+    }
+
+    bool MappingPredicate::accept(const std::string& token) {
+        skipSpace();
+
+        const bool accepted = expression.compare(position, token.size(), token) == 0;
+        if (accepted) {
+            position += token.size();
+        }
+
+        return accepted;
+    }
+
+    bool MappingPredicate::acceptWord(const std::string& word) {
+        skipSpace();
+
+        const std::size_t end = position + word.size();
+        const bool accepted = expression.compare(position, word.size(), word) == 0 &&
+                              (end == expression.size() ||
+                               (std::isalnum(static_cast<unsigned char>(expression[end])) == 0 && expression[end] != '_'));
+        if (accepted) {
+            position = end;
+        }
+
+        return accepted;
+    }
+
+    std::string MappingPredicate::parseName() {
+        skipSpace();
+
+        const std::size_t begin = position;
+        while (position < expression.size() &&
+               (std::isalnum(static_cast<unsigned char>(expression[position])) != 0 || expression[position] == '_')) {
+            ++position;
+        }
+
+        if (begin == position) {
+            fail("name expected");
+        }
+
+        return expression.substr(begin, position - begin);
+    }
+
+    std::size_t MappingPredicate::parseOr() {
+        std::size_t lhs = parseAnd();
+
+        while (accept("||") || acceptWord("or")) {
+            const std::size_t rhs = parseAnd();
+
+            nodes.push_back({Kind::OR, lhs, rhs});
+            lhs = nodes.size() - 1;
+        }
+
+        return lhs;
+    }
+
+    std::size_t MappingPredicate::parseAnd() {
+        std::size_t lhs = parseNot();
+
+        while (accept("&&") || acceptWord("and")) {
+            const std::size_t rhs = parseNot();
+
+            nodes.push_back({Kind::AND, lhs, rhs});
+            lhs = nodes.size() - 1;
+        }
+
+        return lhs;
+    }
+
+    std::size_t MappingPredicate::parseNot() {
+        std::size_t node = 0;
+
+        skipSpace();
+        if ((expression.compare(position, 2, "!=") != 0 && accept("!")) || acceptWord("not")) {
+            nodes.push_back({Kind::NOT, parseNot(), 0});
+            node = nodes.size() - 1;
+        } else {
+            node = parseCompare();
+        }
+
+        return node;
+    }
+
+    std::size_t MappingPredicate::parseCompare() {
+        std::size_t node = 0;
+
+        if (accept("(")) {
+            node = parseOr();
+
+            if (!accept(")")) {
+                fail("')' expected");
+            }
+        } else {
+            const std::size_t lhs = parseOperand();
+
+            Kind kind = Kind::TRUTHY;
+            if (accept("==")) {
+                kind = Kind::EQ;
+            } else if (accept("!=")) {
+                kind = Kind::NE;
+            } else if (accept("<=")) {
+                kind = Kind::LE;
+            } else if (accept(">=")) {
+                kind = Kind::GE;
+            } else if (accept("<")) {
+                kind = Kind::LT;
+            } else if (accept(">")) {
+                kind = Kind::GT;
+            }
+
+            nodes.push_back({kind, lhs, kind != Kind::TRUTHY ? parseOperand() : 0});
+            node = nodes.size() - 1;
+        }
+
+        return node;
+    }
+
+    std::size_t MappingPredicate::parseOperand() {
+        Operand operand;
+
+        skipSpace();
+        if (position >= expression.size()) {
+            fail("operand expected");
+        }
+
+        const char c = expression[position];
+
+        if (c == '"' || c == '\'') {
+            const std::size_t end = expression.find(c, position + 1);
+            if (end == std::string::npos) {
+                fail("unterminated string");
+            }
+
+            operand.literal = expression.substr(position + 1, end - position - 1);
+            position = end + 1;
+        } else if (std::isdigit(static_cast<unsigned char>(c)) != 0 || c == '-' || c == '.') {
+            std::size_t length = 0;
+
+            try {
+                operand.literal = std::stod(expression.substr(position), &length);
+            } catch (const std::logic_error&) {
+                fail("number expected");
+            }
+
+            position += length;
+        } else if (acceptWord("true")) {
+            operand.literal = true;
+        } else if (acceptWord("false")) {
+            operand.literal = false;
+        } else if (acceptWord("null")) {
+            operand.literal = nullptr;
+        } else {
+            operand.isPath = true;
+            operand.path.push_back(parseName());
+
+            for (;;) {
+                if (accept(".")) {
+                    operand.path.push_back(parseName());
+                } else if (accept("[")) {
+                    skipSpace();
+
+                    const std::size_t begin = position;
+                    while (position < expression.size() && std::isdigit(static_cast<unsigned char>(expression[position])) != 0) {
+                        ++position;
+                    }
+
+                    const std::string index = expression.substr(begin, position - begin);
+                    if (index.empty() || !accept("]")) {
+                        fail("array index expected");
+                    }
+
+                    operand.path.push_back(index);
+                } else {
+                    break;
+                }
+            }
+        }
+
+        operands.push_back(std::move(operand));
+
+        return operands.size() - 1;
+    }
+
+    const nlohmann::json* MappingPredicate::resolve(std::size_t operandIndex, const nlohmann::json& json) const {
+        const Operand& operand = operands[operandIndex];
+        const nlohmann::json* value = &operand.literal;
+
+        if (operand.isPath) {
+            value = json.contains(operand.path) ? &json[operand.path] : nullptr;
+        }
+
+        return value;
+    }
+
+    bool MappingPredicate::truthy(const nlohmann::json* value) {
+        bool result = false;
+
+        if (value != nullptr) {
+            if (value->is_boolean()) {
+                result = value->get<bool>();
+            } else if (value->is_number()) {
+                result = value->get<double>() != 0;
+            } else if (value->is_string() || value->is_array() || value->is_object()) {
+                result = !value->empty() && !(value->is_string() && value->get_ref<const std::string&>().empty());
+            }
+        }
+
+        return result;
+    }
+
+    std::partial_ordering MappingPredicate::compare(const nlohmann::json* lhs, const nlohmann::json* rhs) {
+        std::partial_ordering order = std::partial_ordering::unordered;
+
+        if (lhs != nullptr && rhs != nullptr) {
+            if (lhs->is_number() && rhs->is_number()) {
+                order = lhs->get<double>() <=> rhs->get<double>();
+            } else if (lhs->is_string() && rhs->is_string()) {
+                order = lhs->get_ref<const std::string&>() <=> rhs->get_ref<const std::string&>();
+            } else if (lhs->is_number() && rhs->is_string()) {
+                order = compare(*lhs, rhs->get_ref<const std::string&>());
+            } else if (lhs->is_string() && rhs->is_number()) {
+                order = 0 <=> compare(*rhs, lhs->get_ref<const std::string&>());
+            } else if (*lhs == *rhs) {
+                order = std::partial_ordering::equivalent;
+            }
+        }
+
+        return order;
+    }
+
+    std::partial_ordering MappingPredicate::compare(const nlohmann::json& number, const std::string& string) {
+        std::partial_ordering order = std::partial_ordering::unordered;
+
+        try {
+            std::size_t length = 0;
+            const double value = std::stod(string, &length);
+
+            if (length == string.size()) {
+                order = number.get<double>() <=> value;
+            }
+        } catch (const std::logic_error&) {
+            // not a number - unordered
+        }
+
+        return order;
+    }
+
+    bool MappingPredicate::evaluate(std::size_t nodeIndex, const nlohmann::json& json) const {
+        const Node& node = nodes[nodeIndex];
+
+        bool result = false;
+
+        switch (node.kind) {
+            case Kind::OR:
+                result = evaluate(node.lhs, json) || evaluate(node.rhs, json);
+                break;
+            case Kind::AND:
+                result = evaluate(node.lhs, json) && evaluate(node.rhs, json);
+                break;
+            case Kind::NOT:
+                result = !evaluate(node.lhs, json);
+                break;
+            case Kind::TRUTHY:
+                result = truthy(resolve(node.lhs, json));
+                break;
+            case Kind::EQ:
+                result = compare(resolve(node.lhs, json), resolve(node.rhs, json)) == 0;
+                break;
+            case Kind::NE:
+                result = compare(resolve(node.lhs, json), resolve(node.rhs, json)) != 0;
+                break;
+            case Kind::LT:
+                result = compare(resolve(node.lhs, json), resolve(node.rhs, json)) < 0;
+                break;
+            case Kind::LE:
+                result = compare(resolve(node.lhs, json), resolve(node.rhs, json)) <= 0;
+                break;
+            case Kind::GT:
+                result = compare(resolve(node.lhs, json), resolve(node.rhs, json)) > 0;
+                break;
+            case Kind::GE:
+                result = compare(resolve(node.lhs, json), resolve(node.rhs, json)) >= 0;
+                break;
+        }
+
+        return result;
+    }
+
+} // namespace mqtt::lib
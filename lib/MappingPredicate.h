@@ -0,0 +1,98 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MQTTBROKER_LIB_MAPPINGPREDICATE_H
+#define MQTTBROKER_LIB_MAPPINGPREDICATE_H
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+#endif
+
+namespace mqtt::lib {
+
+    /* A "when" condition of a template mapping, compiled once when the mapping is loaded.
+     *
+     * Grammar:
+     *   expr    := and ( ( "||" | "or" ) and )*
+     *   and     := not ( ( "&&" | "and" ) not )*
+     *   not     := ( "!" | "not" ) not | compare
+     *   compare := operand [ ( "==" | "!=" | "<" | "<=" | ">" | ">=" ) operand ]
+     *   operand := path | number | string | true | false | null | "(" expr ")"
+     *   path    := name ( "." name | "[" index "]" )*     e.g. message.sensors[0].temperature, topic, qos, retain
+     *
+     * Paths are resolved against the render data of the mapping. A number compared with a string containing a number is
+     * compared numerically, thus "message > 20" also works for value mappings. */
+    class MappingPredicate {
+    public:
+        explicit MappingPredicate(const std::string& expression); // throws std::invalid_argument
+
+        bool evaluate(const nlohmann::json& json) const;
+
+    private:
+        enum class Kind : uint8_t { OR, AND, NOT, TRUTHY, EQ, NE, LT, LE, GT, GE };
+
+        struct Operand {
+            bool isPath = false;
+            nlohmann::json::json_pointer path;
+            nlohmann::json literal;
+        };
+
+        struct Node {
+            Kind kind;
+            std::size_t lhs; // node index for OR, AND, NOT - operand index otherwise
+            std::size_t rhs;
+        };
+
+        std::size_t parseOr();
+        std::size_t parseAnd();
+        std::size_t parseNot();
+        std::size_t parseCompare();
+        std::size_t parseOperand();
+
+        void skipSpace();
+        bool accept(const std::string& token);
+        bool acceptWord(const std::string& word);
+        std::string parseName();
+        [[noreturn]] void fail(const std::string& what) const;
+
+        bool evaluate(std::size_t nodeIndex, const nlohmann::json& json) const;
+        const nlohmann::json* resolve(std::size_t operandIndex, const nlohmann::json& json) const;
+
+        static bool truthy(const nlohmann::json* value);
+        static std::partial_ordering compare(const nlohmann::json* lhs, const nlohmann::json* rhs);
+        static std::partial_ordering compare(const nlohmann::json& number, const std::string& string);
+
+        std::vector<Node> nodes;
+        std::vector<Operand> operands;
+        std::size_t root = 0;
+
+        std::string expression; // only used during compilation
+        std::size_t position = 0;
+    };
+
+} // namespace mqtt::lib
+
+#endif // MQTTBROKER_LIB_MAPPINGPREDICATE_H
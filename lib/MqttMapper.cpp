@@ -19,6 +19,8 @@
 
 #include "MqttMapper.h"
 
+#include "LoopMonitor.h"
+#include "MappingPredicate.h"
 #include "MqttMapperPlugin.h"
 
 #include <cmath>
@@ -64,6 +66,10 @@
 #include <log/Logger.h>
 #include <map>
 #include <nlohmann/json.hpp>
+#include <ostream>
+#include <stdexcept>
+#include <streambuf>
+#include <utility>
 #include <vector>
 
 #endif
@@ -72,8 +78,68 @@
 
 namespace mqtt::lib {
 
+    namespace {
+
+        // Stream buffer appending to a std::string owned by the caller. Rendering thus reuses the capacity of that string instead of
+        // building a temporary std::ostringstream and copying its content out.
+        class StringAppendBuffer : public std::streambuf {
+        public:
+            explicit StringAppendBuffer(std::string& string)
+                : string(string) {
+            }
+
+        protected:
+            int_type overflow(int_type ch) override {
+                if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+                    string.push_back(traits_type::to_char_type(ch));
+                }
+
+                return ch;
+            }
+
+            std::streamsize xsputn(const char* s, std::streamsize n) override {
+                string.append(s, static_cast<std::size_t>(n));
+
+                return n;
+            }
+
+        private:
+            std::string& string;
+        };
+
+        class RenderDepthGuard {
+        public:
+            explicit RenderDepthGuard(std::size_t& renderDepth)
+                : renderDepth(renderDepth) {
+                renderDepth += 2;
+            }
+
+            RenderDepthGuard(const RenderDepthGuard&) = delete;
+            RenderDepthGuard& operator=(const RenderDepthGuard&) = delete;
+
+            ~RenderDepthGuard() {
+                renderDepth -= 2;
+            }
+
+        private:
+            std::size_t& renderDepth;
+        };
+
+    } // namespace
+
+    std::map<const nlohmann::json*, std::weak_ptr<MqttMapper::MappingState>> MqttMapper::mappingStates;
+
     MqttMapper::MqttMapper(const nlohmann::json& mappingJson)
         : mappingJson(mappingJson) {
+        std::weak_ptr<MappingState>& sharedState = mappingStates[&mappingJson];
+
+        state = sharedState.lock();
+        if (!state) {
+            state = std::make_shared<MappingState>();
+            sharedState = state;
+        }
+        state->mappers.push_back(this);
+
         injaEnvironment = new inja::Environment;
 
         if (mappingJson.contains("plugins")) {
@@ -133,9 +199,43 @@ namespace mqtt::lib {
 
             VLOG(1) << "Loading plugins done";
         }
+
+        if (mappingJson.contains("joins")) {
+            for (const auto& [name, joinJson] : mappingJson["joins"].items()) {
+                Join& join = state->joins[&joinJson];
+
+                if (join.definition == nullptr) {
+                    join.definition = &joinJson;
+                    join.requireAll = joinJson.value("require_all", true);
+                    join.renderData["values"] = nlohmann::json::object();
+                    join.topic = &join.renderData["topic"];
+                    join.trigger = &join.renderData["trigger"];
+                    join.qoS = &join.renderData["qos"];
+                    join.retain = &join.renderData["retain"];
+                }
+
+                compileTemplateMapping(joinJson);
+            }
+        }
+
+        if (mappingJson.contains("topic_level")) {
+            compileMappings(mappingJson["topic_level"]);
+        }
     }
 
     MqttMapper::~MqttMapper() {
+        state->mappers.remove(this);
+
+        if (state->mappers.empty()) {
+            for (auto& [topic, batch] : state->batches) {
+                if (batch.timer) {
+                    batch.timer->cancel();
+                }
+            }
+
+            mappingStates.erase(&mappingJson);
+        }
+
         delete injaEnvironment;
 
         for (void* pluginHandle : pluginHandles) {
@@ -156,19 +256,26 @@ namespace mqtt::lib {
     }
 
     void MqttMapper::publishMappings(const iot::mqtt::packets::Publish& publish) {
+        publishMappings(
+            MappedPublish{publish.getTopic(), publish.getMessage(), publish.getQoS(), publish.getRetain(), publish.getPacketIdentifier()});
+    }
+
+    void MqttMapper::publishMappings(const MappedPublish& publish) {
+        const LoopMonitor::Probe probe("mapping: publish");
+
         if (!mappingJson.empty()) {
-            nlohmann::json matchingTopicLevel = findMatchingTopicLevel(mappingJson["topic_level"], publish.getTopic());
+            const nlohmann::json* matchingTopicLevel = findMatchingTopicLevel(mappingJson["topic_level"], publish.topic);
 
-            if (!matchingTopicLevel.empty()) {
-                const nlohmann::json& subscription = matchingTopicLevel["subscription"];
+            if (matchingTopicLevel != nullptr && matchingTopicLevel->contains("subscription")) {
+                const nlohmann::json& subscription = (*matchingTopicLevel)["subscription"];
 
                 if (subscription.contains("static")) {
                     VLOG(1) << "Topic mapping found for:";
                     VLOG(1) << "  Type: static";
-                    VLOG(1) << "  Topic: " << publish.getTopic();
-                    VLOG(1) << "  Message: " << publish.getMessage();
-                    VLOG(1) << "  QoS: " << static_cast<uint16_t>(publish.getQoS());
-                    VLOG(1) << "  Retain: " << publish.getRetain();
+                    VLOG(1) << "  Topic: " << publish.topic;
+                    VLOG(1) << "  Message: " << publish.message;
+                    VLOG(1) << "  QoS: " << static_cast<uint16_t>(publish.qoS);
+                    VLOG(1) << "  Retain: " << publish.retain;
 
                     publishMappedMessages(subscription["static"], publish);
                 }
@@ -176,32 +283,43 @@ namespace mqtt::lib {
                 if (subscription.contains("value")) {
                     VLOG(1) << "Topic mapping found for:";
                     VLOG(1) << "  Type: value";
-                    VLOG(1) << "  Topic: " << publish.getTopic();
-                    VLOG(1) << "  Message: " << publish.getMessage();
-                    VLOG(1) << "  QoS: " << static_cast<uint16_t>(publish.getQoS());
-                    VLOG(1) << "  Retain: " << publish.getRetain();
+                    VLOG(1) << "  Topic: " << publish.topic;
+                    VLOG(1) << "  Message: " << publish.message;
+                    VLOG(1) << "  QoS: " << static_cast<uint16_t>(publish.qoS);
+                    VLOG(1) << "  Retain: " << publish.retain;
 
                     nlohmann::json json;
-                    json["message"] = publish.getMessage();
+                    json["message"] = publish.message;
 
                     publishMappedTemplates(subscription["value"], json, publish);
                 }
 
+                if (subscription.contains("join")) {
+                    VLOG(1) << "Topic mapping found for:";
+                    VLOG(1) << "  Type: join";
+                    VLOG(1) << "  Topic: " << publish.topic;
+                    VLOG(1) << "  Message: " << publish.message;
+                    VLOG(1) << "  QoS: " << static_cast<uint16_t>(publish.qoS);
+                    VLOG(1) << "  Retain: " << publish.retain;
+
+                    publishJoins(subscription["join"], publish);
+                }
+
                 if (subscription.contains("json")) {
                     VLOG(1) << "Topic mapping found for:";
                     VLOG(1) << "  Type: json";
-                    VLOG(1) << "  Topic: " << publish.getTopic();
-                    VLOG(1) << "  Message: " << publish.getMessage();
-                    VLOG(1) << "  QoS: " << static_cast<uint16_t>(publish.getQoS());
-                    VLOG(1) << "  Retain: " << publish.getRetain();
+                    VLOG(1) << "  Topic: " << publish.topic;
+                    VLOG(1) << "  Message: " << publish.message;
+                    VLOG(1) << "  QoS: " << static_cast<uint16_t>(publish.qoS);
+                    VLOG(1) << "  Retain: " << publish.retain;
 
                     try {
                         nlohmann::json json;
-                        json["message"] = nlohmann::json::parse(publish.getMessage());
+                        json["message"] = nlohmann::json::parse(publish.message);
 
                         publishMappedTemplates(subscription["json"], json, publish);
                     } catch (const nlohmann::json::parse_error& e) {
-                        LOG(ERROR) << "  Parsing message into json failed: " << publish.getMessage();
+                        LOG(ERROR) << "  Parsing message into json failed: " << publish.message;
                         LOG(ERROR) << "     What: " << e.what() << '\n'
                                    << "     Exception Id: " << e.id << '\n'
                                    << "     Byte position of error: " << e.byte;
@@ -240,8 +358,8 @@ namespace mqtt::lib {
         }
     }
 
-    nlohmann::json MqttMapper::findMatchingTopicLevel(const nlohmann::json& topicLevel, const std::string& topic) {
-        nlohmann::json foundTopicLevel;
+    const nlohmann::json* MqttMapper::findMatchingTopicLevel(const nlohmann::json& topicLevel, const std::string& topic) {
+        const nlohmann::json* foundTopicLevel = nullptr;
 
         if (topicLevel.is_object()) {
             const std::string::size_type slashPosition = topic.find('/');
@@ -249,7 +367,7 @@ namespace mqtt::lib {
 
             if (topicLevel["name"] == topicLevelName) {
                 if (slashPosition == std::string::npos) {
-                    foundTopicLevel = topicLevel;
+                    foundTopicLevel = &topicLevel;
                 } else if (topicLevel.contains("topic_level")) {
                     foundTopicLevel = findMatchingTopicLevel(topicLevel["topic_level"], topic.substr(slashPosition + 1));
                 }
@@ -258,7 +376,7 @@ namespace mqtt::lib {
             for (const nlohmann::json& topicLevelEntry : topicLevel) {
                 foundTopicLevel = findMatchingTopicLevel(topicLevelEntry, topic);
 
-                if (!foundTopicLevel.empty()) {
+                if (foundTopicLevel != nullptr) {
                     break;
                 }
             }
@@ -267,66 +385,214 @@ namespace mqtt::lib {
         return foundTopicLevel;
     }
 
-    void MqttMapper::publishMappedTemplate(const nlohmann::json& templateMapping, nlohmann::json& json) {
-        const std::string& mappingTemplate = templateMapping["mapping_template"];
-        const std::string& mappedTopic = templateMapping["mapped_topic"];
+    void MqttMapper::compileMappings(const nlohmann::json& topicLevel) {
+        if (topicLevel.is_array()) {
+            for (const nlohmann::json& topicLevelEntry : topicLevel) {
+                compileMappings(topicLevelEntry);
+            }
+        } else if (topicLevel.is_object()) {
+            if (topicLevel.contains("subscription")) {
+                const nlohmann::json& subscription = topicLevel["subscription"];
 
-        try {
-            // Render topic
-            const std::string renderedTopic = injaEnvironment->render(mappedTopic, json);
-            json["mapped_topic"] = renderedTopic;
+                for (const char* type : {"value", "json"}) {
+                    if (subscription.contains(type)) {
+                        compileTemplateMappings(subscription[type]);
+                    }
+                }
+
+                if (subscription.contains("join")) {
+                    const nlohmann::json& joinMapping = subscription["join"];
+                    std::vector<JoinInput>& inputs = joinInputs[&joinMapping];
+
+                    if (joinMapping.is_object()) {
+                        compileJoinInput(joinMapping, inputs);
+                    } else {
+                        for (const nlohmann::json& joinInputJson : joinMapping) {
+                            compileJoinInput(joinInputJson, inputs);
+                        }
+                    }
+                }
+            }
+
+            if (topicLevel.contains("topic_level")) {
+                compileMappings(topicLevel["topic_level"]);
+            }
+        }
+    }
+
+    void MqttMapper::compileJoinInput(const nlohmann::json& joinInputJson, std::vector<JoinInput>& inputs) {
+        const std::string& name = joinInputJson["name"].get_ref<const std::string&>();
+        const std::string& slotName = joinInputJson["slot"].get_ref<const std::string&>();
 
-            VLOG(1) << "  Mapped topic template: " << mappedTopic;
-            VLOG(1) << "    -> " << renderedTopic;
+        if (mappingJson.contains("joins") && mappingJson["joins"].contains(name)) {
+            Join& join = state->joins[&mappingJson["joins"][name]];
+
+            const std::vector<std::string>::const_iterator slotIt = std::find(join.slotNames.begin(), join.slotNames.end(), slotName);
+            std::size_t slot = static_cast<std::size_t>(slotIt - join.slotNames.begin());
+
+            if (slotIt == join.slotNames.end()) {
+                const nlohmann::json trigger = join.definition->value("trigger", nlohmann::json::array());
+
+                join.slotNames.push_back(slotName);
+                join.values.push_back(&(join.renderData["values"][slotName] = nullptr));
+                join.present.push_back(false);
+                join.triggers.push_back(trigger.empty() || std::find(trigger.begin(), trigger.end(), slotName) != trigger.end());
+                join.missing++;
+            }
+
+            inputs.push_back({&join, slot, joinInputJson.value("json", false)});
+
+            VLOG(1) << "  Compiled join input: " << name << "[" << slot << "] = " << slotName;
+        } else {
+            LOG(ERROR) << "  Compiling join input failed: Join '" << name << "' not defined";
+        }
+    }
+
+    void MqttMapper::compileTemplateMappings(const nlohmann::json& templateMapping) {
+        if (templateMapping.is_object()) {
+            compileTemplateMapping(templateMapping);
+        } else {
+            for (const nlohmann::json& concreteTemplateMapping : templateMapping) {
+                compileTemplateMapping(concreteTemplateMapping);
+            }
+        }
+    }
+
+    void MqttMapper::compileTemplateMapping(const nlohmann::json& templateMapping) {
+        if (templateMapping.contains("when")) {
+            const std::string& when = templateMapping["when"].get_ref<const std::string&>();
 
             try {
-                // Render message
-                const std::string renderedMessage = injaEnvironment->render(mappingTemplate, json);
-                VLOG(1) << "  Mapped message template: " << mappingTemplate;
-                VLOG(1) << "    -> " << renderedMessage;
+                predicates.emplace(&templateMapping, MappingPredicate(when));
 
-                const nlohmann::json& suppressions = templateMapping["suppressions"];
-                const bool retain = templateMapping["retain"];
+                VLOG(1) << "  Compiled mapping condition: " << when;
+            } catch (const std::invalid_argument& e) {
+                LOG(ERROR) << "  Compiling mapping condition failed: " << e.what();
+                LOG(ERROR) << "    Mapping disabled: " << templateMapping.dump();
 
-                if (suppressions.empty() || std::find(suppressions.begin(), suppressions.end(), renderedMessage) == suppressions.end() ||
-                    (retain && renderedMessage.empty())) {
-                    const uint8_t qoS = templateMapping["qos"];
+                predicates.emplace(&templateMapping, MappingPredicate("false"));
+            }
+        }
 
-                    VLOG(1) << "  Send mapping:";
-                    VLOG(1) << "    Topic: " << renderedTopic;
-                    VLOG(1) << "    Message: " << renderedMessage << "";
-                    VLOG(1) << "    QoS: " << static_cast<int>(qoS);
-                    VLOG(1) << "    retain: " << retain;
+        CompiledTemplate& compiledTemplate = templates[&templateMapping];
+        compiledTemplate.topic = compileTemplate(templateMapping["mapped_topic"]);
+        compiledTemplate.message = compileTemplate(templateMapping["mapping_template"]);
+    }
 
-                    publishMapping(renderedTopic, renderedMessage, qoS, retain);
-                } else {
-                    VLOG(1) << "    Rendered message: '" << renderedMessage << "' in suppression list:";
-                    for (const nlohmann::json& item : suppressions) {
-                        VLOG(1) << "         '" << item.get<std::string>() << "'";
+    std::unique_ptr<inja::Template> MqttMapper::compileTemplate(const std::string& source) {
+        std::unique_ptr<inja::Template> compiledTemplate;
+
+        try {
+            compiledTemplate = std::make_unique<inja::Template>(injaEnvironment->parse(source));
+
+            VLOG(1) << "  Compiled template: " << source;
+        } catch (const inja::InjaError& e) {
+            // Keep the source - the error is reported with the render data when the template is rendered
+            LOG(WARNING) << "  Compiling template failed: " << source;
+            LOG(WARNING) << "    INJA: " << e.type << ": " << e.message;
+        }
+
+        return compiledTemplate;
+    }
+
+    void MqttMapper::render(const inja::Template* compiledTemplate,
+                            const std::string& source,
+                            const nlohmann::json& json,
+                            std::string& rendered) {
+        rendered.clear();
+
+        StringAppendBuffer buffer(rendered);
+        std::ostream os(&buffer);
+
+        if (compiledTemplate != nullptr) {
+            injaEnvironment->render_to(os, *compiledTemplate, json);
+        } else {
+            injaEnvironment->render_to(os, injaEnvironment->parse(source), json);
+        }
+    }
+
+    void MqttMapper::publishMappedTemplate(const nlohmann::json& templateMapping, nlohmann::json& json) {
+        const std::map<const nlohmann::json*, MappingPredicate>::const_iterator predicate = predicates.find(&templateMapping);
+
+        if (predicate != predicates.end() && !predicate->second.evaluate(json)) {
+            VLOG(1) << "  Mapping condition not satisfied: " << templateMapping["when"].get<std::string>();
+            VLOG(1) << "  Send mapping: skipped";
+        } else {
+            const std::string& mappingTemplate = templateMapping["mapping_template"];
+            const std::string& mappedTopic = templateMapping["mapped_topic"];
+
+            const std::map<const nlohmann::json*, CompiledTemplate>::const_iterator compiledTemplate = templates.find(&templateMapping);
+            const bool compiled = compiledTemplate != templates.end();
+
+            // A mapping published from here may cascade back into this mapper, thus each depth renders into its own buffers
+            if (renderBuffers.size() < renderDepth + 2) {
+                renderBuffers.resize(renderDepth + 2);
+            }
+            std::string& renderedTopic = renderBuffers[renderDepth];
+            std::string& renderedMessage = renderBuffers[renderDepth + 1];
+
+            const RenderDepthGuard renderDepthGuard(renderDepth);
+
+            try {
+                // Render topic
+                render(compiled ? compiledTemplate->second.topic.get() : nullptr, mappedTopic, json, renderedTopic);
+                json["mapped_topic"] = renderedTopic;
+
+                VLOG(1) << "  Mapped topic template: " << mappedTopic;
+                VLOG(1) << "    -> " << renderedTopic;
+
+                try {
+                    // Render message
+                    render(compiled ? compiledTemplate->second.message.get() : nullptr, mappingTemplate, json, renderedMessage);
+                    VLOG(1) << "  Mapped message template: " << mappingTemplate;
+                    VLOG(1) << "    -> " << renderedMessage;
+
+                    const nlohmann::json& suppressions = templateMapping["suppressions"];
+                    const bool retain = templateMapping["retain"];
+
+                    if (suppressions.empty() ||
+                        std::find(suppressions.begin(), suppressions.end(), renderedMessage) == suppressions.end() ||
+                        (retain && renderedMessage.empty())) {
+                        const uint8_t qoS = templateMapping["qos"];
+
+                        VLOG(1) << "  Send mapping:";
+                        VLOG(1) << "    Topic: " << renderedTopic;
+                        VLOG(1) << "    Message: " << renderedMessage << "";
+                        VLOG(1) << "    QoS: " << static_cast<int>(qoS);
+                        VLOG(1) << "    retain: " << retain;
+
+                        if (templateMapping.contains("batch")) {
+                            publishBatched(templateMapping["batch"], renderedTopic, renderedMessage, qoS, retain);
+                        } else {
+                            publishMapping(renderedTopic, renderedMessage, qoS, retain);
+                        }
+                    } else {
+                        VLOG(1) << "    Rendered message: '" << renderedMessage << "' in suppression list:";
+                        for (const nlohmann::json& item : suppressions) {
+                            VLOG(1) << "         '" << item.get<std::string>() << "'";
+                        }
+                        VLOG(1) << "  Send mapping: suppressed";
                     }
-                    VLOG(1) << "  Send mapping: suppressed";
+                } catch (const inja::InjaError& e) {
+                    LOG(ERROR) << "  Message template rendering failed: " << mappingTemplate << " : " << json.dump();
+                    LOG(ERROR) << "    What: " << e.what();
+                    LOG(ERROR) << "    INJA: " << e.type << ": " << e.message;
+                    LOG(ERROR) << "    INJA (line:column):" << e.location.line << ":" << e.location.column;
                 }
             } catch (const inja::InjaError& e) {
-                LOG(ERROR) << "  Message template rendering failed: " << mappingTemplate << " : " << json.dump();
+                LOG(ERROR) << "  Topic template rendering failed: " << mappingTemplate << " : " << json.dump();
                 LOG(ERROR) << "    What: " << e.what();
                 LOG(ERROR) << "    INJA: " << e.type << ": " << e.message;
                 LOG(ERROR) << "    INJA (line:column):" << e.location.line << ":" << e.location.column;
             }
-        } catch (const inja::InjaError& e) {
-            LOG(ERROR) << "  Topic template rendering failed: " << mappingTemplate << " : " << json.dump();
-            LOG(ERROR) << "    What: " << e.what();
-            LOG(ERROR) << "    INJA: " << e.type << ": " << e.message;
-            LOG(ERROR) << "    INJA (line:column):" << e.location.line << ":" << e.location.column;
         }
     }
 
-    void MqttMapper::publishMappedTemplates(const nlohmann::json& templateMapping,
-                                            nlohmann::json& json,
-                                            const iot::mqtt::packets::Publish& publish) {
-        json["topic"] = publish.getTopic();
-        json["qos"] = publish.getQoS();
-        json["retain"] = publish.getRetain();
-        json["package_identifier"] = publish.getPacketIdentifier();
+    void MqttMapper::publishMappedTemplates(const nlohmann::json& templateMapping, nlohmann::json& json, const MappedPublish& publish) {
+        json["topic"] = publish.topic;
+        json["qos"] = publish.qoS;
+        json["retain"] = publish.retain;
+        json["package_identifier"] = publish.packetIdentifier;
 
         try {
             VLOG(0) << "  Render data: " << json.dump();
@@ -343,6 +609,46 @@ namespace mqtt::lib {
         }
     }
 
+    void MqttMapper::publishJoins(const nlohmann::json& joinMapping, const MappedPublish& publish) {
+        const std::map<const nlohmann::json*, std::vector<JoinInput>>::iterator inputsIt = joinInputs.find(&joinMapping);
+
+        if (inputsIt != joinInputs.end()) {
+            for (const JoinInput& input : inputsIt->second) {
+                Join& join = *input.join;
+
+                try {
+                    *join.values[input.slot] =
+                        input.json ? nlohmann::json::parse(publish.message) : nlohmann::json(publish.message);
+
+                    if (!join.present[input.slot]) {
+                        join.present[input.slot] = true;
+                        join.missing--;
+                    }
+
+                    if (!join.triggers[input.slot]) {
+                        VLOG(1) << "  Join slot updated: " << join.slotNames[input.slot] << " (no trigger)";
+                    } else if (join.requireAll && join.missing > 0) {
+                        VLOG(1) << "  Join slot updated: " << join.slotNames[input.slot] << " (" << join.missing << " slots missing)";
+                    } else {
+                        *join.topic = publish.topic;
+                        *join.trigger = join.slotNames[input.slot];
+                        *join.qoS = publish.qoS;
+                        *join.retain = publish.retain;
+
+                        VLOG(0) << "  Render data: " << join.renderData.dump();
+
+                        publishMappedTemplate(*join.definition, join.renderData);
+                    }
+                } catch (const nlohmann::json::parse_error& e) {
+                    LOG(ERROR) << "  Parsing message into json failed: " << publish.message;
+                    LOG(ERROR) << "     What: " << e.what() << '\n'
+                               << "     Exception Id: " << e.id << '\n'
+                               << "     Byte position of error: " << e.byte;
+                }
+            }
+        }
+    }
+
     void MqttMapper::publishMappedMessage(const std::string& topic, const std::string& message, uint8_t qoS, bool retain) {
         VLOG(1) << "  Mapped topic:";
         VLOG(1) << "    -> " << topic;
@@ -357,13 +663,13 @@ namespace mqtt::lib {
         publishMapping(topic, message, qoS, retain);
     }
 
-    void MqttMapper::publishMappedMessage(const nlohmann::json& staticMapping, const iot::mqtt::packets::Publish& publish) {
+    void MqttMapper::publishMappedMessage(const nlohmann::json& staticMapping, const MappedPublish& publish) {
         const nlohmann::json& messageMapping = staticMapping["message_mapping"];
 
         VLOG(0) << "  Message mapping: " << messageMapping.dump();
 
         if (messageMapping.is_object()) {
-            if (messageMapping["message"] == publish.getMessage()) {
+            if (messageMapping["message"] == publish.message) {
                 publishMappedMessage(
                     staticMapping["mapped_topic"], messageMapping["mapped_message"], staticMapping["qos"], staticMapping["retain"]);
             } else {
@@ -372,7 +678,7 @@ namespace mqtt::lib {
         } else {
             const nlohmann::json::const_iterator matchedMessageMappingIterator =
                 std::find_if(messageMapping.begin(), messageMapping.end(), [&publish](const nlohmann::json& messageMappingCandidat) {
-                    return messageMappingCandidat["message"] == publish.getMessage();
+                    return messageMappingCandidat["message"] == publish.message;
                 });
 
             if (matchedMessageMappingIterator != messageMapping.end()) {
@@ -386,7 +692,7 @@ namespace mqtt::lib {
         }
     }
 
-    void MqttMapper::publishMappedMessages(const nlohmann::json& staticMapping, const iot::mqtt::packets::Publish& publish) {
+    void MqttMapper::publishMappedMessages(const nlohmann::json& staticMapping, const MappedPublish& publish) {
         if (staticMapping.is_object()) {
             publishMappedMessage(staticMapping, publish);
         } else if (staticMapping.is_array()) {
@@ -396,4 +702,106 @@ namespace mqtt::lib {
         }
     }
 
+    void MqttMapper::publishBatched(
+        const nlohmann::json& batchMapping, const std::string& topic, const std::string& message, uint8_t qoS, bool retain) {
+        auto [it, inserted] = state->batches.try_emplace(topic);
+        Batch& batch = it->second;
+
+        if (inserted) {
+            batch.ndjson = batchMapping["format"] == "ndjson";
+            batch.maxCount = batchMapping["max_count"];
+            batch.maxBytes = batchMapping["max_bytes"];
+            batch.qoS = qoS;
+            batch.retain = retain;
+
+            batch.buffer.reserve(batch.maxBytes + 2);
+        }
+
+        if (batch.count > 0 && batch.buffer.size() + message.size() + 2 > batch.maxBytes) {
+            flushBatch(this, topic, batch);
+        }
+
+        if (batch.count == 0) {
+            batch.buffer = batch.ndjson ? "" : "[";
+
+            const double maxDelay = batchMapping["max_delay"];
+            batch.timer = core::timer::Timer::singleshotTimer(
+                [weakState = std::weak_ptr<MappingState>(state), topic]() -> void {
+                    const std::shared_ptr<MappingState> state = weakState.lock();
+
+                    if (state && !state->mappers.empty()) {
+                        const std::map<std::string, Batch>::iterator it = state->batches.find(topic);
+
+                        if (it != state->batches.end()) {
+                            it->second.timer.reset();
+
+                            VLOG(1) << "  Batch delay expired: " << topic;
+                            flushBatch(state->mappers.front(), topic, it->second);
+                        }
+                    }
+                },
+                maxDelay);
+        } else {
+            batch.buffer += batch.ndjson ? "\n" : ",";
+        }
+
+        batch.buffer += message;
+        batch.count++;
+
+        VLOG(1) << "  Batched mapping: " << topic << " (" << batch.count << "/" << batch.maxCount << " messages, " << batch.buffer.size()
+                << "/" << batch.maxBytes << " bytes)";
+
+        if (batch.count >= batch.maxCount || batch.buffer.size() >= batch.maxBytes) {
+            flushBatch(this, topic, batch);
+        }
+    }
+
+    void MqttMapper::flushBatch(MqttMapper* mapper, const std::string& topic, Batch& batch) {
+        if (batch.count > 0) {
+            if (batch.timer) {
+                batch.timer->cancel();
+                batch.timer.reset();
+            }
+
+            if (!batch.ndjson) {
+                batch.buffer += "]";
+            }
+
+            VLOG(1) << "  Send batch:";
+            VLOG(1) << "    Topic: " << topic;
+            VLOG(1) << "    Messages: " << batch.count;
+            VLOG(1) << "    Bytes: " << batch.buffer.size();
+            VLOG(1) << "    QoS: " << static_cast<int>(batch.qoS);
+            VLOG(1) << "    retain: " << batch.retain;
+
+            // Publishing may cascade into this very batch, thus it has to be empty before the buffer is handed out
+            std::string buffer;
+            std::swap(buffer, batch.buffer);
+            batch.count = 0;
+
+            mapper->publishMapping(topic, buffer, batch.qoS, batch.retain);
+
+            if (batch.count == 0) {
+                buffer.clear();
+                std::swap(buffer, batch.buffer); // keep the capacity for the next batch
+            }
+        }
+    }
+
+    void MqttMapper::flushBatches() {
+        for (auto& [topic, batch] : state->batches) {
+            flushBatch(this, topic, batch);
+        }
+    }
+
+    void MqttMapper::releaseBatches() {
+        state->mappers.remove(this);
+
+        if (state->mappers.empty()) {
+            for (auto& [topic, batch] : state->batches) {
+                flushBatch(this, topic, batch);
+            }
+        }
+    }
+
 } // namespace mqtt::lib
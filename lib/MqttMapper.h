@@ -27,16 +27,27 @@ namespace iot::mqtt {
     }
 } // namespace iot::mqtt
 
+#include "MappingPredicate.h"
+
+#include <core/timer/Timer.h>
+
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 
 namespace inja {
     class Environment;
-}
+    struct Template;
+} // namespace inja
 
+#include <cstddef>
 #include <cstdint>
+#include <deque>
 #include <list>
+#include <map>
+#include <memory>
 #include <nlohmann/json_fwd.hpp> // IWYU pragma: export
+#include <optional>
 #include <string>
+#include <vector>
 
 #endif
 
@@ -53,10 +64,71 @@ namespace mqtt::lib {
     protected:
         std::string dump();
 
+        // Non owning view of a message to be mapped. Used for cascaded mappings to avoid copying topic and message into a Publish
+        struct MappedPublish {
+            const std::string& topic;
+            const std::string& message;
+            uint8_t qoS;
+            bool retain;
+            uint16_t packetIdentifier;
+        };
+
         std::list<iot::mqtt::Topic> extractSubscriptions();
         void publishMappings(const iot::mqtt::packets::Publish& publish);
+        void publishMappings(const MappedPublish& publish);
+
+        void flushBatches();
+        void releaseBatches();
 
     private:
+        struct Batch {
+            std::string buffer;
+            std::size_t count = 0;
+
+            bool ndjson = false;
+            std::size_t maxCount = 0;
+            std::size_t maxBytes = 0;
+            uint8_t qoS = 0;
+            bool retain = false;
+
+            std::optional<core::timer::Timer> timer;
+        };
+
+        struct Join {
+            const nlohmann::json* definition = nullptr;
+            bool requireAll = true;
+
+            nlohmann::json renderData;
+            nlohmann::json* topic = nullptr; // slots of the triggering publish inside renderData
+            nlohmann::json* trigger = nullptr;
+            nlohmann::json* qoS = nullptr;
+            nlohmann::json* retain = nullptr;
+            std::vector<std::string> slotNames;
+            std::vector<nlohmann::json*> values; // slot index -> latest value inside renderData["values"]
+            std::vector<bool> present;
+            std::vector<bool> triggers;
+            std::size_t missing = 0;
+        };
+
+        struct JoinInput {
+            Join* join;
+            std::size_t slot;
+            bool json;
+        };
+
+        // Batches and join slots are shared by all mappers of the same mapping document, thus messages of different connections are
+        // aggregated together. The state lives as long as at least one mapper of that mapping exists.
+        struct MappingState {
+            std::list<MqttMapper*> mappers; // the front mapper publishes batches flushed by the delay timer
+            std::map<std::string, Batch> batches;
+            std::map<const nlohmann::json*, Join> joins;
+        };
+
+        struct CompiledTemplate {
+            std::unique_ptr<inja::Template> topic;
+            std::unique_ptr<inja::Template> message;
+        };
+
         virtual void publishMapping(const std::string& topic, const std::string& message, uint8_t qoS, bool retain) = 0;
 
         static void
@@ -64,21 +136,45 @@ namespace mqtt::lib {
         static void
         extractSubscriptions(const nlohmann::json& mappingJson, const std::string& topic, std::list<iot::mqtt::Topic>& topicList);
 
-        nlohmann::json findMatchingTopicLevel(const nlohmann::json& topicLevel, const std::string& topic);
+        const nlohmann::json* findMatchingTopicLevel(const nlohmann::json& topicLevel, const std::string& topic);
+
+        void compileMappings(const nlohmann::json& topicLevel);
+        void compileJoinInput(const nlohmann::json& joinInputJson, std::vector<JoinInput>& inputs);
+        void compileTemplateMapping(const nlohmann::json& templateMapping);
+        void compileTemplateMappings(const nlohmann::json& templateMapping);
+        std::unique_ptr<inja::Template> compileTemplate(const std::string& source);
+
+        void render(const inja::Template* compiledTemplate, const std::string& source, const nlohmann::json& json, std::string& rendered);
 
         void publishMappedTemplate(const nlohmann::json& templateMapping, nlohmann::json& json);
-        void
-        publishMappedTemplates(const nlohmann::json& templateMapping, nlohmann::json& json, const iot::mqtt::packets::Publish& publish);
+        void publishMappedTemplates(const nlohmann::json& templateMapping, nlohmann::json& json, const MappedPublish& publish);
 
         void publishMappedMessage(const std::string& topic, const std::string& message, uint8_t qoS, bool retain);
-        void publishMappedMessage(const nlohmann::json& staticMapping, const iot::mqtt::packets::Publish& publish);
-        void publishMappedMessages(const nlohmann::json& staticMapping, const iot::mqtt::packets::Publish& publish);
+        void publishMappedMessage(const nlohmann::json& staticMapping, const MappedPublish& publish);
+        void publishMappedMessages(const nlohmann::json& staticMapping, const MappedPublish& publish);
+
+        void publishJoins(const nlohmann::json& joinMapping, const MappedPublish& publish);
+
+        void
+        publishBatched(const nlohmann::json& batchMapping, const std::string& topic, const std::string& message, uint8_t qoS, bool retain);
+        static void flushBatch(MqttMapper* mapper, const std::string& topic, Batch& batch);
 
         const nlohmann::json& mappingJson;
 
         std::list<void*> pluginHandles;
 
+        std::map<const nlohmann::json*, MappingPredicate> predicates;
+        std::map<const nlohmann::json*, CompiledTemplate> templates;
+        std::map<const nlohmann::json*, std::vector<JoinInput>> joinInputs;
+
+        std::shared_ptr<MappingState> state;
+
+        static std::map<const nlohmann::json*, std::weak_ptr<MappingState>> mappingStates;
+
         inja::Environment* injaEnvironment;
+
+        std::deque<std::string> renderBuffers; // reused across messages - one topic and one message buffer per cascade depth
+        std::size_t renderDepth = 0;
     };
 
 } // namespace mqtt::lib
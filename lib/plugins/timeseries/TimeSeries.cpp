@@ -0,0 +1,283 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "TimeSeries.h"
+
+#include "lib/MqttMapperPlugin.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <limits>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <vector>
+
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
+namespace mqtt::lib::plugins::timeseries_plugin {
+
+    std::size_t Series::index(std::size_t position) {
+        return position & (capacity - 1);
+    }
+
+    void Series::push(double timestamp, double value) {
+        const std::size_t i = index(pushed);
+
+        if (pushed >= capacity) {
+            sum -= values[i];
+        }
+
+        timestamps[i] = timestamp;
+        values[i] = value;
+        sum += value;
+
+        ++pushed;
+
+        if (index(pushed) == 0) {
+            sum = 0;
+            for (const double v : values) {
+                sum += v;
+            }
+        }
+    }
+
+    std::size_t Series::size() const {
+        return std::min(pushed, capacity);
+    }
+
+    template <typename Reducer>
+    double Series::reduce(std::size_t n, double init, Reducer reducer) const {
+        n = std::min(n, size());
+
+        // The last n samples occupy at most two contiguous runs of the values array
+        const std::size_t begin = index(pushed - n);
+        const std::size_t firstRun = std::min(n, capacity - begin);
+
+        double result = init;
+        for (std::size_t i = begin; i < begin + firstRun; ++i) {
+            result = reducer(result, values[i]);
+        }
+        for (std::size_t i = 0; i < n - firstRun; ++i) {
+            result = reducer(result, values[i]);
+        }
+
+        return result;
+    }
+
+    double Series::mavg(std::size_t n) const {
+        double result = 0;
+
+        n = std::min(n, size());
+
+        if (n == size() && n > 0) {
+            result = sum / static_cast<double>(n);
+        } else if (n > 0) {
+            result = reduce(n, 0., std::plus<>()) / static_cast<double>(n);
+        }
+
+        return result;
+    }
+
+    double Series::min(std::size_t n) const {
+        double result = 0;
+
+        if (size() > 0 && n > 0) {
+            result = reduce(n, std::numeric_limits<double>::infinity(), [](double a, double b) {
+                return std::min(a, b);
+            });
+        }
+
+        return result;
+    }
+
+    double Series::max(std::size_t n) const {
+        double result = 0;
+
+        if (size() > 0 && n > 0) {
+            result = reduce(n, -std::numeric_limits<double>::infinity(), [](double a, double b) {
+                return std::max(a, b);
+            });
+        }
+
+        return result;
+    }
+
+    double Series::ewma(double alpha) const {
+        double result = 0;
+
+        if (size() > 0) {
+            alpha = std::clamp(alpha, 0., 1.);
+
+            const std::size_t begin = pushed - size();
+
+            result = values[index(begin)];
+            for (std::size_t position = begin + 1; position < pushed; ++position) {
+                result = alpha * values[index(position)] + (1 - alpha) * result;
+            }
+        }
+
+        return result;
+    }
+
+    double Series::delta() const {
+        return size() > 1 ? values[index(pushed - 1)] - values[index(pushed - 2)] : 0;
+    }
+
+    double Series::rate() const {
+        double result = 0;
+
+        if (size() > 1) {
+            const double dt = timestamps[index(pushed - 1)] - timestamps[index(pushed - 2)];
+
+            if (dt > 0) {
+                result = delta() / dt;
+            }
+        }
+
+        return result;
+    }
+
+    TimeSeries& TimeSeries::instance() {
+        static TimeSeries timeSeries;
+
+        return timeSeries;
+    }
+
+    bool TimeSeries::number(const nlohmann::json* arg, double& value) {
+        bool valid = arg->is_number();
+
+        if (valid) {
+            value = arg->get<double>();
+        } else if (arg->is_string()) {
+            const std::string& string = arg->get_ref<const std::string&>();
+
+            try {
+                std::size_t length = 0;
+                value = std::stod(string, &length);
+                valid = length == string.size();
+            } catch (const std::logic_error&) {
+                // not a number
+            }
+        }
+
+        return valid;
+    }
+
+    std::string TimeSeries::key(const nlohmann::json* arg) {
+        return arg->is_string() ? arg->get<std::string>() : arg->dump();
+    }
+
+    const Series* TimeSeries::find(const inja::Arguments& args) {
+        const std::unordered_map<std::string, Entry>& series = instance().series;
+
+        const std::unordered_map<std::string, Entry>::const_iterator it = series.find(key(args.at(0)));
+
+        return it != series.end() ? &it->second.series : nullptr;
+    }
+
+    std::size_t TimeSeries::window(const inja::Arguments& args, std::size_t pos) {
+        std::size_t n = Series::capacity;
+
+        double value = 0;
+        if (args.size() > pos && number(args[pos], value)) {
+            n = static_cast<std::size_t>(std::clamp(value, 0., static_cast<double>(Series::capacity)));
+        }
+
+        return n;
+    }
+
+    void TimeSeries::push(const inja::Arguments& args) {
+        double value = 0;
+
+        if (number(args.at(1), value)) { // not a number - do not pollute the series
+            TimeSeries& timeSeries = instance();
+            const double now = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+            std::string name = key(args.at(0));
+
+            std::unordered_map<std::string, Entry>::iterator it = timeSeries.series.find(name);
+            if (it != timeSeries.series.end()) {
+                timeSeries.recent.splice(timeSeries.recent.begin(), timeSeries.recent, it->second.recent);
+            } else {
+                if (timeSeries.series.size() >= maxSeries) {
+                    timeSeries.series.erase(timeSeries.recent.back());
+                    timeSeries.recent.pop_back();
+                }
+
+                timeSeries.recent.push_front(name);
+                it = timeSeries.series.emplace(std::move(name), Entry{{}, timeSeries.recent.begin()}).first;
+            }
+
+            it->second.series.push(now, value);
+        }
+    }
+
+    double TimeSeries::mavg(const inja::Arguments& args) {
+        const Series* series = find(args);
+
+        return series != nullptr ? series->mavg(window(args, 1)) : 0;
+    }
+
+    double TimeSeries::rate(const inja::Arguments& args) {
+        const Series* series = find(args);
+
+        return series != nullptr ? series->rate() : 0;
+    }
+
+    double TimeSeries::delta(const inja::Arguments& args) {
+        const Series* series = find(args);
+
+        return series != nullptr ? series->delta() : 0;
+    }
+
+    double TimeSeries::min_n(const inja::Arguments& args) {
+        const Series* series = find(args);
+
+        return series != nullptr ? series->min(window(args, 1)) : 0;
+    }
+
+    double TimeSeries::max_n(const inja::Arguments& args) {
+        const Series* series = find(args);
+
+        return series != nullptr ? series->max(window(args, 1)) : 0;
+    }
+
+    double TimeSeries::ewma(const inja::Arguments& args) {
+        const Series* series = find(args);
+
+        double alpha = 0;
+
+        return series != nullptr && number(args.at(1), alpha) ? series->ewma(alpha) : 0;
+    }
+
+} // namespace mqtt::lib::plugins::timeseries_plugin
+
+extern "C" {
+    std::vector<mqtt::lib::Function> functions{{"mavg", -1, mqtt::lib::plugins::timeseries_plugin::TimeSeries::mavg},
+                                               {"rate", 1, mqtt::lib::plugins::timeseries_plugin::TimeSeries::rate},
+                                               {"delta", 1, mqtt::lib::plugins::timeseries_plugin::TimeSeries::delta},
+                                               {"min_n", 2, mqtt::lib::plugins::timeseries_plugin::TimeSeries::min_n},
+                                               {"max_n", 2, mqtt::lib::plugins::timeseries_plugin::TimeSeries::max_n},
+                                               {"ewma", 2, mqtt::lib::plugins::timeseries_plugin::TimeSeries::ewma}};
+
+    std::vector<mqtt::lib::VoidFunction> voidFunctions{{"push", 2, mqtt::lib::plugins::timeseries_plugin::TimeSeries::push}};
+}
@@ -0,0 +1,113 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MQTT_LIB_PLUGINS_TIMESERIES_PLUGIN_TIMESERIES_H
+#define MQTT_LIB_PLUGINS_TIMESERIES_PLUGIN_TIMESERIES_H
+
+#include "lib/inja.hpp"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <array>
+#include <cstddef>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#endif // DOXYGEN_SHOULD_SKIP_THIS
+
+namespace mqtt::lib::plugins::timeseries_plugin {
+
+    /* Fixed capacity ring buffer of (timestamp, value) samples. Timestamps and values are kept in two separate, cache line
+     * aligned arrays (struct of arrays) so that the window reductions run over contiguous doubles. */
+    class Series {
+    public:
+        static constexpr std::size_t capacity = 128; // must be a power of two
+
+        void push(double timestamp, double value);
+
+        std::size_t size() const;
+
+        double mavg(std::size_t n) const;
+        double min(std::size_t n) const;
+        double max(std::size_t n) const;
+        double ewma(double alpha) const;
+
+        double delta() const;
+        double rate() const;
+
+    private:
+        static_assert((capacity & (capacity - 1)) == 0, "Series::capacity must be a power of two");
+
+        static std::size_t index(std::size_t position);
+
+        template <typename Reducer>
+        double reduce(std::size_t n, double init, Reducer reducer) const;
+
+        alignas(64) std::array<double, capacity> timestamps{};
+        alignas(64) std::array<double, capacity> values{};
+
+        std::size_t pushed = 0; // monotonic number of pushes - the write position is pushed % capacity
+        double sum = 0;         // running sum of the whole window, recomputed on each wrap around to bound rounding drift
+    };
+
+    /* The series of all keys. Their number is bounded - pushing to a new key while maxSeries keys exist evicts the key pushed
+     * to least recently. Arguments which are not numbers are ignored, thus a bad payload can not abort the rendering. */
+    class TimeSeries {
+    private:
+        TimeSeries() = default;
+
+    public:
+        TimeSeries(const TimeSeries&) = delete;
+
+        TimeSeries& operator=(const TimeSeries&) = delete;
+
+        static TimeSeries& instance();
+
+        static void push(const inja::Arguments& args);
+
+        static double mavg(const inja::Arguments& args);
+        static double rate(const inja::Arguments& args);
+        static double delta(const inja::Arguments& args);
+        static double min_n(const inja::Arguments& args);
+        static double max_n(const inja::Arguments& args);
+        static double ewma(const inja::Arguments& args);
+
+        ~TimeSeries() = default;
+
+        static constexpr std::size_t maxSeries = 4096;
+
+    private:
+        struct Entry {
+            Series series;
+            std::list<std::string>::iterator recent;
+        };
+
+        static const Series* find(const inja::Arguments& args);
+        static std::size_t window(const inja::Arguments& args, std::size_t pos);
+        static bool number(const nlohmann::json* arg, double& value);
+        static std::string key(const nlohmann::json* arg);
+
+        std::unordered_map<std::string, Entry> series;
+        std::list<std::string> recent; // keys, most recently pushed first
+    };
+
+} // namespace mqtt::lib::plugins::timeseries_plugin
+
+#endif // MQTT_LIB_PLUGINS_TIMESERIES_PLUGIN_TIMESERIES_H
@@ -0,0 +1,404 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Bench.h"
+
+#include "ktls/KernelTls.h"
+#include "lib/Mqtt.h"
+
+#include <core/SNodeC.h>
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <log/Logger.h>
+#include <nlohmann/json.hpp>
+#include <sstream>
+#include <unistd.h>
+
+#endif
+
+namespace mqtt::mqttbench::lib {
+
+    namespace {
+
+        constexpr double tickInterval = 0.001;      // seconds
+        constexpr std::size_t maxBurst = 1024;      // messages per publisher and tick
+        constexpr std::size_t headerReserve = 64;   // "<publisher>:<sequence>:<nanoseconds>;"
+        constexpr uint64_t nanosecondsPerSecond = 1000000000;
+
+    } // namespace
+
+    Bench& Bench::instance() {
+        static Bench bench;
+
+        return bench;
+    }
+
+    uint64_t Bench::now() {
+        return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    uint64_t Bench::residentBytes(pid_t pid) {
+        uint64_t bytes = 0;
+
+        std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+        for (std::string line; std::getline(status, line);) {
+            if (line.starts_with("VmRSS:")) {
+                bytes = std::strtoull(line.data() + 6, nullptr, 10) * 1024;
+            }
+        }
+
+        std::ifstream children("/proc/" + std::to_string(pid) + "/task/" + std::to_string(pid) + "/children");
+        for (pid_t child = 0; children >> child;) {
+            bytes += residentBytes(child);
+        }
+
+        return bytes;
+    }
+
+    bool Bench::parseMix(const std::string& spec, uint64_t maximum, Mix& mix) {
+        bool success = !spec.empty();
+
+        std::vector<double> weights;
+        std::istringstream specStream(spec);
+
+        for (std::string entry; success && std::getline(specStream, entry, ',');) {
+            const std::string::size_type equal = entry.find('=');
+
+            uint64_t value = 0;
+            double weight = 1;
+
+            const std::string valueString = entry.substr(0, equal);
+            success = std::from_chars(valueString.data(), valueString.data() + valueString.size(), value).ec == std::errc() &&
+                      value <= maximum;
+
+            if (success && equal != std::string::npos) {
+                weight = std::atof(entry.substr(equal + 1).data());
+                success = weight > 0;
+            }
+
+            mix.values.push_back(value);
+            weights.push_back(weight);
+        }
+
+        if (success) {
+            mix.distribution = std::discrete_distribution<std::size_t>(weights.begin(), weights.end());
+        } else {
+            LOG(ERROR) << "Bench: Invalid mix '" << spec << "'";
+        }
+
+        return success;
+    }
+
+    bool Bench::configure(const Options& options) {
+        this->options = options;
+
+        random.seed(options.seed);
+
+        const std::string::size_type placeholder = options.topic.find("{topic}");
+        for (std::size_t topic = 0; topic < std::max(options.topics, std::size_t{1}); ++topic) {
+            topicNames.push_back(placeholder != std::string::npos
+                                     ? std::string(options.topic).replace(placeholder, std::string("{topic}").size(), std::to_string(topic))
+                                     : options.topic);
+        }
+
+        if (options.brokerPid > 0) {
+            brokerIdleBytes = residentBytes(options.brokerPid);
+        }
+
+        const bool success = parseMix(options.qoSMix, 2, qoSMix) && parseMix(options.payloadMix, 256 * 1024 * 1024, payloadMix);
+
+        if (success) {
+            phaseTimer = core::timer::Timer::singleshotTimer(
+                [this]() -> void {
+                    phaseTimer.reset();
+
+                    LOG(WARNING) << "Bench: Connect timeout - " << readyPublishers << "/" << this->options.publishers << " publishers and "
+                                 << readySubscribers << "/" << this->options.subscribers << " subscribers ready";
+                    begin();
+                },
+                options.connectTimeout);
+        }
+
+        return success;
+    }
+
+    std::size_t Bench::getConnections() const {
+        return options.publishers + options.subscribers;
+    }
+
+    Mqtt* Bench::createMqtt() {
+        Mqtt* mqtt = nullptr;
+
+        if (created < getConnections()) {
+            const bool subscriber = created < options.subscribers;
+
+            mqtt = new Mqtt("mqttbench-" + std::to_string(getpid()) + "-" + std::to_string(created),
+                            subscriber ? Role::SUBSCRIBER : Role::PUBLISHER);
+            created++;
+        }
+
+        return mqtt;
+    }
+
+    void Bench::ready(Mqtt* mqtt) {
+        if (mqtt->getRole() == Role::PUBLISHER) {
+            publishers.push_back({mqtt, 0});
+            readyPublishers++;
+        } else {
+            readySubscribers++;
+        }
+
+        if (phase == Phase::CONNECTING && readyPublishers == options.publishers && readySubscribers == options.subscribers) {
+            begin();
+        }
+    }
+
+    void Bench::disconnected(Mqtt* mqtt) {
+        const std::vector<Publisher>::iterator it =
+            std::find_if(publishers.begin(), publishers.end(), [mqtt](const Publisher& candidate) -> bool {
+                return candidate.mqtt == mqtt;
+            });
+
+        if (it != publishers.end()) {
+            it->mqtt = nullptr;
+        }
+
+        if (phase != Phase::DONE) {
+            LOG(WARNING) << "Bench: Connection lost during the run";
+        }
+    }
+
+    const std::string& Bench::getFilter() const {
+        return options.filter;
+    }
+
+    uint8_t Bench::getSubscribeQoS() const {
+        return options.subscribeQoS;
+    }
+
+    void Bench::begin() {
+        phase = Phase::WARMUP;
+        beginTime = now();
+
+        if (options.brokerPid > 0) {
+            brokerConnectedBytes = residentBytes(options.brokerPid);
+        }
+
+        VLOG(0) << "Bench: Warming up with " << publishers.size() << " publishers and " << readySubscribers << " subscribers";
+
+        tickTimer = core::timer::Timer::intervalTimer(
+            [this]() -> void {
+                tick();
+            },
+            tickInterval);
+
+        if (phaseTimer) {
+            phaseTimer->cancel();
+        }
+        phaseTimer = core::timer::Timer::singleshotTimer(
+            [this]() -> void {
+                phaseTimer.reset();
+                nextPhase();
+            },
+            options.warmup);
+    }
+
+    void Bench::nextPhase() {
+        double phaseDuration = 0;
+
+        switch (phase) {
+            case Phase::WARMUP:
+                VLOG(0) << "Bench: Measuring for " << options.duration << " s";
+
+                phase = Phase::MEASURING;
+                measureBegin = now();
+                phaseDuration = options.duration;
+                break;
+            case Phase::MEASURING:
+                VLOG(0) << "Bench: Draining for " << options.drain << " s";
+
+                phase = Phase::DRAINING;
+                measureEnd = now();
+                phaseDuration = options.drain;
+
+                tickTimer->cancel();
+                tickTimer.reset();
+                break;
+            case Phase::DRAINING:
+                phase = Phase::DONE;
+                break;
+            case Phase::CONNECTING:
+            case Phase::DONE:
+                break;
+        }
+
+        if (phase == Phase::DONE) {
+            finish();
+        } else {
+            phaseTimer = core::timer::Timer::singleshotTimer(
+                [this]() -> void {
+                    phaseTimer.reset();
+                    nextPhase();
+                },
+                phaseDuration);
+        }
+    }
+
+    void Bench::tick() {
+        const uint64_t current = now();
+
+        for (std::size_t index = 0; index < publishers.size(); ++index) {
+            Publisher& publisher = publishers[index];
+
+            for (std::size_t burst = 0; publisher.mqtt != nullptr && burst < maxBurst; ++burst) {
+                if (options.rate > 0) {
+                    // Open-loop: catch up with the schedule, stamping each message with its scheduled send time
+                    const uint64_t scheduled =
+                        beginTime + static_cast<uint64_t>(static_cast<double>(publisher.sequence * nanosecondsPerSecond) / options.rate);
+
+                    if (scheduled > current) {
+                        break;
+                    }
+                    publish(index, scheduled);
+                } else {
+                    if (publisher.mqtt->getBacklog() >= options.window) {
+                        break;
+                    }
+                    publish(index, current);
+                }
+            }
+        }
+    }
+
+    void Bench::publish(std::size_t index, uint64_t timestamp) {
+        Publisher& publisher = publishers[index];
+
+        const std::string& topic = topicNames[(index + publisher.sequence) % topicNames.size()];
+        const uint8_t qoS = static_cast<uint8_t>(qoSMix.values[qoSMix.distribution(random)]);
+        const std::size_t size = static_cast<std::size_t>(payloadMix.values[payloadMix.distribution(random)]);
+
+        std::string message;
+        message.reserve(std::max(size, headerReserve));
+        message += std::to_string(index) + ":" + std::to_string(publisher.sequence) + ":" + std::to_string(timestamp) + ";";
+        message.resize(std::max(size, message.size()), 'x');
+
+        publisher.mqtt->publish(topic, message, qoS);
+        publisher.sequence++;
+
+        if (isMeasured(timestamp)) {
+            publishedMessages++;
+            publishedBytes += message.size();
+        }
+    }
+
+    bool Bench::isMeasured(uint64_t timestamp) const {
+        return measureBegin != 0 && timestamp >= measureBegin && (measureEnd == 0 || timestamp < measureEnd);
+    }
+
+    void Bench::received(const std::string& message) {
+        const uint64_t current = now();
+
+        // Skip publisher and sequence number - only the send time is needed here
+        const std::string::size_type begin = message.find(':', message.find(':') + 1);
+        const std::string::size_type end = message.find(';');
+
+        uint64_t timestamp = 0;
+        if (begin != std::string::npos && end != std::string::npos && begin < end &&
+            std::from_chars(message.data() + begin + 1, message.data() + end, timestamp).ec == std::errc() && isMeasured(timestamp)) {
+            receivedMessages++;
+            receivedBytes += message.size();
+            latency.record(current > timestamp ? current - timestamp : 0);
+        }
+    }
+
+    nlohmann::json Bench::report() const {
+        const double seconds = static_cast<double>(measureEnd - measureBegin) / static_cast<double>(nanosecondsPerSecond);
+        const double expected = static_cast<double>(publishedMessages) * static_cast<double>(readySubscribers);
+
+        nlohmann::json json;
+
+        json["transport"] = options.transport;
+        json["ktls"] = mqtt::ktls::KernelTls::instance().toJson();
+        json["publishers"] = {{"configured", options.publishers}, {"ready", readyPublishers}};
+        json["subscribers"] = {{"configured", options.subscribers}, {"ready", readySubscribers}, {"filter", options.filter}};
+        json["load"] = {{"topics", topicNames.size()},
+                        {"qos", options.qoSMix},
+                        {"payload", options.payloadMix},
+                        {"rate", options.rate},
+                        {"window", options.window},
+                        {"seed", options.seed}};
+        json["duration"] = seconds;
+        json["published"] = {{"messages", publishedMessages},
+                             {"bytes", publishedBytes},
+                             {"messages_per_second", static_cast<double>(publishedMessages) / seconds},
+                             {"bytes_per_second", static_cast<double>(publishedBytes) / seconds}};
+        json["received"] = {{"messages", receivedMessages},
+                            {"bytes", receivedBytes},
+                            {"messages_per_second", static_cast<double>(receivedMessages) / seconds},
+                            {"bytes_per_second", static_cast<double>(receivedBytes) / seconds}};
+        json["delivery_ratio"] = expected > 0 ? static_cast<double>(receivedMessages) / expected : 0;
+        json["latency_us"] = {{"min", static_cast<double>(latency.getMin()) / 1000},
+                              {"mean", latency.getMean() / 1000},
+                              {"p50", static_cast<double>(latency.percentile(0.5)) / 1000},
+                              {"p99", static_cast<double>(latency.percentile(0.99)) / 1000},
+                              {"p999", static_cast<double>(latency.percentile(0.999)) / 1000},
+                              {"max", static_cast<double>(latency.getMax()) / 1000}};
+
+        if (options.brokerPid > 0) {
+            const std::size_t connections = readyPublishers + readySubscribers;
+
+            json["broker_memory"] = {{"pid", options.brokerPid},
+                                     {"idle_bytes", brokerIdleBytes},
+                                     {"connected_bytes", brokerConnectedBytes},
+                                     {"connections", connections},
+                                     {"bytes_per_connection",
+                                      connections > 0 && brokerConnectedBytes > brokerIdleBytes
+                                          ? static_cast<double>(brokerConnectedBytes - brokerIdleBytes) / static_cast<double>(connections)
+                                          : 0}};
+        }
+
+        return json;
+    }
+
+    void Bench::finish() {
+        const std::string result = report().dump(2);
+
+        if (options.output.empty()) {
+            std::cout << result << std::endl;
+        } else {
+            std::ofstream output(options.output);
+            output << result << std::endl;
+
+            if (!output) {
+                LOG(ERROR) << "Bench: Writing report to '" << options.output << "' failed";
+            }
+        }
+
+        core::SNodeC::stop();
+    }
+
+} // namespace mqtt::mqttbench::lib
@@ -0,0 +1,159 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef APPS_MQTTBROKER_MQTTBENCH_LIB_BENCH_H
+#define APPS_MQTTBROKER_MQTTBENCH_LIB_BENCH_H
+
+#include "lib/LatencyHistogram.h"
+
+#include <core/timer/Timer.h>
+
+namespace mqtt::mqttbench::lib {
+    class Mqtt;
+} // namespace mqtt::mqttbench::lib
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <cstddef>
+#include <cstdint>
+#include <nlohmann/json_fwd.hpp>
+#include <optional>
+#include <random>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+#endif
+
+namespace mqtt::mqttbench::lib {
+
+    /* Drives a benchmark run: the first connections become subscribers, the remaining ones publishers. Publishing starts once all
+     * sessions are established (or the connect timeout expired), runs through a warmup and the measurement phase and stops for
+     * a drain phase collecting the messages still in flight. Each payload carries the publisher, its sequence number and the
+     * send time, thus the latency is taken from the payload and only messages sent during the measurement phase are counted.
+     *
+     * With a rate the load is open-loop: publishers send on a fixed schedule independent of the broker and latency is taken
+     * from the scheduled send time, so a stalled broker shows up as latency instead of a lower send rate. Without a rate each
+     * publisher sends as fast as its connection drains, keeping at most window bytes unsent.
+     *
+     * Given the pid of a broker on the same machine its resident memory is sampled before connecting and once all sessions are
+     * established, e.g. with 100000 subscribers and no publishers this measures the memory per connection. */
+    class Bench {
+    private:
+        Bench() = default;
+
+    public:
+        enum class Role : uint8_t { PUBLISHER, SUBSCRIBER };
+
+        struct Options {
+            std::size_t publishers = 1;
+            std::size_t subscribers = 1;
+            std::string topic = "mqttbench/{topic}"; // {topic} is replaced by the topic number
+            std::size_t topics = 1;
+            std::string filter = "mqttbench/#";
+            uint8_t subscribeQoS = 2;
+            std::string qoSMix = "0";       // value=weight,...
+            std::string payloadMix = "256"; // value=weight,... in bytes
+            double rate = 0;                // messages per second and publisher, 0 for closed-loop
+            std::size_t window = 65536;     // unsent bytes per publisher in closed-loop mode
+            double warmup = 2;
+            double duration = 10;
+            double drain = 2;
+            double connectTimeout = 10;
+            uint32_t seed = 1;
+            std::string transport;
+            std::string output; // empty for stdout
+            pid_t brokerPid = 0; // broker whose resident memory is reported, 0 for none
+        };
+
+        Bench(const Bench&) = delete;
+        Bench& operator=(const Bench&) = delete;
+
+        static Bench& instance();
+
+        bool configure(const Options& options); // false if a mix can not be parsed
+
+        std::size_t getConnections() const;
+
+        Mqtt* createMqtt(); // nullptr if all connections of the run exist already
+
+        void ready(Mqtt* mqtt); // publisher CONNACKed or subscriber SUBACKed
+        void disconnected(Mqtt* mqtt);
+        void received(const std::string& message);
+
+        const std::string& getFilter() const;
+        uint8_t getSubscribeQoS() const;
+
+    private:
+        enum class Phase : uint8_t { CONNECTING, WARMUP, MEASURING, DRAINING, DONE };
+
+        struct Mix {
+            std::vector<uint64_t> values;
+            std::discrete_distribution<std::size_t> distribution;
+        };
+
+        struct Publisher {
+            Mqtt* mqtt = nullptr;
+            uint64_t sequence = 0;
+        };
+
+        static bool parseMix(const std::string& spec, uint64_t maximum, Mix& mix);
+        static uint64_t now();
+        static uint64_t residentBytes(pid_t pid); // including the worker processes
+
+        void begin();
+        void nextPhase();
+        void tick();
+        void publish(std::size_t index, uint64_t timestamp);
+        bool isMeasured(uint64_t timestamp) const;
+        nlohmann::json report() const;
+        void finish();
+
+        Options options;
+        std::vector<std::string> topicNames;
+        Mix qoSMix;
+        Mix payloadMix;
+        std::mt19937 random;
+
+        Phase phase = Phase::CONNECTING;
+        std::size_t created = 0;
+        std::size_t readyPublishers = 0;
+        std::size_t readySubscribers = 0;
+        std::vector<Publisher> publishers;
+
+        uint64_t brokerIdleBytes = 0;      // before the run connects
+        uint64_t brokerConnectedBytes = 0; // all sessions established, before publishing
+
+        uint64_t beginTime = 0;
+        uint64_t measureBegin = 0;
+        uint64_t measureEnd = 0; // 0 while measuring
+
+        uint64_t publishedMessages = 0;
+        uint64_t publishedBytes = 0;
+        uint64_t receivedMessages = 0;
+        uint64_t receivedBytes = 0;
+        LatencyHistogram latency;
+
+        std::optional<core::timer::Timer> phaseTimer;
+        std::optional<core::timer::Timer> tickTimer;
+    };
+
+} // namespace mqtt::mqttbench::lib
+
+#endif // APPS_MQTTBROKER_MQTTBENCH_LIB_BENCH_H
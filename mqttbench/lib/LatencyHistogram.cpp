@@ -0,0 +1,106 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "LatencyHistogram.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#endif
+
+namespace mqtt::mqttbench::lib {
+
+    std::size_t LatencyHistogram::bucketOf(uint64_t value) {
+        std::size_t bucket = static_cast<std::size_t>(value);
+
+        if (value >= subBuckets) {
+            // Values with the most significant bit at position msb share a group of sub-buckets, each 2^(msb - 5) wide
+            const unsigned msb = static_cast<unsigned>(std::bit_width(value)) - 1;
+            const uint64_t group = msb - subBucketBits + 1;
+
+            bucket = static_cast<std::size_t>(group * subBuckets + ((value >> (msb - subBucketBits)) - subBuckets));
+        }
+
+        return bucket;
+    }
+
+    uint64_t LatencyHistogram::upperBoundOf(std::size_t bucket) {
+        uint64_t upperBound = bucket;
+
+        if (bucket >= subBuckets) {
+            const uint64_t group = bucket / subBuckets;
+            const uint64_t subBucket = bucket % subBuckets;
+
+            upperBound = ((subBuckets + subBucket + 1) << (group - 1)) - 1;
+        }
+
+        return upperBound;
+    }
+
+    void LatencyHistogram::record(uint64_t nanoseconds) {
+        counts[bucketOf(nanoseconds)]++;
+
+        count++;
+        min = std::min(min, nanoseconds);
+        max = std::max(max, nanoseconds);
+        sum += static_cast<double>(nanoseconds);
+    }
+
+    void LatencyHistogram::reset() {
+        *this = LatencyHistogram();
+    }
+
+    uint64_t LatencyHistogram::percentile(double quantile) const {
+        uint64_t value = 0;
+
+        if (count > 0) {
+            const uint64_t rank = std::max(uint64_t{1}, static_cast<uint64_t>(std::ceil(quantile * static_cast<double>(count))));
+
+            uint64_t seen = 0;
+            std::size_t bucket = 0;
+            for (; bucket < counts.size() && seen + counts[bucket] < rank; ++bucket) {
+                seen += counts[bucket];
+            }
+
+            value = std::clamp(upperBoundOf(bucket), min, max);
+        }
+
+        return value;
+    }
+
+    uint64_t LatencyHistogram::getCount() const {
+        return count;
+    }
+
+    uint64_t LatencyHistogram::getMin() const {
+        return count > 0 ? min : 0;
+    }
+
+    uint64_t LatencyHistogram::getMax() const {
+        return max;
+    }
+
+    double LatencyHistogram::getMean() const {
+        return count > 0 ? sum / static_cast<double>(count) : 0;
+    }
+
+} // namespace mqtt::mqttbench::lib
@@ -0,0 +1,64 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef APPS_MQTTBROKER_MQTTBENCH_LIB_LATENCYHISTOGRAM_H
+#define APPS_MQTTBROKER_MQTTBENCH_LIB_LATENCYHISTOGRAM_H
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#endif
+
+namespace mqtt::mqttbench::lib {
+
+    /* Log-linear histogram of latencies in nanoseconds. Each power of two is split into 32 linear sub-buckets, thus percentiles
+     * are exact to about 3 % while the histogram keeps a fixed size independent of the number of samples. */
+    class LatencyHistogram {
+    public:
+        void record(uint64_t nanoseconds);
+        void reset();
+
+        uint64_t percentile(double quantile) const; // upper bound of the bucket holding the quantile
+
+        uint64_t getCount() const;
+        uint64_t getMin() const;
+        uint64_t getMax() const;
+        double getMean() const;
+
+    private:
+        static constexpr unsigned subBucketBits = 5;
+        static constexpr uint64_t subBuckets = uint64_t{1} << subBucketBits;
+
+        static std::size_t bucketOf(uint64_t value);
+        static uint64_t upperBoundOf(std::size_t bucket);
+
+        std::array<uint64_t, 64 * subBuckets> counts{};
+        uint64_t count = 0;
+        uint64_t min = std::numeric_limits<uint64_t>::max();
+        uint64_t max = 0;
+        double sum = 0;
+    };
+
+} // namespace mqtt::mqttbench::lib
+
+#endif // APPS_MQTTBROKER_MQTTBENCH_LIB_LATENCYHISTOGRAM_H
@@ -0,0 +1,96 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Mqtt.h"
+
+#include <core/socket/stream/SocketConnection.h>
+#include <iot/mqtt/Topic.h>
+#include <iot/mqtt/packets/Connack.h>
+#include <iot/mqtt/packets/Publish.h>
+#include <iot/mqtt/packets/Suback.h>
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <cstring>
+#include <list>
+#include <log/Logger.h>
+#include <utils/system/signal.h>
+
+#endif
+
+namespace mqtt::mqttbench::lib {
+
+    Mqtt::Mqtt(const std::string& clientId, Bench::Role role)
+        : iot::mqtt::client::Mqtt(clientId)
+        , role(role) {
+    }
+
+    void Mqtt::publish(const std::string& topic, const std::string& message, uint8_t qoS) {
+        sendPublish(topic, message, qoS, false);
+    }
+
+    std::size_t Mqtt::getBacklog() const {
+        return getSocketConnection()->getTotalQueued() - getSocketConnection()->getTotalSent();
+    }
+
+    Bench::Role Mqtt::getRole() const {
+        return role;
+    }
+
+    void Mqtt::onConnected() {
+        VLOG(1) << "MQTT: Initiating Session '" << clientId << "'";
+
+        sendConnect(60, clientId, true, "", "", 0, false, "", "");
+    }
+
+    void Mqtt::onDisconnected() {
+        Bench::instance().disconnected(this);
+    }
+
+    bool Mqtt::onSignal(int signum) {
+        VLOG(1) << "MQTT: On Exit due to '" << strsignal(signum) << "' (SIG" << utils::system::sigabbrev_np(signum) << " = " << signum
+                << ")";
+
+        sendDisconnect();
+
+        return Super::onSignal(signum);
+    }
+
+    void Mqtt::onConnack(const iot::mqtt::packets::Connack& connack) {
+        if (connack.getReturnCode() != 0) {
+            LOG(ERROR) << "MQTT: Session '" << clientId << "' refused: " << static_cast<int>(connack.getReturnCode());
+        } else if (role == Bench::Role::SUBSCRIBER) {
+            const std::list<iot::mqtt::Topic> topicList = {
+                iot::mqtt::Topic(Bench::instance().getFilter(), Bench::instance().getSubscribeQoS())};
+
+            sendSubscribe(topicList);
+        } else {
+            Bench::instance().ready(this);
+        }
+    }
+
+    void Mqtt::onSuback([[maybe_unused]] const iot::mqtt::packets::Suback& suback) {
+        Bench::instance().ready(this);
+    }
+
+    void Mqtt::onPublish(const iot::mqtt::packets::Publish& publish) {
+        Bench::instance().received(publish.getMessage());
+    }
+
+} // namespace mqtt::mqttbench::lib
@@ -0,0 +1,64 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef APPS_MQTTBROKER_MQTTBENCH_LIB_MQTT_H
+#define APPS_MQTTBROKER_MQTTBENCH_LIB_MQTT_H
+
+#include "lib/Bench.h"
+
+#include <iot/mqtt/client/Mqtt.h>
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#endif
+
+namespace mqtt::mqttbench::lib {
+
+    // One benchmark connection, either publishing the generated load or subscribing to it
+    class Mqtt : public iot::mqtt::client::Mqtt {
+    public:
+        Mqtt(const std::string& clientId, Bench::Role role);
+
+        void publish(const std::string& topic, const std::string& message, uint8_t qoS);
+
+        std::size_t getBacklog() const; // bytes queued but not yet written to the socket
+
+        Bench::Role getRole() const;
+
+    private:
+        using Super = iot::mqtt::client::Mqtt;
+
+        void onConnected() final;
+        void onDisconnected() final;
+        [[nodiscard]] bool onSignal(int signum) final;
+
+        void onConnack(const iot::mqtt::packets::Connack& connack) final;
+        void onSuback(const iot::mqtt::packets::Suback& suback) final;
+        void onPublish(const iot::mqtt::packets::Publish& publish) final;
+
+        Bench::Role role;
+    };
+
+} // namespace mqtt::mqttbench::lib
+
+#endif // APPS_MQTTBROKER_MQTTBENCH_LIB_MQTT_H
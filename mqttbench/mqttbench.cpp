@@ -0,0 +1,263 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SocketContextFactory.h"
+#include "ktls/KernelTls.h"
+#include "lib/Bench.h"
+#include "websocket/SubProtocolFactory.h"
+
+#include <web/websocket/client/SocketContextUpgradeFactory.h>
+#include <web/websocket/client/SubProtocolFactorySelector.h>
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <core/SNodeC.h>
+//
+#include <net/in/stream/legacy/SocketClient.h>
+#include <net/in/stream/tls/SocketClient.h>
+#include <net/in6/stream/legacy/SocketClient.h>
+#include <net/in6/stream/tls/SocketClient.h>
+#include <net/un/stream/legacy/SocketClient.h>
+#include <web/http/legacy/in/Client.h>
+#include <web/http/tls/in/Client.h>
+//
+#include <log/Logger.h>
+#include <utils/Config.h>
+//
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+#endif
+
+static void
+reportState(const std::string& instanceName, const core::socket::SocketAddress& socketAddress, const core::socket::State& state) {
+    switch (state) {
+        case core::socket::State::OK:
+            VLOG(1) << instanceName << ": connected to '" << socketAddress.toString() << "'";
+            break;
+        case core::socket::State::DISABLED:
+            VLOG(1) << instanceName << ": disabled";
+            break;
+        case core::socket::State::ERROR:
+            LOG(ERROR) << instanceName << ": " << socketAddress.toString() << ": " << state.what();
+            break;
+        case core::socket::State::FATAL:
+            LOG(FATAL) << instanceName << ": " << socketAddress.toString() << ": " << state.what();
+            break;
+    }
+}
+
+// Hands the record encryption of a TLS client to the kernel if kTLS is enabled for its instance. SNode.C starts TLS after
+// onConnect, thus the SSL_CTX is set up there - before the handshake of the first connection.
+template <typename Client>
+void enableKernelTls(Client& client, const std::string& instanceName) {
+    if constexpr (requires(typename Client::SocketConnection* socketConnection) { socketConnection->getSSL(); }) {
+        typename Client::Config* config = &client.getConfig();
+
+        client.setOnConnect([instanceName, config]([[maybe_unused]] typename Client::SocketConnection* socketConnection) -> void {
+            mqtt::ktls::KernelTls::instance().setup(instanceName, config->getSslCtx());
+        });
+        client.setOnConnected([instanceName](typename Client::SocketConnection* socketConnection) -> void {
+            mqtt::ktls::KernelTls::instance().handshake(instanceName, socketConnection->getSSL());
+        });
+    }
+}
+
+// Opens all connections of the run through one client instance - each connect() creates an independent connection
+template <template <typename, typename...> typename SocketClient,
+          typename SocketContextFactory,
+          typename Client = SocketClient<SocketContextFactory>,
+          typename SocketAddress = typename Client::SocketAddress,
+          typename = std::enable_if_t<std::is_base_of_v<core::socket::stream::SocketContextFactory, SocketContextFactory>>>
+void startClient(const std::string& instanceName,
+                 std::size_t connections,
+                 const std::function<void(typename Client::Config&)>& configurator) {
+    Client client(instanceName);
+    enableKernelTls(client, instanceName);
+
+    configurator(client.getConfig());
+
+    for (std::size_t connection = 0; connection < connections; ++connection) {
+        client.connect([instanceName](const SocketAddress& socketAddress, const core::socket::State& state) -> void {
+            reportState(instanceName, socketAddress, state);
+        });
+    }
+}
+
+template <typename HttpClient>
+void startClient(const std::string& name, std::size_t connections, const std::function<void(typename HttpClient::Config&)>& configurator) {
+    using SocketAddress = typename HttpClient::SocketAddress;
+
+    const HttpClient httpClient(
+        name,
+        [](const std::shared_ptr<web::http::client::Request>& req) -> void {
+            req->set("Sec-WebSocket-Protocol", "mqtt");
+
+            if (!req->upgrade(
+                    "/ws/",
+                    "websocket",
+                    [](const std::shared_ptr<web::http::client::Request>& req,
+                       const std::shared_ptr<web::http::client::Response>& res) -> void {
+                        req->upgrade(res, [subProtocolsRequested = req->header("Upgrade")](const std::string& name) -> void {
+                            if (name.empty()) {
+                                LOG(ERROR) << "Can not upgrade to any of '" << subProtocolsRequested << "'";
+                            }
+                        });
+                    },
+                    [](const std::shared_ptr<web::http::client::Request>& req, const std::string& reason) -> void {
+                        LOG(ERROR) << "Upgrade to subprotocols '" << req->header("Upgrade")
+                                   << "' failed with response parse error: " << reason;
+                    })) {
+                LOG(ERROR) << "Initiating upgrade to any of 'upgradeprotocol, websocket' failed";
+            }
+        },
+        []([[maybe_unused]] const std::shared_ptr<web::http::client::Request>& req) -> void {
+            VLOG(1) << "Session ended";
+        });
+
+    configurator(httpClient.getConfig());
+
+    for (std::size_t connection = 0; connection < connections; ++connection) {
+        httpClient.connect([name](const SocketAddress& socketAddress, const core::socket::State& state) -> void {
+            reportState(name, socketAddress, state);
+        });
+    }
+}
+
+static bool startTransport(const std::string& transport, std::size_t connections) {
+    bool known = true;
+
+    const auto configurator = [](auto& config) -> void {
+        config.setRetry();
+        config.setRetryBase(1);
+    };
+
+    if (transport == "in-mqtt") {
+        startClient<net::in::stream::legacy::SocketClient, mqtt::mqttbench::SocketContextFactory>(
+            transport, connections, [configurator](auto& config) -> void {
+                config.Remote::setPort(1883);
+                configurator(config);
+            });
+    } else if (transport == "in-mqtts") {
+        startClient<net::in::stream::tls::SocketClient, mqtt::mqttbench::SocketContextFactory>(
+            transport, connections, [configurator](auto& config) -> void {
+                config.Remote::setPort(8883);
+                configurator(config);
+            });
+    } else if (transport == "in6-mqtt") {
+        startClient<net::in6::stream::legacy::SocketClient, mqtt::mqttbench::SocketContextFactory>(
+            transport, connections, [configurator](auto& config) -> void {
+                config.Remote::setPort(1883);
+                configurator(config);
+            });
+    } else if (transport == "in6-mqtts") {
+        startClient<net::in6::stream::tls::SocketClient, mqtt::mqttbench::SocketContextFactory>(
+            transport, connections, [configurator](auto& config) -> void {
+                config.Remote::setPort(8883);
+                configurator(config);
+            });
+    } else if (transport == "un-mqtt") {
+        startClient<net::un::stream::legacy::SocketClient, mqtt::mqttbench::SocketContextFactory>(transport, connections, configurator);
+    } else if (transport == "in-wsmqtt") {
+        startClient<web::http::legacy::in::Client>(transport, connections, [configurator](auto& config) -> void {
+            config.Remote::setPort(8080);
+            configurator(config);
+        });
+    } else if (transport == "in-wsmqtts") {
+        startClient<web::http::tls::in::Client>(transport, connections, [configurator](auto& config) -> void {
+            config.Remote::setPort(8088);
+            configurator(config);
+        });
+    } else {
+        known = false;
+    }
+
+    return known;
+}
+
+int main(int argc, char* argv[]) {
+    web::websocket::client::SocketContextUpgradeFactory::link();
+    web::websocket::client::SubProtocolFactorySelector::link("mqtt", mqttBenchSubProtocolFactory);
+
+    utils::Config::addStringOption("--transport",
+                                   "Client instance used for all connections",
+                                   "[in-mqtt|in-mqtts|in6-mqtt|in6-mqtts|un-mqtt|in-wsmqtt|in-wsmqtts]",
+                                   "in-mqtt");
+    utils::Config::addStringOption("--publishers", "Number of publishing connections", "[n]", "1");
+    utils::Config::addStringOption("--subscribers", "Number of subscribing connections", "[n]", "1");
+    utils::Config::addStringOption(
+        "--topic", "Topic published to, {topic} is replaced by the topic number", "[topic]", "mqttbench/{topic}");
+    utils::Config::addStringOption("--topics", "Number of distinct topics the publishers cycle through", "[n]", "1");
+    utils::Config::addStringOption("--filter", "Topic filter of the subscribers", "[filter]", "mqttbench/#");
+    utils::Config::addStringOption("--subscribe-qos", "QoS of the subscriptions", "[0|1|2]", "2");
+    utils::Config::addStringOption("--qos", "QoS mix of the published messages", "[qos=weight,...]", "0");
+    utils::Config::addStringOption("--payload", "Payload size mix of the published messages", "[bytes=weight,...]", "256");
+    utils::Config::addStringOption("--rate", "Open-loop messages per second of each publisher, 0 for closed-loop", "[rate]", "0");
+    utils::Config::addStringOption("--window", "Unsent bytes per publisher in closed-loop mode", "[bytes]", "65536");
+    utils::Config::addStringOption("--warmup", "Publishing before the measurement starts", "[seconds]", "2");
+    utils::Config::addStringOption("--duration", "Duration of the measurement", "[seconds]", "10");
+    utils::Config::addStringOption("--drain", "Time given to messages in flight after the measurement", "[seconds]", "2");
+    utils::Config::addStringOption("--connect-timeout", "Time to establish all sessions before publishing starts", "[seconds]", "10");
+    utils::Config::addStringOption("--seed", "Seed of the QoS and payload mix selection", "[n]", "1");
+    utils::Config::addStringOption("--ktls", "Kernel TLS offload of the TLS transports, compare runs with on and off", "[on|off]", "off");
+    utils::Config::addStringOption("--output", "File the JSON report is written to, stdout if empty", "[path]", "");
+    utils::Config::addStringOption("--broker-pid", "Local broker whose resident memory is reported, 0 for none", "[pid]", "0");
+
+    core::SNodeC::init(argc, argv);
+
+    mqtt::mqttbench::lib::Bench::Options options;
+    options.transport = utils::Config::getStringOptionValue("--transport");
+    options.publishers = std::strtoull(utils::Config::getStringOptionValue("--publishers").data(), nullptr, 10);
+    options.subscribers = std::strtoull(utils::Config::getStringOptionValue("--subscribers").data(), nullptr, 10);
+    options.topic = utils::Config::getStringOptionValue("--topic");
+    options.topics = std::strtoull(utils::Config::getStringOptionValue("--topics").data(), nullptr, 10);
+    options.filter = utils::Config::getStringOptionValue("--filter");
+    options.subscribeQoS = static_cast<uint8_t>(std::min(std::atoi(utils::Config::getStringOptionValue("--subscribe-qos").data()), 2));
+    options.qoSMix = utils::Config::getStringOptionValue("--qos");
+    options.payloadMix = utils::Config::getStringOptionValue("--payload");
+    options.rate = std::atof(utils::Config::getStringOptionValue("--rate").data());
+    options.window = std::strtoull(utils::Config::getStringOptionValue("--window").data(), nullptr, 10);
+    options.warmup = std::atof(utils::Config::getStringOptionValue("--warmup").data());
+    options.duration = std::atof(utils::Config::getStringOptionValue("--duration").data());
+    options.drain = std::atof(utils::Config::getStringOptionValue("--drain").data());
+    options.connectTimeout = std::atof(utils::Config::getStringOptionValue("--connect-timeout").data());
+    options.seed = static_cast<uint32_t>(std::strtoul(utils::Config::getStringOptionValue("--seed").data(), nullptr, 10));
+    options.output = utils::Config::getStringOptionValue("--output");
+    options.brokerPid = static_cast<pid_t>(std::atol(utils::Config::getStringOptionValue("--broker-pid").data()));
+
+    mqtt::ktls::KernelTls::instance().configure("*=" + utils::Config::getStringOptionValue("--ktls"));
+
+    int result = EXIT_FAILURE;
+
+    if (mqtt::mqttbench::lib::Bench::instance().configure(options)) {
+        if (startTransport(options.transport, mqtt::mqttbench::lib::Bench::instance().getConnections())) {
+            result = core::SNodeC::start();
+        } else {
+            LOG(ERROR) << "Unknown transport '" << options.transport << "'";
+        }
+    }
+
+    return result;
+}
@@ -21,6 +21,7 @@
 
 #include "Bridge.h"
 #include "Broker.h"
+#include "lib/LoopMonitor.h"
 
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 
@@ -87,6 +88,8 @@ namespace mqtt::bridge::lib {
     }
 
     void Mqtt::onPublish(const iot::mqtt::packets::Publish& publish) {
+        const mqtt::lib::LoopMonitor::Probe probe("socket read: mqtt publish");
+
         broker.getBridge().publish(this, publish);
     }
 
@@ -18,7 +18,9 @@
  */
 
 #include "SocketContextFactory.h"
+#include "ktls/KernelTls.h"
 #include "lib/BridgeStore.h"
+#include "lib/LoopMonitor.h"
 
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 
@@ -124,6 +126,7 @@
 #include <web/http/tls/in6/Client.h>
 #endif
 
+#include <cstdlib>
 #include <list>
 #include <string>
 #include <tuple>
@@ -151,6 +154,22 @@ reportState(const std::string& instanceName, const core::socket::SocketAddress&
     }
 }
 
+// Hands the record encryption of a TLS client to the kernel if kTLS is enabled for its instance. SNode.C starts TLS after
+// onConnect, thus the SSL_CTX is set up there - before the handshake of the first connection.
+template <typename Client>
+void enableKernelTls(Client& client, const std::string& instanceName) {
+    if constexpr (requires(typename Client::SocketConnection* socketConnection) { socketConnection->getSSL(); }) {
+        typename Client::Config* config = &client.getConfig();
+
+        client.setOnConnect([instanceName, config]([[maybe_unused]] typename Client::SocketConnection* socketConnection) -> void {
+            mqtt::ktls::KernelTls::instance().setup(instanceName, config->getSslCtx());
+        });
+        client.setOnConnected([instanceName](typename Client::SocketConnection* socketConnection) -> void {
+            mqtt::ktls::KernelTls::instance().handshake(instanceName, socketConnection->getSSL());
+        });
+    }
+}
+
 template <template <typename, typename...> typename SocketClient,
           typename SocketContextFactory,
           typename... SocketContextFactoryArgs,
@@ -160,7 +179,8 @@ template <template <typename, typename...> typename SocketClient,
 void startClient(const std::string& instanceName,
                  const std::function<void(typename Client::Config&)>& configurator,
                  SocketContextFactoryArgs&&... socketContextFactoryArgs) {
-    const Client client(instanceName, std::forward<SocketContextFactoryArgs>(socketContextFactoryArgs)...);
+    Client client(instanceName, std::forward<SocketContextFactoryArgs>(socketContextFactoryArgs)...);
+    enableKernelTls(client, instanceName);
 
     configurator(client.getConfig());
 
@@ -179,6 +199,7 @@ template <template <typename, typename...> typename SocketClient,
                                                               typename SocketClient<SocketContextFactory>::Config&>>>
 void startClient(const std::string& instanceName, SocketContextFactoryArgs&&... socketContextFactoryArgs) {
     Client client(instanceName, std::forward<SocketContextFactoryArgs>(socketContextFactoryArgs)...);
+    enableKernelTls(client, instanceName);
 
     client.connect([instanceName](const SocketAddress& socketAddress, const core::socket::State& state) -> void {
         reportState(instanceName, socketAddress, state);
@@ -246,8 +267,18 @@ int main(int argc, char* argv[]) {
                          ->configurable()
                          ->required());
 
+    utils::Config::addStringOption(
+        "--loop-stall-threshold", "Duration of an event loop callback counted as stall", "[seconds]", "0.05");
+    utils::Config::addStringOption("--loop-log-interval", "Interval of the event loop summary log, 0 disables", "[seconds]", "60");
+    utils::Config::addStringOption(
+        "--ktls", "Kernel TLS offload per TLS client instance, '*' for all others", "[instance=on|off,...]", "");
+
     core::SNodeC::init(argc, argv);
 
+    mqtt::lib::LoopMonitor::instance().start(std::atof(utils::Config::getStringOptionValue("--loop-stall-threshold").data()),
+                                             std::atof(utils::Config::getStringOptionValue("--loop-log-interval").data()));
+    mqtt::ktls::KernelTls::instance().configure(utils::Config::getStringOptionValue("--ktls"));
+
     if (bridgeDefinitionFile != "<REQUIRED>") {
         if (mqtt::bridge::lib::BridgeStore::instance().loadAndValidate(bridgeDefinitionFile)) {
             for (const auto& [instanceName, broker] : mqtt::bridge::lib::BridgeStore::instance().getBrokers()) {
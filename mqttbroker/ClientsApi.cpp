@@ -0,0 +1,257 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ClientsApi.h"
+
+#include "lib/LoopMonitor.h"
+#include "lib/Mqtt.h"
+#include "lib/MqttModel.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <core/EventReceiver.h>
+#include <express/Request.h>
+#include <express/Response.h>
+#include <log/Logger.h>
+//
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#endif
+
+namespace mqtt::mqttbroker {
+
+    namespace {
+
+        constexpr std::size_t defaultLimit = 100;
+        constexpr std::size_t maxLimit = 1000;
+        constexpr std::size_t chunkClients = 64;   // clients serialized per event loop iteration
+        constexpr std::size_t chunkScanned = 4096; // records inspected per event loop iteration (filters may reject most)
+
+        enum Field : uint16_t {
+            CLIENT_ID = 1 << 0,
+            USERNAME = 1 << 1,
+            LOCAL_ADDRESS = 1 << 2,
+            REMOTE_ADDRESS = 1 << 3,
+            CONNECTED_AT = 1 << 4,
+            KEEP_ALIVE = 1 << 5,
+            PROTOCOL_LEVEL = 1 << 6,
+            CLEAN_SESSION = 1 << 7,
+            OUTBOUND = 1 << 8,
+            RATE_LIMITED = 1 << 9
+        };
+
+        struct Listing {
+            std::shared_ptr<express::Response> res;
+
+            uint64_t cursor = 0;
+            std::size_t limit = defaultLimit;
+            std::string prefix;
+            std::string address;
+            uint16_t fields = 0xFFFF;
+
+            std::size_t sent = 0;
+        };
+
+        uint16_t parseFields(const std::string& fieldsString) {
+            static const std::pair<const char*, Field> fieldNames[] = {{"client_id", CLIENT_ID},
+                                                                       {"username", USERNAME},
+                                                                       {"local_address", LOCAL_ADDRESS},
+                                                                       {"remote_address", REMOTE_ADDRESS},
+                                                                       {"connected_at", CONNECTED_AT},
+                                                                       {"keep_alive", KEEP_ALIVE},
+                                                                       {"protocol_level", PROTOCOL_LEVEL},
+                                                                       {"clean_session", CLEAN_SESSION},
+                                                                       {"outbound", OUTBOUND},
+                                                                       {"rate_limited", RATE_LIMITED}};
+
+            uint16_t fields = 0;
+
+            std::size_t begin = 0;
+            while (begin <= fieldsString.size()) {
+                const std::size_t end = std::min(fieldsString.find(',', begin), fieldsString.size());
+                const std::string name = fieldsString.substr(begin, end - begin);
+
+                for (const auto& [fieldName, field] : fieldNames) {
+                    if (name == fieldName) {
+                        fields |= field;
+                    }
+                }
+
+                begin = end + 1;
+            }
+
+            return fields;
+        }
+
+        void serializeClient(const Listing& listing, const mqtt::mqttbroker::lib::MqttModel::Client& client, std::string& chunk) {
+            nlohmann::json json;
+
+            json["serial"] = client.serial;
+            if ((listing.fields & CLIENT_ID) != 0) {
+                json["client_id"] = client.clientId;
+            }
+            if ((listing.fields & USERNAME) != 0) {
+                json["username"] = *client.username;
+            }
+            if ((listing.fields & LOCAL_ADDRESS) != 0) {
+                json["local_address"] = client.mqtt->getSocketConnection()->getLocalAddress().toString();
+            }
+            if ((listing.fields & REMOTE_ADDRESS) != 0) {
+                json["remote_address"] = client.mqtt->getSocketConnection()->getRemoteAddress().toString();
+            }
+            if ((listing.fields & CONNECTED_AT) != 0) {
+                json["connected_at"] = client.connectedAt;
+            }
+            if ((listing.fields & KEEP_ALIVE) != 0) {
+                json["keep_alive"] = client.keepAlive;
+            }
+            if ((listing.fields & PROTOCOL_LEVEL) != 0) {
+                json["protocol_level"] = client.level;
+            }
+            if ((listing.fields & CLEAN_SESSION) != 0) {
+                json["clean_session"] = client.cleanSession;
+            }
+            if ((listing.fields & OUTBOUND) != 0) {
+                const mqtt::mqttbroker::lib::Mqtt::Outbound& outbound = client.mqtt->getOutbound();
+
+                json["outbound"] = {{"backlog", client.mqtt->getOutboundBacklog()},
+                                    {"dropped", outbound.dropped},
+                                    {"over_seconds", outbound.overSeconds},
+                                    {"throttled", outbound.over}};
+            }
+            if ((listing.fields & RATE_LIMITED) != 0) {
+                json["rate_limited"] = client.mqtt->getRateLimited();
+            }
+
+            chunk += json.dump();
+        }
+
+        bool matches(const Listing& listing, const mqtt::mqttbroker::lib::MqttModel::Client& client) {
+            bool match = client.mqtt != nullptr && client.clientId.starts_with(listing.prefix);
+
+            if (match && !listing.address.empty()) {
+                match = client.mqtt->getSocketConnection()->getRemoteAddress().toString().find(listing.address) != std::string::npos ||
+                        client.mqtt->getSocketConnection()->getLocalAddress().toString().find(listing.address) != std::string::npos;
+            }
+
+            return match;
+        }
+
+        void sendClients(const std::shared_ptr<Listing>& listing);
+
+        void sendNextChunk(const std::shared_ptr<Listing>& listing) {
+            if (listing->res->isConnected()) {
+                sendClients(listing);
+            } else {
+                VLOG(1) << "Client listing aborted: connection closed";
+            }
+        }
+
+        void sendClients(const std::shared_ptr<Listing>& listing) {
+            const mqtt::lib::LoopMonitor::Probe probe("http: /api/clients");
+
+            // The registry may have changed since the last chunk - resume behind the cursor, not at a stored position
+            const mqtt::mqttbroker::lib::MqttModel& mqttModel = mqtt::mqttbroker::lib::MqttModel::instance();
+            const std::vector<mqtt::mqttbroker::lib::MqttModel::Client>& clients = mqttModel.getClients();
+            std::size_t index = mqttModel.lowerBound(listing->cursor + 1);
+
+            std::string chunk;
+            std::size_t serialized = 0;
+            std::size_t scanned = 0;
+
+            for (; index < clients.size() && listing->sent < listing->limit && serialized < chunkClients && scanned < chunkScanned;
+                 ++index, ++scanned) {
+                const mqtt::mqttbroker::lib::MqttModel::Client& client = clients[index];
+
+                if (matches(*listing, client)) {
+                    if (listing->sent > 0) {
+                        chunk += ",";
+                    }
+                    serializeClient(*listing, client, chunk);
+
+                    listing->sent++;
+                    serialized++;
+                }
+
+                listing->cursor = client.serial;
+            }
+
+            const bool exhausted = index >= clients.size();
+
+            if (listing->sent < listing->limit && !exhausted) {
+                if (!chunk.empty()) { // an empty fragment would terminate the chunked body
+                    listing->res->sendFragment(chunk);
+                }
+
+                core::EventReceiver::atNextTick([listing]() -> void {
+                    sendNextChunk(listing);
+                });
+            } else {
+                chunk += "],\"next\":" + (exhausted ? std::string("null") : std::to_string(listing->cursor)) + "}";
+
+                listing->res->sendFragment(chunk);
+                listing->res->end();
+            }
+        }
+
+        std::size_t toSize(const std::string& value, std::size_t defaultValue) {
+            std::size_t result = defaultValue;
+
+            try {
+                result = value.empty() ? defaultValue : static_cast<std::size_t>(std::stoull(value));
+            } catch (const std::logic_error&) {
+                // keep default
+            }
+
+            return result;
+        }
+
+    } // namespace
+
+    void ClientsApi::list(const std::shared_ptr<express::Request>& req, const std::shared_ptr<express::Response>& res) {
+        const std::shared_ptr<Listing> listing = std::make_shared<Listing>();
+
+        listing->res = res;
+        listing->cursor = toSize(req->query("after"), 0);
+        // At least one client per page - an empty page would return the incoming cursor as next and a pager would loop forever
+        listing->limit = std::clamp(toSize(req->query("limit"), defaultLimit), std::size_t{1}, maxLimit);
+        listing->prefix = req->query("prefix");
+        listing->address = req->query("address");
+        if (!req->query("fields").empty()) {
+            listing->fields = parseFields(req->query("fields"));
+        }
+
+        res->set("Content-Type", "application/json");
+        res->set("Transfer-Encoding", "chunked");
+        res->set("Cache-Control", "no-store");
+        res->sendHeader();
+
+        res->sendFragment("{\"clients\":[");
+
+        sendNextChunk(listing);
+    }
+
+} // namespace mqtt::mqttbroker
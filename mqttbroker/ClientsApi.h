@@ -0,0 +1,61 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MQTTBROKER_CLIENTSAPI_H
+#define MQTTBROKER_CLIENTSAPI_H
+
+namespace express {
+    class Request;
+    class Response;
+} // namespace express
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <memory>
+
+#endif
+
+namespace mqtt::mqttbroker {
+
+    /* GET /api/clients - paginated listing of the connected clients
+     *
+     * Query parameters:
+     *   after   serial of the last client of the previous page (cursor, default 0)
+     *   limit   maximum number of clients returned (default 100, at most 1000)
+     *   prefix  only clients whose client id starts with prefix
+     *   address only clients whose local or remote address contains address
+     *   fields  comma separated list out of client_id, username, local_address, remote_address, connected_at, keep_alive,
+     *           protocol_level, clean_session, outbound, rate_limited (default all)
+     *
+     * outbound: {"backlog":<bytes not yet written>,"dropped":<QoS 0 messages dropped by the slow consumer policy>,
+     *            "over_seconds":<time above the high water mark>,"throttled":<slow consumer policy in force>}
+     * rate_limited: number of publishes of the client over a rate limit
+     *
+     * Response: {"clients":[{"serial":...,...},...],"next":<cursor of the next page or null>}
+     *
+     * The body is serialized and sent chunk by chunk. Between two chunks control is given back to the event loop, thus a large
+     * listing does not delay message delivery. */
+    class ClientsApi {
+    public:
+        static void list(const std::shared_ptr<express::Request>& req, const std::shared_ptr<express::Response>& res);
+    };
+
+} // namespace mqtt::mqttbroker
+
+#endif // MQTTBROKER_CLIENTSAPI_H
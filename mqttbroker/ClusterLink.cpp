@@ -0,0 +1,70 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ClusterLink.h"
+
+#include "lib/Cluster.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <cstring>
+#include <iot/mqtt/packets/Connack.h>
+#include <log/Logger.h>
+#include <utils/system/signal.h>
+
+#endif
+
+namespace mqtt::mqttbroker {
+
+    ClusterLink::ClusterLink(const std::string& peerNode)
+        : iot::mqtt::client::Mqtt(mqtt::mqttbroker::lib::Cluster::instance().getLinkClientId())
+        , peerNode(peerNode) {
+    }
+
+    void ClusterLink::onConnected() {
+        VLOG(1) << "Cluster: Initiating link to '" << peerNode << "'";
+
+        const mqtt::mqttbroker::lib::Cluster& cluster = mqtt::mqttbroker::lib::Cluster::instance();
+
+        // Clean session: the summary is resent on each link up, nothing needs to survive a reconnect
+        sendConnect(60, cluster.getLinkClientId(), true, "", "", 0, false, cluster.getLinkUsername(), cluster.getLinkPassword());
+    }
+
+    void ClusterLink::onDisconnected() {
+        mqtt::mqttbroker::lib::Cluster::instance().linkDown(peerNode);
+    }
+
+    bool ClusterLink::onSignal(int signum) {
+        VLOG(1) << "Cluster: Link to '" << peerNode << "' closed due to '" << strsignal(signum) << "' (SIG"
+                << utils::system::sigabbrev_np(signum) << " = " << signum << ")";
+
+        sendDisconnect();
+
+        return Super::onSignal(signum);
+    }
+
+    void ClusterLink::onConnack(const iot::mqtt::packets::Connack& connack) {
+        if (connack.getReturnCode() == 0) {
+            mqtt::mqttbroker::lib::Cluster::instance().linkUp(peerNode, this);
+        } else {
+            LOG(ERROR) << "Cluster: Link to '" << peerNode << "' refused: " << static_cast<int>(connack.getReturnCode());
+        }
+    }
+
+} // namespace mqtt::mqttbroker
@@ -19,10 +19,10 @@
 
 #include "SharedSocketContextFactory.h"
 
+#include "SocketContext.h"
 #include "lib/JsonMappingReader.h"
 #include "mqttbroker/lib/Mqtt.h"
-
-#include <iot/mqtt/SocketContext.h>
+#include "mqttbroker/lib/RateLimiter.h"
 
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 
@@ -37,11 +37,17 @@ namespace mqtt::mqttbroker {
 
     core::socket::stream::SocketContext* SharedSocketContextFactory::create(core::socket::stream::SocketConnection* socketConnection,
                                                                             std::shared_ptr<iot::mqtt::server::broker::Broker> broker) {
-        return new iot::mqtt::SocketContext(
-            socketConnection,
-            new mqtt::mqttbroker::lib::Mqtt(
-                broker,
-                mqtt::lib::JsonMappingReader::readMappingFromFile(utils::Config::getStringOptionValue("--mqtt-mapping-file"))["mapping"]));
+        core::socket::stream::SocketContext* socketContext = nullptr;
+
+        if (lib::RateLimiter::instance().accept(socketConnection->getInstanceName(), socketConnection->getRemoteAddress().toString())) {
+            socketContext = new SocketContext(
+                socketConnection,
+                new mqtt::mqttbroker::lib::Mqtt(broker,
+                                                mqtt::lib::JsonMappingReader::readMappingFromFile(
+                                                    utils::Config::getStringOptionValue("--mqtt-mapping-file"))["mapping"]));
+        }
+
+        return socketContext;
     }
 
 } // namespace mqtt::mqttbroker
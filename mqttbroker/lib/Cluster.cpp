@@ -0,0 +1,327 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Cluster.h"
+
+#include "ShardBus.h"
+#include "SharedSubscriptions.h"
+
+#include <iot/mqtt/Mqtt.h>
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <iterator>
+#include <log/Logger.h>
+#include <openssl/crypto.h>
+#include <system_error>
+
+#endif
+
+namespace mqtt::mqttbroker::lib {
+
+    namespace {
+
+        const std::string linkClientIdPrefix = "cluster:";
+        const std::string linkUsername = "cluster";
+
+        constexpr std::size_t minSecretSize = 16;
+        const std::string summaryTopicPrefix = "$CLUSTER/";
+        const std::string filtersTopicSuffix = "/filters";
+        const std::string deltaTopicSuffix = "/delta";
+        const std::string groupsTopicSuffix = "/groups";
+        const std::string sharedTopicSuffix = "/shared";
+
+    } // namespace
+
+    Cluster& Cluster::instance() {
+        static Cluster cluster;
+
+        return cluster;
+    }
+
+    void Cluster::configure(const std::string& nodeName, double summaryDelay, const std::string& secretFile) {
+        this->summaryDelay = summaryDelay;
+
+        if (!nodeName.empty()) {
+            std::ifstream file(secretFile, std::ios::binary);
+            secret.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+            if (secret.size() >= minSecretSize) {
+                this->nodeName = nodeName;
+
+                VLOG(1) << "Cluster: Node '" << nodeName << "'";
+            } else {
+                LOG(ERROR) << "Cluster: Secret file '" << secretFile << "' missing or shorter than " << minSecretSize
+                           << " bytes - clustering disabled";
+
+                secret.clear();
+            }
+        }
+    }
+
+    bool Cluster::isEnabled() const {
+        return !nodeName.empty();
+    }
+
+    const std::string& Cluster::getNodeName() const {
+        return nodeName;
+    }
+
+    std::string Cluster::getOrigin() const {
+        return nodeName + "/" + std::to_string(ShardBus::instance().getWorker());
+    }
+
+    std::string Cluster::getLinkClientId() const {
+        return linkClientIdPrefix + getOrigin();
+    }
+
+    bool Cluster::isLinkClientId(const std::string& clientId) {
+        return clientId.starts_with(linkClientIdPrefix);
+    }
+
+    const std::string& Cluster::getLinkUsername() const {
+        return linkUsername;
+    }
+
+    const std::string& Cluster::getLinkPassword() const {
+        return secret;
+    }
+
+    // Constant time - the comparison does not tell how much of a guessed secret is right
+    bool Cluster::authenticate(const std::string& username, const std::string& password) const {
+        return isEnabled() && username == linkUsername && password.size() == secret.size() &&
+               CRYPTO_memcmp(password.data(), secret.data(), secret.size()) == 0;
+    }
+
+    // Shared subscriptions are announced by their member counts - see groupsChanged()
+    void Cluster::subscribed(const std::string& filter) {
+        if (isEnabled() && !SharedSubscriptions::isShared(filter) && filters[filter]++ == 0) {
+            changes[filter] = true;
+            scheduleDelta();
+        }
+    }
+
+    void Cluster::unsubscribed(const std::string& filter) {
+        const std::map<std::string, std::size_t>::iterator it = filters.find(filter);
+
+        if (isEnabled() && it != filters.end() && --it->second == 0) {
+            changes[it->first] = false;
+            filters.erase(it);
+            scheduleDelta();
+        }
+    }
+
+    void Cluster::groupsChanged() {
+        if (isEnabled()) {
+            groupsPending = true;
+            scheduleDelta();
+        }
+    }
+
+    void Cluster::scheduleDelta() {
+        if (!deltaTimer) {
+            deltaTimer = core::timer::Timer::singleshotTimer(
+                [this]() -> void {
+                    deltaTimer.reset();
+
+                    std::string delta;
+                    for (const auto& [filter, added] : changes) {
+                        delta += (added ? "+" : "-") + filter + "\n";
+                    }
+
+                    for (const auto& [peerNode, peer] : peers) {
+                        if (peer.link != nullptr && !changes.empty()) {
+                            peer.link->sendPublish(summaryTopicPrefix + getOrigin() + deltaTopicSuffix, delta, 1, false);
+                        }
+                        if (groupsPending) {
+                            sendGroups(peer);
+                        }
+                    }
+
+                    changes.clear();
+                    groupsPending = false;
+                },
+                summaryDelay);
+        }
+    }
+
+    void Cluster::sendFilters(const Peer& peer) const {
+        if (peer.link != nullptr) {
+            std::string list;
+            for (const auto& [filter, subscriptions] : filters) {
+                list += filter + "\n";
+            }
+
+            peer.link->sendPublish(summaryTopicPrefix + getOrigin() + filtersTopicSuffix, list, 1, false);
+        }
+    }
+
+    void Cluster::sendGroups(const Peer& peer) const {
+        if (peer.link != nullptr) {
+            peer.link->sendPublish(summaryTopicPrefix + getOrigin() + groupsTopicSuffix, SharedSubscriptions::instance().list(), 1, false);
+        }
+    }
+
+    void Cluster::linkUp(const std::string& peerNode, iot::mqtt::Mqtt* link) {
+        Peer& peer = peers[peerNode];
+        peer.link = link;
+
+        VLOG(1) << "Cluster: Link to '" << peerNode << "' up";
+
+        // The full lists - deltas pending meanwhile are contained and harmless when applied again
+        sendFilters(peer);
+        sendGroups(peer);
+    }
+
+    void Cluster::linkDown(const std::string& peerNode) {
+        const std::map<std::string, Peer>::iterator it = peers.find(peerNode);
+
+        if (it != peers.end()) {
+            it->second.link = nullptr;
+
+            VLOG(1) << "Cluster: Link to '" << peerNode << "' down";
+        }
+    }
+
+    void Cluster::linkPublish(const std::string& linkClientId, const std::string& topic, const std::string& message, uint8_t qoS) {
+        const std::string origin = linkClientId.substr(linkClientIdPrefix.size());
+        const std::string nodePrefix = summaryTopicPrefix + nodeName + "/";
+
+        if (topic == summaryTopicPrefix + origin + filtersTopicSuffix) {
+            announce(origin, true, message);
+        } else if (topic == summaryTopicPrefix + origin + deltaTopicSuffix) {
+            announce(origin, false, message);
+        } else if (topic == summaryTopicPrefix + origin + groupsTopicSuffix) {
+            SharedSubscriptions::instance().announced(origin, message);
+        } else if (topic.starts_with(nodePrefix) && topic.ends_with(sharedTopicSuffix)) {
+            // "<offset> <name size> <topic size>\n<name><topic><message>"
+            std::size_t sizes[3] = {0, 0, 0};
+
+            const char* position = message.data();
+            const char* const end = message.data() + message.size();
+
+            bool valid = true;
+            for (std::size_t& size : sizes) {
+                const std::from_chars_result parsed = std::from_chars(position, end, size);
+
+                valid = valid && parsed.ec == std::errc() && parsed.ptr != end && (*parsed.ptr == ' ' || *parsed.ptr == '\n');
+                position = valid ? parsed.ptr + 1 : end;
+            }
+
+            const std::size_t header = static_cast<std::size_t>(position - message.data());
+
+            if (valid && sizes[1] + sizes[2] <= message.size() - header) {
+                SharedSubscriptions::instance().deliver(topic.substr(summaryTopicPrefix.size(),
+                                                                     topic.size() - summaryTopicPrefix.size() - sharedTopicSuffix.size()),
+                                                        message.substr(header, sizes[1]),
+                                                        sizes[0],
+                                                        message.substr(header + sizes[1], sizes[2]),
+                                                        message.substr(header + sizes[1] + sizes[2]),
+                                                        qoS);
+            } else {
+                LOG(WARNING) << "Cluster: Ignoring a malformed shared subscription publish of '" << origin << "'";
+            }
+        }
+    }
+
+    void Cluster::linkGone(const std::string& linkClientId) {
+        const std::string origin = linkClientId.substr(linkClientIdPrefix.size());
+
+        announce(origin, true, "");
+        SharedSubscriptions::instance().announced(origin, "");
+    }
+
+    void Cluster::announce(const std::string& origin, bool full, const std::string& filters) {
+        announced(origin, full, filters);
+
+        ShardBus& shardBus = ShardBus::instance();
+        if (shardBus.isEnabled() &&
+            !shardBus.control(ShardBus::Control::ANNOUNCE, shardBus.getWorkers(), 0, origin, "", filters, full ? 1 : 0)) {
+            LOG(WARNING) << "Cluster: Relaying the filters of '" << origin << "' failed - the ring of this worker is full";
+        }
+    }
+
+    void Cluster::announced(const std::string& origin, bool full, const std::string& filters) {
+        const std::size_t slash = origin.rfind('/');
+
+        Peer& peer = peers[origin.substr(0, slash)];
+        std::set<std::string>& workerFilters = peer.workerFilters[slash != std::string::npos ? origin.substr(slash + 1) : ""];
+
+        if (full) {
+            for (const std::string& filter : workerFilters) {
+                peer.filters.erase(filter);
+            }
+            workerFilters.clear();
+        }
+
+        std::size_t begin = 0;
+        while (begin < filters.size()) {
+            const std::size_t end = std::min(filters.find('\n', begin), filters.size());
+
+            if (end > begin) {
+                const bool removed = !full && filters[begin] == '-';
+                const std::string filter = filters.substr(full ? begin : begin + 1, end - (full ? begin : begin + 1));
+
+                if (removed) {
+                    if (workerFilters.erase(filter) > 0) {
+                        peer.filters.erase(filter);
+                    }
+                } else if (!filter.empty() && workerFilters.insert(filter).second) {
+                    peer.filters.insert(filter);
+                }
+            }
+
+            begin = end + 1;
+        }
+
+        VLOG(1) << "Cluster: Filters of '" << origin << "' " << (full ? "received" : "updated") << ": " << workerFilters.size()
+                << " filters";
+    }
+
+    void Cluster::route(const std::string& topic, const std::string& message, uint8_t qoS, bool retain) {
+        for (const auto& [peerNode, peer] : peers) {
+            if (peer.link != nullptr && (retain || peer.filters.matches(topic))) {
+                peer.link->sendPublish(topic, message, qoS, retain);
+            }
+        }
+    }
+
+    void Cluster::share(const std::string& target,
+                        const std::string& name,
+                        std::size_t offset,
+                        const std::string& topic,
+                        const std::string& message,
+                        uint8_t qoS) {
+        const std::map<std::string, Peer>::const_iterator it = peers.find(target.substr(0, target.rfind('/')));
+
+        if (it != peers.end() && it->second.link != nullptr) {
+            it->second.link->sendPublish(summaryTopicPrefix + target + sharedTopicSuffix,
+                                         std::to_string(offset) + " " + std::to_string(name.size()) + " " + std::to_string(topic.size()) +
+                                             "\n" + name + topic + message,
+                                         qoS,
+                                         false);
+        } else {
+            VLOG(1) << "Cluster: Publish on '" << topic << "' for '" << target << "' lost - no link";
+        }
+    }
+
+} // namespace mqtt::mqttbroker::lib
@@ -0,0 +1,137 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MQTTBROKER_LIB_CLUSTER_H
+#define MQTTBROKER_LIB_CLUSTER_H
+
+#include "TopicFilterTrie.h"
+
+namespace iot::mqtt {
+    class Mqtt;
+} // namespace iot::mqtt
+
+#include <core/timer/Timer.h>
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+
+#endif
+
+namespace mqtt::mqttbroker::lib {
+
+    /* Subscription aware clustering of mqttbroker nodes.
+     *
+     * Each worker of a node keeps one outbound MQTT link per peer node (client id "cluster:<node>/<worker>"), thus a node with W
+     * workers and P peers holds W * P outbound links - each worker routes its own publishes without a further hop over the
+     * ShardBus. A link authenticates with the secret shared by all nodes as password of its CONNECT, a connection with a link
+     * client id and without the secret is closed before it touches any session. Over this link it
+     * announces the topic filters its local clients are subscribed to: the full list on "$CLUSTER/<node>/<worker>/filters" when
+     * the link comes up, afterwards only the changes on "$CLUSTER/<node>/<worker>/delta" ("+<filter>" or "-<filter>" per line,
+     * debounced). The worker of the peer receiving an announcement relays it to its sibling workers over the ShardBus, thus every
+     * worker knows the filters of all workers of all peers and forwards those publishes which match them over its own link.
+     * Shared subscriptions are not routed by filter. Their member counts are announced on "$CLUSTER/<node>/<worker>/groups" (the
+     * full list, debounced) and a publish placed on a member of a peer is sent to it on "$CLUSTER/<node>/<worker>/shared" of the
+     * worker of the member - see SharedSubscriptions.
+     * Retained publishes are forwarded to all peers to keep their retained stores complete. Publishes received over a cluster
+     * link are delivered locally only, thus never travel more than one hop. */
+    class Cluster {
+    private:
+        Cluster() = default;
+
+    public:
+        Cluster(const Cluster&) = delete;
+        Cluster& operator=(const Cluster&) = delete;
+
+        static Cluster& instance();
+
+        // The secret authenticates the links of the peers - clustering stays disabled without one
+        void configure(const std::string& nodeName, double summaryDelay, const std::string& secretFile);
+        bool isEnabled() const;
+
+        const std::string& getNodeName() const;
+        std::string getOrigin() const; // "<node>/<worker>"
+        std::string getLinkClientId() const;
+        static bool isLinkClientId(const std::string& clientId);
+
+        // Credentials of the CONNECT of an outbound link, checked for each inbound one
+        const std::string& getLinkUsername() const;
+        const std::string& getLinkPassword() const;
+        bool authenticate(const std::string& username, const std::string& password) const;
+
+        // Local client subscriptions - link clients excluded, shared subscriptions ignored
+        void subscribed(const std::string& filter);
+        void unsubscribed(const std::string& filter);
+
+        // The members of the shared subscriptions of this worker have changed
+        void groupsChanged();
+
+        // Outbound links
+        void linkUp(const std::string& peerNode, iot::mqtt::Mqtt* link);
+        void linkDown(const std::string& peerNode);
+
+        // Inbound link sessions of peers
+        void linkPublish(const std::string& linkClientId, const std::string& topic, const std::string& message, uint8_t qoS);
+        void linkGone(const std::string& linkClientId);
+
+        // Announcement of a worker "<node>/<worker>" of a peer relayed by a sibling worker
+        void announced(const std::string& origin, bool full, const std::string& filters);
+
+        void route(const std::string& topic, const std::string& message, uint8_t qoS, bool retain);
+        // A publish placed on the member at offset of a shared subscription on worker "<node>/<worker>" target of a peer
+        void share(const std::string& target,
+                   const std::string& name,
+                   std::size_t offset,
+                   const std::string& topic,
+                   const std::string& message,
+                   uint8_t qoS);
+
+    private:
+        struct Peer {
+            iot::mqtt::Mqtt* link = nullptr;
+            std::map<std::string, std::set<std::string>> workerFilters; // worker of the peer -> announced filters
+            TopicFilterTrie filters;                                    // of all its workers
+        };
+
+        void announce(const std::string& origin, bool full, const std::string& filters); // and relay to the sibling workers
+
+        void scheduleDelta();
+        void sendFilters(const Peer& peer) const;
+        void sendGroups(const Peer& peer) const;
+
+        std::string nodeName;
+        std::string secret;
+        double summaryDelay = 0.5;
+
+        std::map<std::string, Peer> peers;
+        std::map<std::string, std::size_t> filters; // local topic filter -> number of local subscriptions
+        std::map<std::string, bool> changes;        // local topic filter -> added (true) or removed since the last delta
+        bool groupsPending = false;                 // shared subscription members changed since the last announcement
+
+        std::optional<core::timer::Timer> deltaTimer;
+    };
+
+} // namespace mqtt::mqttbroker::lib
+
+#endif // MQTTBROKER_LIB_CLUSTER_H
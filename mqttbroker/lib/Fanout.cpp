@@ -0,0 +1,81 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Fanout.h"
+
+#include "Cluster.h"
+#include "Metrics.h"
+#include "OfflineQueue.h"
+#include "RetainedStore.h"
+#include "ShardBus.h"
+#include "SharedSubscriptions.h"
+
+#include <iot/mqtt/server/broker/Broker.h>
+
+#ifndef SUBSCRIBTION_MAX_QOS
+#define SUBSCRIBTION_MAX_QOS 2
+#endif
+
+namespace mqtt::mqttbroker::lib {
+
+    Fanout::Fanout()
+        : broker(iot::mqtt::server::broker::Broker::instance(SUBSCRIBTION_MAX_QOS)) {
+    }
+
+    Fanout& Fanout::instance() {
+        static Fanout fanout;
+
+        return fanout;
+    }
+
+    void Fanout::publish(
+        Origin origin, const std::string& clientId, const std::string& topic, const std::string& message, uint8_t qoS, bool retain) {
+        Metrics& metrics = Metrics::instance();
+
+        // The local broker has delivered client and cluster link publishes since the last mark, all others are delivered from here
+        if (origin == Origin::MAPPING || origin == Origin::WORKER) {
+            metrics.fanoutMark();
+        }
+
+        // The broker has retained client and cluster link publishes already - all others are retained by the store alone if possible
+        const bool brokerRetain =
+            retain && RetainedStore::instance().retain(topic, message, qoS, origin == Origin::CLIENT || origin == Origin::CLUSTER);
+
+        if (origin == Origin::MAPPING || origin == Origin::WORKER) {
+            broker->publish(clientId, topic, message, qoS, brokerRetain);
+        }
+
+        if (origin != Origin::WORKER) {
+            ShardBus::instance().forward(topic, message, qoS, retain);
+        }
+
+        OfflineQueue::instance().publish(topic, message, qoS);
+
+        // Shared subscriptions of all workers and nodes are served by the worker a publish enters the broker at
+        if (origin == Origin::CLIENT || origin == Origin::MAPPING) {
+            SharedSubscriptions::instance().publish(topic, message, qoS);
+            Cluster::instance().route(topic, message, qoS, retain);
+        } else if (origin == Origin::CLUSTER) {
+            Cluster::instance().linkPublish(clientId, topic, message, qoS);
+        }
+
+        metrics.fanoutObserve();
+    }
+
+} // namespace mqtt::mqttbroker::lib
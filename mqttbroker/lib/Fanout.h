@@ -0,0 +1,70 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MQTTBROKER_LIB_FANOUT_H
+#define MQTTBROKER_LIB_FANOUT_H
+
+namespace iot::mqtt::server::broker {
+    class Broker;
+} // namespace iot::mqtt::server::broker
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#endif
+
+namespace mqtt::mqttbroker::lib {
+
+    /* Hands a publish on to everything delivering it beyond the subscriptions of the local broker: the other workers, the
+     * offline queues, the shared subscriptions, the retained store and the peer nodes. The origin of the publish tells which of
+     * them have seen it already. */
+    class Fanout {
+    private:
+        Fanout();
+
+    public:
+        enum class Origin : uint8_t {
+            CLIENT,  // received from a client - the local broker has delivered it
+            MAPPING, // produced by a mapping - not yet known to the local broker
+            WORKER,  // forwarded by another worker, which has forwarded it to the peer nodes
+            CLUSTER  // received over the cluster link of a peer node, which has routed it already
+        };
+
+        Fanout(const Fanout&) = delete;
+        Fanout& operator=(const Fanout&) = delete;
+
+        static Fanout& instance();
+
+        void publish(Origin origin,
+                     const std::string& clientId,
+                     const std::string& topic,
+                     const std::string& message,
+                     uint8_t qoS,
+                     bool retain);
+
+    private:
+        std::shared_ptr<iot::mqtt::server::broker::Broker> broker;
+    };
+
+} // namespace mqtt::mqttbroker::lib
+
+#endif // MQTTBROKER_LIB_FANOUT_H
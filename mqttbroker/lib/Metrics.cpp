@@ -0,0 +1,494 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Metrics.h"
+
+#include "ShardBus.h"
+#include "TlsSessionCache.h"
+#include "ktls/KernelTls.h"
+#include "lib/LoopMonitor.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <cstdio>
+
+#endif
+
+namespace mqtt::mqttbroker::lib {
+
+    namespace {
+
+        // Indexed by the MQTT control packet type
+        const char* const packetNames[] = {"reserved",
+                                           "connect",
+                                           "connack",
+                                           "publish",
+                                           "puback",
+                                           "pubrec",
+                                           "pubrel",
+                                           "pubcomp",
+                                           "subscribe",
+                                           "suback",
+                                           "unsubscribe",
+                                           "unsuback",
+                                           "pingreq",
+                                           "pingresp",
+                                           "disconnect"};
+
+        // The packet types a broker receives from and sends to its clients
+        constexpr std::array receivedPackets{Metrics::Packet::CONNECT,
+                                             Metrics::Packet::PUBLISH,
+                                             Metrics::Packet::PUBACK,
+                                             Metrics::Packet::PUBREC,
+                                             Metrics::Packet::PUBREL,
+                                             Metrics::Packet::PUBCOMP,
+                                             Metrics::Packet::SUBSCRIBE,
+                                             Metrics::Packet::UNSUBSCRIBE,
+                                             Metrics::Packet::PINGREQ,
+                                             Metrics::Packet::DISCONNECT};
+        constexpr std::array sentPackets{Metrics::Packet::CONNACK,
+                                         Metrics::Packet::PUBLISH,
+                                         Metrics::Packet::PUBACK,
+                                         Metrics::Packet::PUBREC,
+                                         Metrics::Packet::PUBREL,
+                                         Metrics::Packet::PUBCOMP,
+                                         Metrics::Packet::SUBACK,
+                                         Metrics::Packet::UNSUBACK,
+                                         Metrics::Packet::PINGRESP};
+
+        void appendNumber(std::string& exposition, double value) {
+            char buffer[32];
+            const int length = std::snprintf(buffer, sizeof(buffer), "%.9g", value);
+
+            exposition.append(buffer, static_cast<std::size_t>(length));
+        }
+
+        void appendType(std::string& exposition, const std::string& name, const char* type, const std::string& help) {
+            exposition += "# TYPE " + name + " " + type + "\n# HELP " + name + " " + help + "\n";
+        }
+
+        // worker: the label of the worker process, empty without workers
+        void appendSample(
+            std::string& exposition, const std::string& worker, const std::string& name, const std::string& labels, double value) {
+            exposition += name;
+            if (!worker.empty() || !labels.empty()) {
+                exposition += "{" + worker + (!worker.empty() && !labels.empty() ? "," : "") + labels + "}";
+            }
+            exposition += " ";
+            appendNumber(exposition, value);
+            exposition += "\n";
+        }
+
+    } // namespace
+
+    Metrics::Histogram::Histogram(const std::array<double, buckets>& bounds)
+        : bounds(bounds) {
+    }
+
+    void Metrics::Histogram::observe(double value) {
+        std::size_t bucket = 0;
+        while (bucket < buckets && value > bounds[bucket]) {
+            ++bucket;
+        }
+
+        counts[bucket].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    void Metrics::Histogram::expose(std::string& exposition,
+                                    const std::string& worker,
+                                    const std::string& name,
+                                    const std::string& help) const {
+        appendType(exposition, name, "histogram", help);
+
+        uint64_t cumulative = 0;
+        for (std::size_t bucket = 0; bucket < buckets; ++bucket) {
+            cumulative += counts[bucket].load(std::memory_order_relaxed);
+
+            std::string le;
+            appendNumber(le, bounds[bucket]);
+            appendSample(exposition, worker, name + "_bucket", "le=\"" + le + "\"", static_cast<double>(cumulative));
+        }
+        cumulative += counts[buckets].load(std::memory_order_relaxed);
+
+        appendSample(exposition, worker, name + "_bucket", "le=\"+Inf\"", static_cast<double>(cumulative));
+        appendSample(exposition, worker, name + "_count", "", static_cast<double>(count.load(std::memory_order_relaxed)));
+        appendSample(exposition, worker, name + "_sum", "", sum.load(std::memory_order_relaxed));
+    }
+
+    Metrics::Metrics()
+        : mappingFanoutHistogram({0, 1, 2, 3, 5, 8, 13, 21, 34, 55})
+        , deliveryFanoutHistogram({0, 1, 2, 5, 10, 50, 100, 500, 1000, 10000}) {
+    }
+
+    Metrics& Metrics::instance() {
+        static Metrics metrics;
+
+        return metrics;
+    }
+
+    Metrics::Listener* Metrics::listener(const std::string& instanceName) {
+        return &listeners[instanceName];
+    }
+
+    void Metrics::packetReceived(Packet packet) {
+        packetsReceived[static_cast<std::size_t>(packet)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void Metrics::packetSent(Packet packet, std::size_t size) {
+        packetsSent[static_cast<std::size_t>(packet)].fetch_add(1, std::memory_order_relaxed);
+        packetBytesSent[static_cast<std::size_t>(packet)].fetch_add(size, std::memory_order_relaxed);
+    }
+
+    void Metrics::publishReceived(const std::string& topic, std::size_t payloadSize, bool retain) {
+        packetReceived(Packet::PUBLISH);
+        publishBytesReceived.fetch_add(payloadSize, std::memory_order_relaxed);
+
+        retained(topic, payloadSize, retain);
+    }
+
+    void Metrics::mappingPublished(const std::string& topic, std::size_t payloadSize, bool retain) {
+        mappingsPublished.fetch_add(1, std::memory_order_relaxed);
+        mappingBytesPublished.fetch_add(payloadSize, std::memory_order_relaxed);
+
+        retained(topic, payloadSize, retain);
+    }
+
+    void Metrics::retained(const std::string& topic, std::size_t payloadSize, bool retain) {
+        if (retain) {
+            if (payloadSize > 0) {
+                retainedTopics.insert(topic);
+            } else {
+                retainedTopics.erase(topic);
+            }
+        }
+    }
+
+    void Metrics::mappingFanout(std::size_t published) {
+        mappingFanoutHistogram.observe(static_cast<double>(published));
+    }
+
+    void Metrics::fanoutMark() {
+        fanoutMarked = getPacketsSent(Packet::PUBLISH);
+    }
+
+    void Metrics::fanoutObserve() {
+        const uint64_t published = getPacketsSent(Packet::PUBLISH);
+
+        deliveryFanoutHistogram.observe(static_cast<double>(published - fanoutMarked));
+        fanoutMarked = published;
+    }
+
+    void Metrics::traffic(std::size_t bytesReceived, std::size_t bytesSent) {
+        this->bytesReceived.fetch_add(bytesReceived, std::memory_order_relaxed);
+        this->bytesSent.fetch_add(bytesSent, std::memory_order_relaxed);
+    }
+
+    void Metrics::tlsHandshake(const std::string& instanceName, bool resumed) {
+        Listener& listener = listeners[instanceName];
+
+        listener.tlsHandshakes.fetch_add(1, std::memory_order_relaxed);
+        if (resumed) {
+            listener.tlsResumed.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void Metrics::session(const std::string& clientId, bool cleanSession) {
+        if (cleanSession) {
+            persistentSessions.erase(clientId);
+        } else {
+            persistentSessions.insert(clientId);
+        }
+    }
+
+    bool Metrics::subscribe(const std::string& clientId, const std::string& topic, uint8_t qoS) {
+        const bool inserted = subscriptions[clientId].insert_or_assign(topic, qoS).second;
+
+        if (inserted) {
+            ++subscriptionCount;
+        }
+
+        return inserted;
+    }
+
+    bool Metrics::unsubscribe(const std::string& clientId, const std::string& topic) {
+        bool erased = false;
+
+        const std::unordered_map<std::string, std::unordered_map<std::string, uint8_t>>::iterator it = subscriptions.find(clientId);
+        if (it != subscriptions.end()) {
+            erased = it->second.erase(topic) > 0;
+
+            if (erased) {
+                --subscriptionCount;
+            }
+            if (it->second.empty()) {
+                subscriptions.erase(it);
+            }
+        }
+
+        return erased;
+    }
+
+    std::unordered_set<std::string> Metrics::clearSubscriptions(const std::string& clientId) {
+        std::unordered_set<std::string> cleared;
+
+        const std::unordered_map<std::string, std::unordered_map<std::string, uint8_t>>::iterator it = subscriptions.find(clientId);
+        if (it != subscriptions.end()) {
+            subscriptionCount -= it->second.size();
+
+            for (const auto& [topic, qoS] : it->second) {
+                cleared.insert(topic);
+            }
+            subscriptions.erase(it);
+        }
+
+        return cleared;
+    }
+
+    std::size_t Metrics::countSubscriptions(const std::string& clientId, const std::string& prefix) const {
+        std::size_t count = 0;
+
+        const std::unordered_map<std::string, std::unordered_map<std::string, uint8_t>>::const_iterator it = subscriptions.find(clientId);
+        if (it != subscriptions.end()) {
+            for (const auto& [topic, qoS] : it->second) {
+                if (topic.starts_with(prefix)) {
+                    ++count;
+                }
+            }
+        }
+
+        return count;
+    }
+
+    std::unordered_map<std::string, uint8_t> Metrics::getSubscriptions(const std::string& clientId) const {
+        const std::unordered_map<std::string, std::unordered_map<std::string, uint8_t>>::const_iterator it = subscriptions.find(clientId);
+
+        return it != subscriptions.end() ? it->second : std::unordered_map<std::string, uint8_t>();
+    }
+
+    uint64_t Metrics::getPacketsReceived(Packet packet) const {
+        return packetsReceived[static_cast<std::size_t>(packet)].load(std::memory_order_relaxed);
+    }
+
+    uint64_t Metrics::getPacketsReceived() const {
+        uint64_t packets = 0;
+
+        for (const std::atomic<uint64_t>& count : packetsReceived) {
+            packets += count.load(std::memory_order_relaxed);
+        }
+
+        return packets;
+    }
+
+    uint64_t Metrics::getPacketsSent(Packet packet) const {
+        return packetsSent[static_cast<std::size_t>(packet)].load(std::memory_order_relaxed);
+    }
+
+    uint64_t Metrics::getPacketsSent() const {
+        uint64_t packets = 0;
+
+        for (const std::atomic<uint64_t>& count : packetsSent) {
+            packets += count.load(std::memory_order_relaxed);
+        }
+
+        return packets;
+    }
+
+    uint64_t Metrics::getBytesReceived() const {
+        return bytesReceived.load(std::memory_order_relaxed);
+    }
+
+    uint64_t Metrics::getBytesSent() const {
+        return bytesSent.load(std::memory_order_relaxed);
+    }
+
+    uint64_t Metrics::getMappingsPublished() const {
+        return mappingsPublished.load(std::memory_order_relaxed);
+    }
+
+    int64_t Metrics::getConnectedClients() const {
+        int64_t connected = 0;
+
+        for (const auto& [instanceName, listener] : listeners) {
+            connected += listener.connected.load(std::memory_order_relaxed);
+        }
+
+        return connected;
+    }
+
+    std::size_t Metrics::getRetainedCount() const {
+        return retainedTopics.size();
+    }
+
+    std::size_t Metrics::getSessionCount() const {
+        return persistentSessions.size();
+    }
+
+    std::size_t Metrics::getSubscriptionCount() const {
+        return subscriptionCount;
+    }
+
+    std::string Metrics::expose() const {
+        std::string exposition;
+        exposition.reserve(4096);
+
+        // Each worker serves its own metrics - labelled to tell them apart when aggregated
+        const ShardBus& shardBus = ShardBus::instance();
+        const std::string worker = shardBus.isEnabled() ? "worker=\"" + std::to_string(shardBus.getWorker()) + "\"" : "";
+
+        appendType(exposition, "mqttbroker_clients_connected", "gauge", "Currently connected clients per listener instance");
+        for (const auto& [instanceName, listener] : listeners) {
+            appendSample(exposition, worker,
+                         "mqttbroker_clients_connected",
+                         "listener=\"" + instanceName + "\"",
+                         static_cast<double>(listener.connected.load(std::memory_order_relaxed)));
+        }
+
+        appendType(exposition, "mqttbroker_connections", "counter", "Accepted MQTT connections per listener instance");
+        for (const auto& [instanceName, listener] : listeners) {
+            appendSample(exposition, worker,
+                         "mqttbroker_connections_total",
+                         "listener=\"" + instanceName + "\"",
+                         static_cast<double>(listener.connections.load(std::memory_order_relaxed)));
+        }
+
+        // Resumed handshakes hit the session cache or a session ticket, the others are full handshakes
+        appendType(exposition, "mqttbroker_tls_handshakes", "counter", "Completed TLS handshakes per listener instance");
+        for (const auto& [instanceName, listener] : listeners) {
+            const uint64_t handshakes = listener.tlsHandshakes.load(std::memory_order_relaxed);
+
+            if (handshakes > 0) {
+                const uint64_t resumed = listener.tlsResumed.load(std::memory_order_relaxed);
+
+                appendSample(exposition, worker,
+                             "mqttbroker_tls_handshakes_total",
+                             "listener=\"" + instanceName + "\",resumed=\"true\"",
+                             static_cast<double>(resumed));
+                appendSample(exposition, worker,
+                             "mqttbroker_tls_handshakes_total",
+                             "listener=\"" + instanceName + "\",resumed=\"false\"",
+                             static_cast<double>(handshakes - resumed));
+            }
+        }
+
+        appendType(exposition, "mqttbroker_tls_ktls_connections", "counter", "TLS connections offloaded to kernel TLS per direction");
+        for (const auto& [instanceName, instance] : mqtt::ktls::KernelTls::instance().getInstances()) {
+            if (instance.enabled) {
+                appendSample(exposition, worker,
+                             "mqttbroker_tls_ktls_connections_total",
+                             "listener=\"" + instanceName + "\",direction=\"send\"",
+                             static_cast<double>(instance.send));
+                appendSample(exposition, worker,
+                             "mqttbroker_tls_ktls_connections_total",
+                             "listener=\"" + instanceName + "\",direction=\"receive\"",
+                             static_cast<double>(instance.receive));
+            }
+        }
+
+        appendType(exposition, "mqttbroker_tls_sessions_cached", "gauge", "Sessions in the TLS session cache per listener instance");
+        for (const auto& [instanceName, cached] : TlsSessionCache::instance().getCachedSessions()) {
+            appendSample(
+                exposition, worker, "mqttbroker_tls_sessions_cached", "listener=\"" + instanceName + "\"", static_cast<double>(cached));
+        }
+
+        appendType(exposition, "mqttbroker_packets_received", "counter", "MQTT control packets received by type");
+        for (const Packet packet : receivedPackets) {
+            appendSample(exposition, worker,
+                         "mqttbroker_packets_received_total",
+                         std::string("type=\"") + packetNames[static_cast<std::size_t>(packet)] + "\"",
+                         static_cast<double>(getPacketsReceived(packet)));
+        }
+
+        appendType(exposition, "mqttbroker_packets_sent", "counter", "MQTT control packets sent by type");
+        for (const Packet packet : sentPackets) {
+            appendSample(exposition, worker,
+                         "mqttbroker_packets_sent_total",
+                         std::string("type=\"") + packetNames[static_cast<std::size_t>(packet)] + "\"",
+                         static_cast<double>(getPacketsSent(packet)));
+        }
+
+        appendType(exposition, "mqttbroker_packet_bytes_sent", "counter", "Bytes of the MQTT control packets sent by type");
+        for (const Packet packet : sentPackets) {
+            appendSample(exposition, worker,
+                         "mqttbroker_packet_bytes_sent_total",
+                         std::string("type=\"") + packetNames[static_cast<std::size_t>(packet)] + "\"",
+                         static_cast<double>(packetBytesSent[static_cast<std::size_t>(packet)].load(std::memory_order_relaxed)));
+        }
+
+        appendType(exposition, "mqttbroker_bytes_received", "counter", "Bytes received on MQTT connections");
+        appendSample(exposition, worker, "mqttbroker_bytes_received_total", "", static_cast<double>(getBytesReceived()));
+
+        appendType(exposition, "mqttbroker_bytes_sent", "counter", "Bytes sent on MQTT connections");
+        appendSample(exposition, worker, "mqttbroker_bytes_sent_total", "", static_cast<double>(getBytesSent()));
+
+        appendType(exposition, "mqttbroker_publish_payload_bytes_received", "counter", "Payload bytes of received PUBLISH packets");
+        appendSample(exposition, worker,
+                     "mqttbroker_publish_payload_bytes_received_total",
+                     "",
+                     static_cast<double>(publishBytesReceived.load(std::memory_order_relaxed)));
+
+        appendType(exposition, "mqttbroker_mapping_published", "counter", "Messages published by the mapping");
+        appendSample(exposition, worker, "mqttbroker_mapping_published_total", "", static_cast<double>(getMappingsPublished()));
+
+        appendType(exposition, "mqttbroker_mapping_payload_bytes_published", "counter", "Payload bytes published by the mapping");
+        appendSample(exposition, worker,
+                     "mqttbroker_mapping_payload_bytes_published_total",
+                     "",
+                     static_cast<double>(mappingBytesPublished.load(std::memory_order_relaxed)));
+
+        mappingFanoutHistogram.expose(
+            exposition, worker, "mqttbroker_mapping_fanout", "Messages published by the mapping per received PUBLISH");
+        deliveryFanoutHistogram.expose(
+            exposition, worker, "mqttbroker_delivery_fanout", "PUBLISH packets sent to clients per published message");
+
+        appendType(exposition, "mqttbroker_retained_messages", "gauge", "Retained messages");
+        appendSample(exposition, worker, "mqttbroker_retained_messages", "", static_cast<double>(getRetainedCount()));
+
+        appendType(exposition, "mqttbroker_sessions_persistent", "gauge", "Persistent (clean session = false) sessions");
+        appendSample(exposition, worker, "mqttbroker_sessions_persistent", "", static_cast<double>(getSessionCount()));
+
+        appendType(exposition, "mqttbroker_subscriptions", "gauge", "Topic filters subscribed by all sessions");
+        appendSample(exposition, worker, "mqttbroker_subscriptions", "", static_cast<double>(getSubscriptionCount()));
+
+        // The event loop lag is measured by the LoopMonitor probe - exposed here instead of probing the loop a second time
+        const mqtt::lib::LoopMonitor& loopMonitor = mqtt::lib::LoopMonitor::instance();
+        appendType(exposition, "mqttbroker_event_loop_lag_seconds", "histogram", "Delay of event loop iterations beyond schedule");
+
+        uint64_t cumulative = 0;
+        for (std::size_t bucket = 0; bucket < mqtt::lib::LoopMonitor::lagBounds.size(); ++bucket) {
+            cumulative += loopMonitor.getLagCounts()[bucket];
+
+            std::string le;
+            appendNumber(le, mqtt::lib::LoopMonitor::lagBounds[bucket]);
+            appendSample(
+                exposition, worker, "mqttbroker_event_loop_lag_seconds_bucket", "le=\"" + le + "\"", static_cast<double>(cumulative));
+        }
+        cumulative += loopMonitor.getLagCounts().back();
+
+        appendSample(exposition, worker, "mqttbroker_event_loop_lag_seconds_bucket", "le=\"+Inf\"", static_cast<double>(cumulative));
+        appendSample(exposition, worker, "mqttbroker_event_loop_lag_seconds_count", "", static_cast<double>(cumulative));
+        appendSample(exposition, worker, "mqttbroker_event_loop_lag_seconds_sum", "", loopMonitor.getLagSum());
+
+        exposition += "# EOF\n";
+
+        return exposition;
+    }
+
+} // namespace mqtt::mqttbroker::lib
@@ -0,0 +1,155 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MQTTBROKER_LIB_METRICS_H
+#define MQTTBROKER_LIB_METRICS_H
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#endif
+
+namespace mqtt::mqttbroker::lib {
+
+    /* Numeric telemetry of the broker. All counters are relaxed atomic increments. Everything a scrape reports is maintained
+     * incrementally, thus producing the exposition is O(number of metrics) and independent of the number of clients. */
+    class Metrics {
+    public:
+        // The values are the MQTT control packet types
+        enum class Packet : uint8_t {
+            CONNECT = 1,
+            CONNACK,
+            PUBLISH,
+            PUBACK,
+            PUBREC,
+            PUBREL,
+            PUBCOMP,
+            SUBSCRIBE,
+            SUBACK,
+            UNSUBSCRIBE,
+            UNSUBACK,
+            PINGREQ,
+            PINGRESP,
+            DISCONNECT,
+            COUNT
+        };
+
+        struct Listener {
+            std::atomic<int64_t> connected = 0;
+            std::atomic<uint64_t> connections = 0;
+            std::atomic<uint64_t> tlsHandshakes = 0;
+            std::atomic<uint64_t> tlsResumed = 0;
+        };
+
+        class Histogram {
+        public:
+            static constexpr std::size_t buckets = 10;
+
+            explicit Histogram(const std::array<double, buckets>& bounds);
+
+            void observe(double value);
+
+            void expose(std::string& exposition, const std::string& worker, const std::string& name, const std::string& help) const;
+
+        private:
+            std::array<double, buckets> bounds;
+            std::array<std::atomic<uint64_t>, buckets + 1> counts{}; // last bucket is +Inf
+            std::atomic<uint64_t> count = 0;
+            std::atomic<double> sum = 0;
+        };
+
+    private:
+        Metrics();
+
+    public:
+        Metrics(const Metrics&) = delete;
+        Metrics& operator=(const Metrics&) = delete;
+
+        static Metrics& instance();
+
+        Listener* listener(const std::string& instanceName);
+
+        void packetReceived(Packet packet);
+        void packetSent(Packet packet, std::size_t size);
+        void publishReceived(const std::string& topic, std::size_t payloadSize, bool retain);
+        void mappingPublished(const std::string& topic, std::size_t payloadSize, bool retain);
+        void mappingFanout(std::size_t published);
+
+        // The delivery fan-out of a message is the number of PUBLISH packets sent between fanoutMark() and fanoutObserve()
+        void fanoutMark();
+        void fanoutObserve();
+        void traffic(std::size_t bytesReceived, std::size_t bytesSent);
+        void tlsHandshake(const std::string& instanceName, bool resumed);
+        void session(const std::string& clientId, bool cleanSession);
+
+        bool subscribe(const std::string& clientId, const std::string& topic, uint8_t qoS); // true if the subscription is new
+        bool unsubscribe(const std::string& clientId, const std::string& topic);           // true if the subscription existed
+        std::unordered_set<std::string> clearSubscriptions(const std::string& clientId); // returns the cleared topic filters
+        std::size_t countSubscriptions(const std::string& clientId, const std::string& prefix) const;
+        std::unordered_map<std::string, uint8_t> getSubscriptions(const std::string& clientId) const; // topic filter -> qos
+
+        std::string expose() const;
+
+        uint64_t getPacketsReceived(Packet packet) const;
+        uint64_t getPacketsReceived() const; // all types
+        uint64_t getPacketsSent(Packet packet) const;
+        uint64_t getPacketsSent() const; // all types
+        uint64_t getBytesReceived() const;
+        uint64_t getBytesSent() const;
+        uint64_t getMappingsPublished() const;
+        int64_t getConnectedClients() const;
+        std::size_t getRetainedCount() const;
+        std::size_t getSessionCount() const;
+        std::size_t getSubscriptionCount() const;
+
+    private:
+        void retained(const std::string& topic, std::size_t payloadSize, bool retain);
+
+        std::map<std::string, Listener> listeners; // node based - Listener* handed out stay valid
+
+        std::array<std::atomic<uint64_t>, static_cast<std::size_t>(Packet::COUNT)> packetsReceived{};
+        std::array<std::atomic<uint64_t>, static_cast<std::size_t>(Packet::COUNT)> packetsSent{};
+        std::array<std::atomic<uint64_t>, static_cast<std::size_t>(Packet::COUNT)> packetBytesSent{};
+        uint64_t fanoutMarked = 0; // PUBLISH packets sent at the last mark
+        std::atomic<uint64_t> publishBytesReceived = 0;
+        std::atomic<uint64_t> bytesReceived = 0;
+        std::atomic<uint64_t> bytesSent = 0;
+        std::atomic<uint64_t> mappingsPublished = 0;
+        std::atomic<uint64_t> mappingBytesPublished = 0;
+
+        std::unordered_set<std::string> retainedTopics;
+        std::unordered_set<std::string> persistentSessions;
+        std::unordered_map<std::string, std::unordered_map<std::string, uint8_t>> subscriptions; // client id -> topic filter -> qos
+        std::size_t subscriptionCount = 0;
+
+        Histogram mappingFanoutHistogram;
+        Histogram deliveryFanoutHistogram;
+    };
+
+} // namespace mqtt::mqttbroker::lib
+
+#endif // MQTTBROKER_LIB_METRICS_H
@@ -19,42 +19,510 @@
 
 #include "Mqtt.h"
 
-#include "mqttbroker/lib/MqttModel.h"
+#include "Cluster.h"
+#include "Fanout.h"
+#include "MqttModel.h"
+#include "OfflineQueue.h"
+#include "OutboundLimiter.h"
+#include "RetainedStore.h"
+#include "SessionHandover.h"
+#include "SessionJournal.h"
+#include "SharedSubscriptions.h"
+#include "SysPublisher.h"
+#include "lib/LoopMonitor.h"
 
+#include <iot/mqtt/Topic.h>
+#include <iot/mqtt/packets/Connect.h>
 #include <iot/mqtt/packets/Publish.h>
+#include <iot/mqtt/packets/Subscribe.h>
+#include <iot/mqtt/packets/Unsubscribe.h>
 #include <iot/mqtt/server/broker/Broker.h>
 
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 
+#include <algorithm>
 #include <log/Logger.h>
+#include <utility>
 
 #endif
 
 namespace mqtt::mqttbroker::lib {
 
+    // Outbound bytes not yet written to the socket above which queued offline messages are held back
+    constexpr std::size_t offlineQueueBacklog = 256 * 1024;
+
+    // Publishes held back by the rate limits before QoS 0 ones are dropped and QoS 1 and 2 ones close the connection, and the
+    // retry interval
+    constexpr std::size_t maxDelayedPublishes = 1024;
+    constexpr double delayInterval = 0.01;
+
     Mqtt::Mqtt(const std::shared_ptr<iot::mqtt::server::broker::Broker>& broker, const nlohmann::json& mappingJson)
         : iot::mqtt::server::Mqtt(broker)
         , mqtt::lib::MqttMapper(mappingJson) {
+        SysPublisher::instance().setBroker(broker);
     }
 
     void Mqtt::onConnect(const iot::mqtt::packets::Connect& connect) {
-        VLOG(1) << "MQTT: Connected";
-        MqttModel::instance().addConnectedClient(this, connect);
+        clusterLink = Cluster::isLinkClientId(connect.getClientId());
+
+        // Refused before it is counted or claims a session - a forged link could take the session of the real one over
+        if (clusterLink && !Cluster::instance().authenticate(connect.getUsername(), connect.getPassword())) {
+            LOG(WARNING) << "MQTT: Refusing cluster link '" << connect.getClientId() << "' from "
+                         << getSocketConnection()->getRemoteAddress().toString() << " - authentication failed";
+
+            getSocketConnection()->close();
+        } else {
+            VLOG(1) << "MQTT: Connected";
+            MqttModel::instance().addConnectedClient(this, connect);
+
+            Metrics& metrics = Metrics::instance();
+
+            listener = metrics.listener(getSocketConnection()->getInstanceName());
+            rateListener = RateLimiter::instance().listener(getSocketConnection()->getInstanceName());
+            listener->connected.fetch_add(1, std::memory_order_relaxed);
+            listener->connections.fetch_add(1, std::memory_order_relaxed);
+
+            metrics.packetReceived(Metrics::Packet::CONNECT);
+            metrics.session(connect.getClientId(), connect.getCleanSession());
+
+            cleanSession = connect.getCleanSession();
+            epoch = SessionHandover::instance().claim(connect.getClientId(), cleanSession);
+
+            if (cleanSession) {
+                clearSubscriptions(connect.getClientId());
+                SessionJournal::instance().cleared(connect.getClientId());
+                OfflineQueue::instance().cleared(connect.getClientId());
+            } else if (!clusterLink) {
+                resumeOfflineQueue();
+            }
+
+            // Subscriptions of a resumed session are active again without a SUBSCRIBE packet
+            sysSubscriptions = metrics.countSubscriptions(connect.getClientId(), "$SYS");
+            SysPublisher::instance().subscribed(sysSubscriptions);
+        }
+
+        sampleTraffic();
     }
 
     void Mqtt::onPublish(const iot::mqtt::packets::Publish& publish) {
-        publishMappings(publish);
+        const mqtt::lib::LoopMonitor::Probe probe("socket read: mqtt publish");
+
+        Metrics::instance().publishReceived(publish.getTopic(), publish.getMessage().size(), publish.getRetain());
+
+        if (admitPublish(publish)) {
+            processPublish(publish.getTopic(), publish.getMessage(), publish.getQoS(), publish.getRetain(), publish.getPacketIdentifier());
+        }
+
+        sampleTraffic();
+    }
+
+    void Mqtt::processPublish(const std::string& topic, const std::string& message, uint8_t qoS, bool retain, uint16_t packetIdentifier) {
+        Fanout::instance().publish(clusterLink ? Fanout::Origin::CLUSTER : Fanout::Origin::CLIENT, clientId, topic, message, qoS, retain);
+
+        // Publishes of a cluster link have been mapped by the origin node already
+        if (!clusterLink) {
+            mappingsPublished = 0;
+            publishMappings(MappedPublish{topic, message, qoS, retain, packetIdentifier});
+            Metrics::instance().mappingFanout(mappingsPublished);
+        }
+    }
+
+    void Mqtt::onSubscribe(const iot::mqtt::packets::Subscribe& subscribe) {
+        Metrics& metrics = Metrics::instance();
+
+        metrics.packetReceived(Metrics::Packet::SUBSCRIBE);
+
+        for (const iot::mqtt::Topic& topic : subscribe.getTopics()) {
+            const bool shared = SharedSubscriptions::isShared(topic.getName());
+
+            if (shared) {
+                // Delivered by the consumer group, not by the broker
+                broker->unsubscribe(clientId, topic.getName());
+                SharedSubscriptions::instance().subscribe(this, topic.getName(), topic.getQoS());
+            } else {
+                // Retained messages the broker does not hold itself
+                RetainedStore::instance().subscribed(
+                    topic.getName(),
+                    [this, qoS = topic.getQoS()](const std::string& name, const std::string& message, uint8_t retainedQoS) -> void {
+                        sendPublish(name, message, std::min(qoS, retainedQoS), true);
+                    });
+            }
+
+            if (!cleanSession && !clusterLink && !shared) {
+                SessionJournal::instance().subscribed(clientId, topic.getName(), topic.getQoS());
+                OfflineQueue::instance().subscribed(clientId, topic.getName(), topic.getQoS());
+            }
+            if (metrics.subscribe(clientId, topic.getName(), topic.getQoS())) {
+                if (topic.getName().starts_with("$SYS")) {
+                    sysSubscriptions++;
+                    SysPublisher::instance().subscribed(1);
+                }
+                if (!clusterLink) {
+                    Cluster::instance().subscribed(topic.getName());
+                }
+            }
+        }
+
+        sampleTraffic();
+    }
+
+    void Mqtt::onUnsubscribe(const iot::mqtt::packets::Unsubscribe& unsubscribe) {
+        Metrics& metrics = Metrics::instance();
+
+        metrics.packetReceived(Metrics::Packet::UNSUBSCRIBE);
+
+        for (const std::string& topic : unsubscribe.getTopics()) {
+            SharedSubscriptions::instance().unsubscribe(this, topic);
+
+            if (!cleanSession) {
+                SessionJournal::instance().unsubscribed(clientId, topic);
+                OfflineQueue::instance().unsubscribed(clientId, topic);
+            }
+            if (metrics.unsubscribe(clientId, topic)) {
+                if (topic.starts_with("$SYS")) {
+                    sysSubscriptions--;
+                    SysPublisher::instance().unsubscribed(1);
+                }
+                if (!clusterLink) {
+                    Cluster::instance().unsubscribed(topic);
+                }
+            }
+        }
+
+        sampleTraffic();
+    }
+
+    void Mqtt::onPingreq([[maybe_unused]] const iot::mqtt::packets::Pingreq& pingreq) {
+        Metrics::instance().packetReceived(Metrics::Packet::PINGREQ);
+
+        sampleTraffic();
+    }
+
+    void Mqtt::onDisconnect([[maybe_unused]] const iot::mqtt::packets::Disconnect& disconnect) {
+        Metrics::instance().packetReceived(Metrics::Packet::DISCONNECT);
+    }
+
+    void Mqtt::onPuback([[maybe_unused]] const iot::mqtt::packets::Puback& puback) {
+        Metrics::instance().packetReceived(Metrics::Packet::PUBACK);
+    }
+
+    void Mqtt::onPubrec([[maybe_unused]] const iot::mqtt::packets::Pubrec& pubrec) {
+        Metrics::instance().packetReceived(Metrics::Packet::PUBREC);
+    }
+
+    void Mqtt::onPubrel([[maybe_unused]] const iot::mqtt::packets::Pubrel& pubrel) {
+        Metrics::instance().packetReceived(Metrics::Packet::PUBREL);
+    }
+
+    void Mqtt::onPubcomp([[maybe_unused]] const iot::mqtt::packets::Pubcomp& pubcomp) {
+        Metrics::instance().packetReceived(Metrics::Packet::PUBCOMP);
     }
 
     void Mqtt::onDisconnected() {
+        releaseBatches();
+
+        if (delayTimer) {
+            delayTimer->cancel();
+            delayTimer.reset();
+        }
+        for (const DelayedPublish& publish : delayed) {
+            if (publish.retain) {
+                // Mirrors the retained messages of the broker, which has stored them regardless of the rate limits
+                RetainedStore::instance().retain(publish.topic, publish.message, publish.qoS, true);
+            }
+        }
+        delayed.clear();
+        heldAck.clear();
+
+        // A connection taken over by a newer one of its client id leaves the session to that
+        const MqttModel::Client* newest = MqttModel::instance().findClient(clientId);
+        const bool owner = !handedOver && newest != nullptr && newest->mqtt == this;
+
         MqttModel::instance().delDisconnectedClient(this);
+        SharedSubscriptions::instance().unsubscribe(this);
+
+        if (listener != nullptr) {
+            listener->connected.fetch_sub(1, std::memory_order_relaxed);
+
+            SysPublisher::instance().unsubscribed(sysSubscriptions);
+            releaseOutbound(!cleanSession && owner);
+            if (cleanSession) {
+                clearSubscriptions(clientId);
+            }
+            if (clusterLink && owner) {
+                Cluster::instance().linkGone(clientId);
+            } else if (!cleanSession && owner) {
+                OfflineQueue::instance().park(clientId, this);
+            }
+        }
+        sampleTraffic();
+
         VLOG(1) << "MQTT: Disconnected";
     }
 
     void Mqtt::publishMapping(const std::string& topic, const std::string& message, uint8_t qoS, bool retain) {
-        broker->publish(clientId, topic, message, qoS, retain);
+        Fanout::instance().publish(Fanout::Origin::MAPPING, clientId, topic, message, qoS, retain);
+
+        Metrics::instance().mappingPublished(topic, message.size(), retain);
+        mappingsPublished++;
+
+        publishMappings(MappedPublish{topic, message, qoS, retain, getPacketIdentifier()});
+    }
+
+    bool Mqtt::admitPublish(const iot::mqtt::packets::Publish& publish) {
+        const std::size_t size = publish.getTopic().size() + publish.getMessage().size();
+
+        // Behind delayed publishes - the order is kept
+        const bool admitted =
+            rateListener == nullptr || (delayed.empty() && RateLimiter::instance().publish(*rateListener, rateClient, size));
+
+        if (!admitted) {
+            const bool qoS0 = publish.getQoS() == 0;
+
+            // QoS 1 and 2 publishes are not dropped - they are delayed with their acknowledgement, which throttles the client
+            const bool delay = rateListener->action != RateLimiter::Action::DISCONNECT &&
+                               (rateListener->action == RateLimiter::Action::DELAY || !qoS0) && delayed.size() < maxDelayedPublishes;
+
+            if (!delayed.empty()) {
+                rateClient.limited++; // queued behind without a check of its own
+            }
+
+            if (delay) {
+                delayed.push_back({publish.getTopic(),
+                                   publish.getMessage(),
+                                   publish.getQoS(),
+                                   publish.getRetain(),
+                                   publish.getPacketIdentifier(),
+                                   std::exchange(heldAck, {})});
+                scheduleDelayed();
+            } else {
+                // The local broker has already delivered the publish - it is only kept from spreading further
+                if (rateListener->action == RateLimiter::Action::DISCONNECT) {
+                    LOG(INFO) << "MQTT: Disconnecting '" << clientId << "' - publish rate limit exceeded";
+
+                    getSocketConnection()->close();
+                } else if (!qoS0) {
+                    LOG(INFO) << "MQTT: Disconnecting '" << clientId << "' - " << maxDelayedPublishes
+                              << " publishes delayed, their acknowledgements are ignored";
+
+                    getSocketConnection()->close();
+                }
+
+                // Not acknowledged - a persistent session publishes it again after reconnecting
+                heldAck.clear();
+
+                if (publish.getRetain()) {
+                    // Mirrors the retained messages of the broker, which has stored it regardless of the rate limits
+                    RetainedStore::instance().retain(publish.getTopic(), publish.getMessage(), publish.getQoS(), true);
+                }
+            }
+        }
+
+        return admitted;
+    }
+
+    void Mqtt::scheduleDelayed() {
+        if (!delayTimer) {
+            delayTimer = core::timer::Timer::singleshotTimer(
+                [this]() -> void {
+                    delayTimer.reset();
+
+                    releaseDelayed();
+                },
+                delayInterval);
+        }
+    }
+
+    void Mqtt::releaseDelayed() {
+        RateLimiter& rateLimiter = RateLimiter::instance();
+
+        while (!delayed.empty() &&
+               rateLimiter.available(*rateListener, rateClient, delayed.front().topic.size() + delayed.front().message.size())) {
+            DelayedPublish publish = std::move(delayed.front());
+            delayed.pop_front();
+
+            rateLimiter.take(*rateListener, rateClient, publish.topic.size() + publish.message.size());
+
+            // The local broker has delivered it when it was received
+            Metrics::instance().fanoutMark();
+            processPublish(publish.topic, publish.message, publish.qoS, publish.retain, publish.packetIdentifier);
+
+            sendAck(publish.ack);
+        }
+
+        if (!delayed.empty()) {
+            scheduleDelayed();
+        } else {
+            // Withheld without a publish taking it - a retransmitted QoS 2 publish is acknowledged but not delivered again
+            sendAck(heldAck);
+        }
+    }
+
+    void Mqtt::sendAck(std::string& ack) {
+        if (!ack.empty()) {
+            Metrics::instance().packetSent(static_cast<Metrics::Packet>(static_cast<uint8_t>(ack[0]) >> 4), ack.size());
+
+            sender(ack.data(), ack.size());
+            ack.clear();
+        }
+    }
+
+    bool Mqtt::sendQueued(const std::string& topic, const std::string& message, uint8_t qoS) {
+        const bool ready = getOutboundBacklog() < offlineQueueBacklog;
+
+        if (ready) {
+            sendPublish(topic, message, qoS, false);
+        }
+
+        return ready;
+    }
+
+    void Mqtt::resumeOfflineQueue() {
+        OfflineQueue::instance().resume(clientId, this, [this](const std::string& topic, const std::string& message, uint8_t qoS) -> bool {
+            return sendQueued(topic, message, qoS);
+        });
+    }
+
+    void Mqtt::checkOutbound(double now) {
+        const OutboundLimiter& limiter = OutboundLimiter::instance();
+        const std::size_t backlog = getOutboundBacklog();
+
+        if (outbound.over) {
+            outbound.overSeconds += now - outbound.overSince;
+            outbound.overSince = now;
+
+            if (backlog <= limiter.getLowWater()) {
+                VLOG(1) << "MQTT: Outbound backlog of '" << clientId << "' below low water mark - " << backlog << " bytes";
+
+                releaseOutbound(true);
+            }
+        } else if (backlog > limiter.getHighWater()) {
+            outbound.over = true;
+            outbound.overSince = now;
+            outbound.policy = limiter.getPolicy(getSocketConnection()->getInstanceName());
+
+            VLOG(1) << "MQTT: Outbound backlog of '" << clientId << "' above high water mark - " << backlog << " bytes";
+
+            switch (outbound.policy) {
+                case OutboundLimiter::Policy::NONE:
+                    break;
+                case OutboundLimiter::Policy::DROP_QOS0:
+                    outbound.dropQoS0 = true;
+                    break;
+                case OutboundLimiter::Policy::PAUSE:
+                    if (!cleanSession && OfflineQueue::instance().isEnabled()) {
+                        // The offline queue takes the subscriptions out of the broker and replays in order on release
+                        OfflineQueue::instance().park(clientId, this);
+                        outbound.queueParked = true;
+                    } else {
+                        // Nowhere to park the messages of a clean session - only those without delivery guarantee are held back
+                        outbound.dropQoS0 = true;
+                    }
+                    break;
+                case OutboundLimiter::Policy::DISCONNECT:
+                    LOG(INFO) << "MQTT: Disconnecting slow consumer '" << clientId << "' - outbound backlog " << backlog << " bytes";
+
+                    getSocketConnection()->close();
+                    break;
+            }
+        }
+    }
+
+    bool Mqtt::sending(const char* packet, std::size_t size) {
+        const uint8_t type = static_cast<uint8_t>(static_cast<uint8_t>(packet[0]) >> 4);
+
+        // The QoS bits of a PUBLISH hold the delivered QoS, the lower of the published and the subscribed one. QoS 1 and 2
+        // messages are never dropped - the session has taken them over already.
+        const bool drop = outbound.dropQoS0 && type == static_cast<uint8_t>(Metrics::Packet::PUBLISH) && (packet[0] & 0x06) == 0;
+
+        // The acknowledgement of a publish received while publishes are delayed is written when it is released - the first
+        // publish over the limit is still acknowledged right away
+        const bool ack = type == static_cast<uint8_t>(Metrics::Packet::PUBACK) || type == static_cast<uint8_t>(Metrics::Packet::PUBREC);
+        const bool withhold = ack && !delayed.empty() && sender;
+
+        if (withhold) {
+            sendAck(heldAck); // not taken by a publish - see releaseDelayed()
+            heldAck.assign(packet, size);
+        } else if (drop) {
+            outbound.dropped++;
+        } else if (type > 0 && type < static_cast<uint8_t>(Metrics::Packet::COUNT)) {
+            Metrics::instance().packetSent(static_cast<Metrics::Packet>(type), size);
+        }
+
+        return !drop && !withhold;
+    }
+
+    void Mqtt::setSender(const std::function<void(const char*, std::size_t)>& sender) {
+        this->sender = sender;
+    }
+
+    std::size_t Mqtt::getOutboundBacklog() const {
+        return getSocketConnection()->getTotalQueued() - getSocketConnection()->getTotalSent();
+    }
+
+    const Mqtt::Outbound& Mqtt::getOutbound() const {
+        return outbound;
+    }
+
+    uint64_t Mqtt::getRateLimited() const {
+        return rateClient.limited;
+    }
+
+    uint64_t Mqtt::getEpoch() const {
+        return epoch;
+    }
+
+    void Mqtt::handOver() {
+        handedOver = true;
+
+        getSocketConnection()->close();
+    }
+
+    void Mqtt::adoptSubscription(const std::string& filter, uint8_t qoS) {
+        broker->subscribe(clientId, filter, qoS);
+
+        if (!cleanSession) {
+            SessionJournal::instance().subscribed(clientId, filter, qoS);
+            OfflineQueue::instance().subscribed(clientId, filter, qoS);
+        }
+        if (Metrics::instance().subscribe(clientId, filter, qoS)) {
+            if (filter.starts_with("$SYS")) {
+                sysSubscriptions++;
+                SysPublisher::instance().subscribed(1);
+            }
+            Cluster::instance().subscribed(filter);
+        }
+    }
+
+    void Mqtt::releaseOutbound(bool resume) {
+        if (outbound.queueParked && resume) {
+            resumeOfflineQueue();
+        }
+        outbound.queueParked = false;
+        outbound.dropQoS0 = false;
+
+        outbound.over = false;
+    }
+
+    void Mqtt::clearSubscriptions(const std::string& clientId) {
+        for (const std::string& topic : Metrics::instance().clearSubscriptions(clientId)) {
+            if (!clusterLink) {
+                Cluster::instance().unsubscribed(topic);
+            }
+        }
+    }
+
+    void Mqtt::sampleTraffic() {
+        const std::size_t currentTotalRead = getSocketConnection()->getTotalRead();
+        const std::size_t currentTotalSent = getSocketConnection()->getTotalSent();
+
+        Metrics::instance().traffic(currentTotalRead - totalRead, currentTotalSent - totalSent);
+
+        totalRead = currentTotalRead;
+        totalSent = currentTotalSent;
 
-        publishMappings(iot::mqtt::packets::Publish(getPacketIdentifier(), topic, message, qoS, false, retain));
+        // What the broker sends from here on is the fan-out of the next publish received
+        Metrics::instance().fanoutMark();
     }
 
 } // namespace mqtt::mqttbroker::lib
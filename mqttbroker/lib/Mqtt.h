@@ -26,12 +26,21 @@ namespace iot::mqtt::server::broker {
     class Broker;
 } // namespace iot::mqtt::server::broker
 
+#include "Metrics.h"
+#include "OutboundLimiter.h"
+#include "RateLimiter.h"
+
+#include <core/timer/Timer.h>
 #include <iot/mqtt/server/Mqtt.h>
 
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 
+#include <cstddef>
 #include <cstdint>
+#include <deque>
+#include <functional>
 #include <memory>
+#include <optional>
 #include <string>
 
 #endif
@@ -44,16 +53,107 @@ namespace mqtt::mqttbroker::lib {
     public:
         explicit Mqtt(const std::shared_ptr<iot::mqtt::server::broker::Broker>& broker, const nlohmann::json& mappingJson);
 
+        struct Outbound {
+            uint64_t dropped = 0;   // QoS 0 messages not sent due to the slow consumer policy
+            double overSeconds = 0; // accumulated time above the high water mark
+            double overSince = 0;   // steady clock seconds of the last check while above the high water mark
+            bool over = false;      // above the high water mark and not yet below the low water mark
+            OutboundLimiter::Policy policy = OutboundLimiter::Policy::NONE;
+            bool dropQoS0 = false;    // QoS 0 messages for this connection are dropped
+            bool queueParked = false; // pause policy of a persistent session - parked in the offline queue
+        };
+
+        // Called periodically by the OutboundLimiter
+        void checkOutbound(double now);
+
+        // Every control packet of the connection passes here before it is written - false withholds it
+        bool sending(const char* packet, std::size_t size);
+        // Writes a packet without passing sending() - set by the socket context, writes withheld acknowledgements
+        void setSender(const std::function<void(const char*, std::size_t)>& sender);
+
+        std::size_t getOutboundBacklog() const;
+        const Outbound& getOutbound() const;
+
+        uint64_t getRateLimited() const;
+
+        // Session ownership across the workers - see SessionHandover
+        uint64_t getEpoch() const;
+        void handOver(); // closes the connection, the session has moved to another worker
+        void adoptSubscription(const std::string& filter, uint8_t qoS);
+
     private:
         // inherited from iot::mqtt::server::SocketContext - the plain and base MQTT broker
         void onConnect(const iot::mqtt::packets::Connect& connect) final;
         void onPublish(const iot::mqtt::packets::Publish& publish) final;
+        void onSubscribe(const iot::mqtt::packets::Subscribe& subscribe) final;
+        void onUnsubscribe(const iot::mqtt::packets::Unsubscribe& unsubscribe) final;
+        void onPingreq(const iot::mqtt::packets::Pingreq& pingreq) final;
+        void onDisconnect(const iot::mqtt::packets::Disconnect& disconnect) final;
+
+        // inherited from iot::mqtt::Mqtt - only counted
+        void onPuback(const iot::mqtt::packets::Puback& puback) final;
+        void onPubrec(const iot::mqtt::packets::Pubrec& pubrec) final;
+        void onPubrel(const iot::mqtt::packets::Pubrel& pubrel) final;
+        void onPubcomp(const iot::mqtt::packets::Pubcomp& pubcomp) final;
 
         // inherited from core::socket::SocketContext (the root class of all SocketContext classes) via iot::mqtt::server::SocketContext
         void onDisconnected() final;
 
         // implement poor virtual method from apps::mqtt::lib::MqttMapper
         void publishMapping(const std::string& topic, const std::string& message, uint8_t qoS, bool retain) final;
+
+        // Applies the rate limits of the listener - false if the publish is not to be processed any further now
+        bool admitPublish(const iot::mqtt::packets::Publish& publish);
+        // Maps and forwards a publish received from the client
+        void processPublish(const std::string& topic, const std::string& message, uint8_t qoS, bool retain, uint16_t packetIdentifier);
+
+        // Publishes held back by the delay action of the rate limits
+        void scheduleDelayed();
+        void releaseDelayed();
+        // Writes a withheld PUBACK or PUBREC, if any, and clears it
+        void sendAck(std::string& ack);
+
+        // Delivers a message of the offline queue unless the outbound backlog of the connection is too large
+        bool sendQueued(const std::string& topic, const std::string& message, uint8_t qoS);
+
+        void resumeOfflineQueue();
+
+        void releaseOutbound(bool resume);
+
+        void clearSubscriptions(const std::string& clientId);
+
+        // Adds the bytes transferred since the last call to the metrics - called on each packet of this client, not periodically
+        void sampleTraffic();
+
+        Metrics::Listener* listener = nullptr;
+        std::size_t totalRead = 0;
+        std::size_t totalSent = 0;
+        std::size_t mappingsPublished = 0;
+
+        bool cleanSession = true;
+        bool clusterLink = false; // session of a peer node's cluster link
+        uint64_t epoch = 0;
+        bool handedOver = false;
+        std::size_t sysSubscriptions = 0;
+
+        Outbound outbound;
+
+        RateLimiter::Listener* rateListener = nullptr;
+        RateLimiter::Client rateClient;
+
+        struct DelayedPublish {
+            std::string topic;
+            std::string message;
+            uint8_t qoS;
+            bool retain;
+            uint16_t packetIdentifier;
+            std::string ack; // withheld PUBACK or PUBREC
+        };
+
+        std::deque<DelayedPublish> delayed;
+        std::string heldAck; // of the publish being received while publishes are delayed
+        std::function<void(const char*, std::size_t)> sender;
+        std::optional<core::timer::Timer> delayTimer;
     };
 
 } // namespace mqtt::mqttbroker::lib
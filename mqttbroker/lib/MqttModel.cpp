@@ -19,6 +19,17 @@
 
 #include "MqttModel.h"
 
+#include <iot/mqtt/packets/Connect.h>
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <utility>
+
+#endif
+
 namespace mqtt::mqttbroker::lib {
 
     MqttModel& MqttModel::instance() {
@@ -28,15 +39,218 @@ namespace mqtt::mqttbroker::lib {
     }
 
     void MqttModel::addConnectedClient(mqtt::mqttbroker::lib::Mqtt* mqtt, const iot::mqtt::packets::Connect& connect) {
-        connectedClients[mqtt] = connect;
+        delDisconnectedClient(mqtt);
+
+        const uint32_t index = static_cast<uint32_t>(clients.size());
+
+        // A client id taken over by a new connection is indexed to the newest record
+        const uint32_t clientIdHash = hash(connect.getClientId());
+        const std::size_t clientIdPosition = findClientId(connect.getClientId(), clientIdHash);
+
+        if (clientIdPosition != SIZE_MAX) {
+            clientIdIndex.slots[clientIdPosition].index = index;
+            clientIdIndex.slots[clientIdPosition].references++;
+        } else {
+            insert(clientIdIndex, {index, clientIdHash, 1});
+        }
+
+        const std::unordered_map<std::string, std::size_t>::iterator usernameIt = usernames.try_emplace(connect.getUsername(), 0).first;
+        usernameIt->second++;
+
+        clients.push_back({mqtt,
+                           connect.getClientId(),
+                           &usernameIt->first,
+                           nextSerial++,
+                           std::time(nullptr),
+                           connect.getKeepAlive(),
+                           connect.getLevel(),
+                           connect.getCleanSession()});
+
+        insert(mqttIndex, {index, hash(mqtt), 0});
     }
 
     void MqttModel::delDisconnectedClient(mqtt::mqttbroker::lib::Mqtt* mqtt) {
-        connectedClients.erase(mqtt);
+        const std::size_t mqttPosition = findMqtt(mqtt);
+
+        if (mqttPosition != SIZE_MAX) {
+            const uint32_t index = mqttIndex.slots[mqttPosition].index;
+            Client& client = clients[index];
+
+            const std::size_t clientIdPosition = findClientId(client.clientId, hash(client.clientId));
+            Slot& clientIdSlot = clientIdIndex.slots[clientIdPosition];
+
+            if (--clientIdSlot.references == 0) {
+                erase(clientIdIndex, clientIdPosition);
+            } else if (clientIdSlot.index == index) {
+                // The newest record of a taken over client id disconnected first - fall back to the remaining one
+                for (std::size_t other = clients.size(); other-- > 0;) {
+                    if (other != index && clients[other].mqtt != nullptr && clients[other].clientId == client.clientId) {
+                        clientIdSlot.index = static_cast<uint32_t>(other);
+                        break;
+                    }
+                }
+            }
+
+            const std::unordered_map<std::string, std::size_t>::iterator usernameIt = usernames.find(*client.username);
+            if (--usernameIt->second == 0) {
+                usernames.erase(usernameIt);
+            }
+
+            client.mqtt = nullptr;
+            std::string().swap(client.clientId);
+            client.username = nullptr;
+            ++tombstones;
+
+            erase(mqttIndex, mqttPosition);
+
+            if (tombstones > 64 && tombstones * 2 > clients.size()) {
+                compact();
+            }
+        }
+    }
+
+    void MqttModel::compact() {
+        clients.erase(std::remove_if(clients.begin(),
+                                     clients.end(),
+                                     [](const Client& client) {
+                                         return client.mqtt == nullptr;
+                                     }),
+                      clients.end());
+        tombstones = 0;
+
+        // The indices are rebuilt - every record has moved
+        for (Index* index : {&mqttIndex, &clientIdIndex}) {
+            std::fill(index->slots.begin(), index->slots.end(), Slot{UINT32_MAX, 0, 0});
+            index->used = 0;
+        }
+
+        for (std::size_t index = 0; index < clients.size(); ++index) {
+            insert(mqttIndex, {static_cast<uint32_t>(index), hash(clients[index].mqtt), 0});
+
+            const uint32_t clientIdHash = hash(clients[index].clientId);
+            const std::size_t clientIdPosition = findClientId(clients[index].clientId, clientIdHash);
+
+            if (clientIdPosition != SIZE_MAX) {
+                // Records are in connection order - the newest wins
+                clientIdIndex.slots[clientIdPosition].index = static_cast<uint32_t>(index);
+                clientIdIndex.slots[clientIdPosition].references++;
+            } else {
+                insert(clientIdIndex, {static_cast<uint32_t>(index), clientIdHash, 1});
+            }
+        }
+
+        clients.shrink_to_fit();
+    }
+
+    template <typename Matches>
+    std::size_t MqttModel::find(const Index& index, uint32_t hash, const Matches& matches) {
+        std::size_t found = SIZE_MAX;
+
+        if (!index.slots.empty()) {
+            const std::size_t mask = index.slots.size() - 1;
+
+            for (std::size_t position = hash & mask; found == SIZE_MAX && index.slots[position].index != UINT32_MAX;
+                 position = (position + 1) & mask) {
+                if (index.slots[position].hash == hash && matches(index.slots[position].index)) {
+                    found = position;
+                }
+            }
+        }
+
+        return found;
+    }
+
+    void MqttModel::insert(Index& index, const Slot& slot) {
+        if ((index.used + 1) * 2 > index.slots.size()) {
+            std::vector<Slot> slots(std::max<std::size_t>(index.slots.size() * 2, 16), Slot{UINT32_MAX, 0, 0});
+            std::swap(slots, index.slots);
+            index.used = 0;
+
+            for (const Slot& moved : slots) {
+                if (moved.index != UINT32_MAX) {
+                    insert(index, moved);
+                }
+            }
+        }
+
+        const std::size_t mask = index.slots.size() - 1;
+
+        std::size_t position = slot.hash & mask;
+        while (index.slots[position].index != UINT32_MAX) {
+            position = (position + 1) & mask;
+        }
+
+        index.slots[position] = slot;
+        index.used++;
+    }
+
+    // Moves each following slot of the probe sequence into the hole unless that would place it before its home slot
+    void MqttModel::erase(Index& index, std::size_t position) {
+        const std::size_t mask = index.slots.size() - 1;
+
+        std::size_t hole = position;
+        for (std::size_t next = (hole + 1) & mask; index.slots[next].index != UINT32_MAX; next = (next + 1) & mask) {
+            const std::size_t home = index.slots[next].hash & mask;
+
+            if (((next - home) & mask) >= ((next - hole) & mask)) {
+                index.slots[hole] = index.slots[next];
+                hole = next;
+            }
+        }
+
+        index.slots[hole].index = UINT32_MAX;
+        index.used--;
+    }
+
+    // Fibonacci hashing - pointers are aligned, their low bits would crowd few slots
+    uint32_t MqttModel::hash(const mqtt::mqttbroker::lib::Mqtt* mqtt) {
+        return static_cast<uint32_t>((reinterpret_cast<uintptr_t>(mqtt) * 0x9E3779B97F4A7C15ULL) >> 32);
+    }
+
+    uint32_t MqttModel::hash(const std::string& clientId) {
+        return static_cast<uint32_t>((std::hash<std::string>{}(clientId) * 0x9E3779B97F4A7C15ULL) >> 32);
+    }
+
+    std::size_t MqttModel::findMqtt(const mqtt::mqttbroker::lib::Mqtt* mqtt) const {
+        return find(mqttIndex, hash(mqtt), [this, mqtt](uint32_t index) -> bool {
+            return clients[index].mqtt == mqtt;
+        });
+    }
+
+    std::size_t MqttModel::findClientId(const std::string& clientId, uint32_t hash) const {
+        return find(clientIdIndex, hash, [this, &clientId](uint32_t index) -> bool {
+            return clients[index].clientId == clientId;
+        });
+    }
+
+    const MqttModel::Client* MqttModel::findClient(mqtt::mqttbroker::lib::Mqtt* mqtt) const {
+        const std::size_t position = findMqtt(mqtt);
+
+        return position != SIZE_MAX ? &clients[mqttIndex.slots[position].index] : nullptr;
+    }
+
+    const MqttModel::Client* MqttModel::findClient(const std::string& clientId) const {
+        const std::size_t position = findClientId(clientId, hash(clientId));
+
+        return position != SIZE_MAX ? &clients[clientIdIndex.slots[position].index] : nullptr;
+    }
+
+    const std::vector<MqttModel::Client>& MqttModel::getClients() const {
+        return clients;
+    }
+
+    std::size_t MqttModel::lowerBound(uint64_t serial) const {
+        return static_cast<std::size_t>(std::lower_bound(clients.begin(),
+                                                         clients.end(),
+                                                         serial,
+                                                         [](const Client& client, uint64_t serial) {
+                                                             return client.serial < serial;
+                                                         }) -
+                                        clients.begin());
     }
 
-    const std::map<mqtt::mqttbroker::lib::Mqtt*, iot::mqtt::packets::Connect>& MqttModel::getConnectedClients() const {
-        return connectedClients;
+    std::size_t MqttModel::getConnectedClientCount() const {
+        return mqttIndex.used;
     }
 
 } // namespace mqtt::mqttbroker::lib
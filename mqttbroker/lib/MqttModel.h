@@ -24,17 +24,43 @@ namespace mqtt::mqttbroker::lib {
     class Mqtt;
 }
 
-#include <iot/mqtt/packets/Connect.h> // IWYU pragma: export
+namespace iot::mqtt::packets {
+    class Connect;
+}
 
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 
-#include <map>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #endif
 
 namespace mqtt::mqttbroker::lib {
 
+    /* Registry of the connected clients. Only what the web UI and the metrics need is kept - one small record per client stored
+     * contiguously in connection order, usernames are interned and reference counted. Disconnected clients leave a tombstone
+     * (mqtt == nullptr) which is removed by compaction once tombstones dominate.
+     *
+     * The connection and client-id indices are open addressing hash tables of record indices: a slot holds the index and the
+     * hash, the key is compared through the record. Linear probing with backward shift deletion, thus no tombstones in the
+     * tables, grown at a load factor of 1/2. Compared to node based maps this saves two allocations per client. */
     class MqttModel {
+    public:
+        struct Client {
+            mqtt::mqttbroker::lib::Mqtt* mqtt;
+            std::string clientId;
+            const std::string* username;
+            uint64_t serial; // monotonic connection number - used as cursor
+            std::time_t connectedAt;
+            uint16_t keepAlive;
+            uint8_t level;
+            bool cleanSession;
+        };
+
     private:
         MqttModel() = default;
 
@@ -44,10 +70,48 @@ namespace mqtt::mqttbroker::lib {
         void addConnectedClient(mqtt::mqttbroker::lib::Mqtt* mqtt, const iot::mqtt::packets::Connect& connect);
         void delDisconnectedClient(mqtt::mqttbroker::lib::Mqtt* mqtt);
 
-        const std::map<mqtt::mqttbroker::lib::Mqtt*, iot::mqtt::packets::Connect>& getConnectedClients() const;
+        const Client* findClient(mqtt::mqttbroker::lib::Mqtt* mqtt) const;
+        const Client* findClient(const std::string& clientId) const;
+
+        // Records in connection order, including tombstones
+        const std::vector<Client>& getClients() const;
+        std::size_t lowerBound(uint64_t serial) const;
+
+        std::size_t getConnectedClientCount() const;
 
     protected:
-        std::map<mqtt::mqttbroker::lib::Mqtt*, iot::mqtt::packets::Connect> connectedClients;
+        struct Slot {
+            uint32_t index; // record, free slot: UINT32_MAX
+            uint32_t hash;
+            uint32_t references; // client-id index: records of the client id - more than one during a session takeover
+        };
+
+        struct Index {
+            std::vector<Slot> slots; // power of two size
+            std::size_t used = 0;
+        };
+
+        // Position of the slot whose record matches, SIZE_MAX if none
+        template <typename Matches>
+        static std::size_t find(const Index& index, uint32_t hash, const Matches& matches);
+        static void insert(Index& index, const Slot& slot); // the key must not be present
+        static void erase(Index& index, std::size_t position);
+
+        static uint32_t hash(const mqtt::mqttbroker::lib::Mqtt* mqtt);
+        static uint32_t hash(const std::string& clientId);
+
+        std::size_t findMqtt(const mqtt::mqttbroker::lib::Mqtt* mqtt) const;
+        std::size_t findClientId(const std::string& clientId, uint32_t hash) const;
+
+        void compact();
+
+        std::vector<Client> clients;
+        std::size_t tombstones = 0;
+        uint64_t nextSerial = 1;
+
+        Index mqttIndex;
+        Index clientIdIndex;
+        std::unordered_map<std::string, std::size_t> usernames; // interned username -> records pointing to it
     };
 
 } // namespace mqtt::mqttbroker::lib
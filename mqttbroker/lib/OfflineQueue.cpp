@@ -0,0 +1,783 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "OfflineQueue.h"
+
+#include "Metrics.h"
+#include "lib/LoopMonitor.h"
+
+#include <iot/mqtt/server/broker/Broker.h>
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <log/Logger.h>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#endif
+
+#ifndef SUBSCRIBTION_MAX_QOS
+#define SUBSCRIBTION_MAX_QOS 2
+#endif
+
+namespace mqtt::mqttbroker::lib {
+
+    namespace {
+
+        // Followed by topic and message
+        struct RecordHeader {
+            uint32_t messageSize;
+            uint16_t topicSize;
+            uint8_t qoS;
+            uint8_t reserved;
+        };
+
+        static_assert(sizeof(RecordHeader) == 8);
+
+        constexpr std::size_t spillChunkSize = 16 * 1024;
+        constexpr std::size_t segmentSize = 4 * 1024 * 1024;
+        constexpr std::size_t readChunkSize = 64 * 1024;
+        constexpr off_t readAheadSize = 1024 * 1024;
+        constexpr std::size_t streamBytesPerTick = 256 * 1024;
+        constexpr double tickInterval = 0.01;
+
+        std::string record(const std::string& topic, const std::string& message, uint8_t qoS) {
+            const RecordHeader header{static_cast<uint32_t>(message.size()), static_cast<uint16_t>(topic.size()), qoS, 0};
+
+            std::string record(sizeof(header), '\0');
+            std::memcpy(record.data(), &header, sizeof(header));
+            record += topic;
+            record += message;
+
+            return record;
+        }
+
+        RecordHeader header(const char* record) {
+            RecordHeader header{};
+            std::memcpy(&header, record, sizeof(header));
+
+            return header;
+        }
+
+        std::size_t recordSize(const char* record) {
+            const RecordHeader recordHeader = header(record);
+
+            return sizeof(RecordHeader) + recordHeader.topicSize + recordHeader.messageSize;
+        }
+
+        bool writeAll(int fd, const std::string& data) {
+            std::size_t written = 0;
+
+            while (written < data.size()) {
+                const ssize_t ret = ::write(fd, data.data() + written, data.size() - written);
+
+                if (ret > 0) {
+                    written += static_cast<std::size_t>(ret);
+                } else if (ret < 0 && errno != EINTR) {
+                    break;
+                }
+            }
+
+            return written == data.size();
+        }
+
+    } // namespace
+
+    OfflineQueue::~OfflineQueue() {
+        // Kept for the next run
+        for (auto& [clientId, queue] : queues) {
+            persist(queue);
+        }
+
+        for (std::unordered_map<std::string, Queue>::node_type& handover : handovers) {
+            discard(handover.mapped());
+        }
+    }
+
+    OfflineQueue& OfflineQueue::instance() {
+        static OfflineQueue offlineQueue;
+
+        return offlineQueue;
+    }
+
+    bool OfflineQueue::open(const std::string& directory, const Limits& limits) {
+        if (!directory.empty() && !enabled) {
+            if (mkdir(directory.data(), 0700) != 0 && errno != EEXIST) {
+                PLOG(ERROR) << "OfflineQueue: Creating spool directory '" << directory << "' failed";
+            } else if (DIR* dir = opendir(directory.data()); dir != nullptr) {
+                this->directory = directory;
+                this->limits = limits;
+                enabled = true;
+
+                restore(dir);
+                closedir(dir);
+
+                broker = iot::mqtt::server::broker::Broker::instance(SUBSCRIBTION_MAX_QOS);
+
+                timer = core::timer::Timer::intervalTimer(
+                    [this]() -> void {
+                        const mqtt::lib::LoopMonitor::Probe probe("timer: offline queue");
+
+                        tick();
+
+                        // Streamed messages are no fan-out of a publish
+                        Metrics::instance().fanoutMark();
+                    },
+                    tickInterval);
+
+                VLOG(1) << "OfflineQueue: Spooling to '" << directory << "'";
+            } else {
+                PLOG(ERROR) << "OfflineQueue: Opening spool directory '" << directory << "' failed";
+            }
+        }
+
+        return enabled;
+    }
+
+    void OfflineQueue::restored() {
+        for (std::unordered_map<std::string, Queue>::iterator it = queues.begin(); it != queues.end();) {
+            if (!it->second.parked) {
+                discard(it->second);
+                it = queues.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        if (enabled) {
+            VLOG(1) << "OfflineQueue: " << totalBytes << " queued bytes restored";
+        }
+    }
+
+    bool OfflineQueue::isEnabled() const {
+        return enabled;
+    }
+
+    std::size_t OfflineQueue::getQueuedBytes() const {
+        return totalBytes;
+    }
+
+    std::size_t OfflineQueue::getMemoryBytes() const {
+        return memoryBytes;
+    }
+
+    uint64_t OfflineQueue::getDroppedBytes() const {
+        return droppedBytes;
+    }
+
+    OfflineQueue::Queue& OfflineQueue::queue(const std::string& clientId) {
+        const auto [it, inserted] = queues.try_emplace(clientId);
+
+        if (inserted) {
+            it->second.clientId = clientId;
+            it->second.serial = nextSerial++;
+        }
+
+        return it->second;
+    }
+
+    void OfflineQueue::subscribed(const std::string& clientId, const std::string& filter, uint8_t qoS) {
+        if (enabled) {
+            Queue& queue = this->queue(clientId);
+
+            const bool inserted = queue.filters.insert_or_assign(filter, qoS).second;
+
+            if (queue.parked) {
+                if (inserted) {
+                    // Delivered through the queue - the broker would deliver past the queued messages
+                    park(queue, filter, qoS);
+                } else {
+                    parkedQueues[filter][&queue] = qoS;
+                }
+            }
+        }
+    }
+
+    void OfflineQueue::unsubscribed(const std::string& clientId, const std::string& filter) {
+        const std::unordered_map<std::string, Queue>::iterator it = queues.find(clientId);
+
+        if (it != queues.end() && it->second.filters.erase(filter) > 0 && it->second.parked) {
+            unpark(it->second, filter);
+        }
+    }
+
+    void OfflineQueue::cleared(const std::string& clientId) {
+        const std::unordered_map<std::string, Queue>::iterator it = queues.find(clientId);
+
+        if (it != queues.end()) {
+            Queue& queue = it->second;
+
+            if (queue.parked) {
+                for (const auto& [filter, qoS] : queue.filters) {
+                    unpark(queue, filter);
+                }
+            }
+
+            discard(queue);
+            streaming.erase(&queue);
+            queues.erase(it);
+        }
+    }
+
+    void OfflineQueue::park(const std::string& clientId, const void* connection) {
+        const std::unordered_map<std::string, Queue>::iterator it = queues.find(clientId);
+
+        if (it != queues.end() && it->second.connection == connection) {
+            Queue& queue = it->second;
+
+            queue.connection = nullptr;
+            queue.deliver = nullptr;
+            streaming.erase(&queue);
+
+            if (queue.readFd >= 0) {
+                // Do not hold a descriptor and read buffer for an offline session - continue at the first unsent record
+                queue.readOffset -= queue.readBuffer.size() - queue.readPosition;
+                queue.readBuffer.clear();
+                queue.readPosition = 0;
+
+                close(queue.readFd);
+                queue.readFd = -1;
+            }
+
+            if (!queue.parked) {
+                queue.parked = true;
+
+                for (const auto& [filter, qoS] : queue.filters) {
+                    park(queue, filter, qoS);
+                }
+            }
+        }
+    }
+
+    void OfflineQueue::park(Queue& queue, const std::string& filter, uint8_t qoS) {
+        parkedFilters.insert(filter);
+        parkedQueues[filter][&queue] = qoS;
+
+        broker->unsubscribe(queue.clientId, filter);
+    }
+
+    void OfflineQueue::resume(const std::string& clientId, const void* connection, const Deliver& deliver) {
+        if (enabled) {
+            Queue& queue = this->queue(clientId);
+
+            queue.connection = connection;
+
+            if (queue.parked) {
+                queue.deliver = deliver;
+
+                if (queue.bytes > 0) {
+                    streaming.insert(&queue);
+                }
+            }
+        }
+    }
+
+    void OfflineQueue::handOver(const std::string& clientId, const Deliver& deliver) {
+        const std::unordered_map<std::string, Queue>::iterator it = queues.find(clientId);
+
+        if (it != queues.end()) {
+            Queue& queue = it->second;
+
+            if (queue.parked) {
+                for (const auto& [filter, qoS] : queue.filters) {
+                    unpark(queue, filter);
+                }
+            }
+            queue.filters.clear();
+            queue.parked = false;
+
+            if (queue.bytes > 0) {
+                // The node keeps the queue at its address - a new session of the client id gets a queue of its own
+                queue.deliver = deliver;
+                streaming.insert(&queue);
+
+                handovers.push_back(queues.extract(it));
+            } else {
+                discard(queue);
+                streaming.erase(&queue);
+                queues.erase(it);
+            }
+        }
+    }
+
+    void OfflineQueue::queued(const std::string& clientId, const std::string& topic, const std::string& message, uint8_t qoS) {
+        if (enabled && qoS > 0 && topic.size() <= UINT16_MAX && message.size() <= UINT32_MAX) {
+            enqueue(queue(clientId), record(topic, message, qoS));
+        }
+    }
+
+    void OfflineQueue::unpark(Queue& queue, const std::string& filter) {
+        parkedFilters.erase(filter);
+
+        const std::unordered_map<std::string, std::unordered_map<Queue*, uint8_t>>::iterator it = parkedQueues.find(filter);
+        if (it != parkedQueues.end()) {
+            it->second.erase(&queue);
+
+            if (it->second.empty()) {
+                parkedQueues.erase(it);
+            }
+        }
+    }
+
+    void OfflineQueue::publish(const std::string& topic, const std::string& message, uint8_t qoS) {
+        if (enabled && parkedFilters.size() > 0 && topic.size() <= UINT16_MAX && message.size() <= UINT32_MAX) {
+            std::unordered_map<Queue*, uint8_t> targets; // a session receives a message once, with the highest matching qos
+
+            parkedFilters.match(topic, [this, &targets](const std::string& filter) -> void {
+                for (const auto& [queue, subscribedQoS] : parkedQueues[filter]) {
+                    uint8_t& targetQoS = targets[queue];
+                    targetQoS = std::max(targetQoS, subscribedQoS);
+                }
+            });
+
+            for (const auto& [queue, subscribedQoS] : targets) {
+                const uint8_t targetQoS = std::min(qoS, subscribedQoS);
+
+                // Directly to a connected session with nothing queued, queued behind the backlog otherwise - QoS 0 only if connected
+                const bool delivered = queue->deliver && queue->bytes == 0 && queue->deliver(topic, message, targetQoS);
+
+                if (!delivered && (targetQoS > 0 || queue->deliver)) {
+                    enqueue(*queue, record(topic, message, targetQoS));
+                }
+            }
+        }
+    }
+
+    void OfflineQueue::enqueue(Queue& queue, const std::string& record) {
+        const auto fits = [this, &queue, size = record.size()]() -> bool {
+            return queue.bytes + size <= limits.clientBytes && totalBytes + size <= limits.totalBytes;
+        };
+
+        while (!fits() && limits.dropOldest && dropOldest(queue)) {
+        }
+
+        if (fits()) {
+            store(queue, record);
+
+            if (queue.deliver) {
+                streaming.insert(&queue);
+            }
+        } else {
+            droppedBytes += record.size();
+        }
+    }
+
+    void OfflineQueue::store(Queue& queue, const std::string& record) {
+        if (queue.segments.empty() && queue.spill.empty() && queue.headBytes + record.size() <= limits.headBytes &&
+            memoryBytes + record.size() <= limits.memoryBytes) {
+            queue.head.push_back(record);
+            queue.headBytes += record.size();
+        } else {
+            queue.spill += record;
+        }
+
+        memoryBytes += record.size();
+        queue.bytes += record.size();
+        totalBytes += record.size();
+
+        if (queue.spill.size() >= spillChunkSize || (!queue.spill.empty() && memoryBytes > limits.memoryBytes)) {
+            flush(queue);
+        }
+    }
+
+    void OfflineQueue::flush(Queue& queue) {
+        if (queue.segments.empty()) {
+            writeQueueFile(queue, 0);
+        }
+        if (queue.segments.empty() || queue.segments.back().size >= segmentSize) {
+            queue.segments.push_back({queue.nextSegment, segmentFile(queue, queue.nextSegment), 0});
+            queue.nextSegment++;
+        }
+
+        Segment& segment = queue.segments.back();
+
+        const int fd = ::open(segment.file.data(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+
+        if (fd >= 0 && writeAll(fd, queue.spill)) {
+            segment.size += queue.spill.size();
+        } else {
+            PLOG(ERROR) << "OfflineQueue: Writing '" << segment.file << "' failed - " << queue.spill.size() << " bytes dropped";
+
+            if (fd >= 0 && ftruncate(fd, static_cast<off_t>(segment.size)) != 0) {
+                PLOG(ERROR) << "OfflineQueue: Truncating '" << segment.file << "' failed";
+            }
+
+            queue.bytes -= queue.spill.size();
+            totalBytes -= queue.spill.size();
+            droppedBytes += queue.spill.size();
+        }
+
+        if (fd >= 0) {
+            close(fd);
+        }
+
+        memoryBytes -= queue.spill.size();
+        queue.spill.clear();
+    }
+
+    bool OfflineQueue::dropOldest(Queue& queue) {
+        std::size_t size = 0;
+
+        if (!queue.head.empty()) {
+            size = queue.head.front().size();
+
+            queue.headBytes -= size;
+            memoryBytes -= size;
+            queue.head.pop_front();
+        } else if (!queue.segments.empty()) {
+            // Whole segments at once - the front one possibly partially streamed already
+            size = queue.segments.front().size - (queue.readOffset - (queue.readBuffer.size() - queue.readPosition));
+
+            dropSegment(queue);
+        } else if (!queue.spill.empty()) {
+            size = recordSize(queue.spill.data());
+
+            memoryBytes -= size;
+            queue.spill.erase(0, size);
+        }
+
+        queue.bytes -= size;
+        totalBytes -= size;
+        droppedBytes += size;
+
+        return size > 0;
+    }
+
+    void OfflineQueue::dropSegment(Queue& queue) {
+        if (queue.readFd >= 0) {
+            close(queue.readFd);
+            queue.readFd = -1;
+        }
+        queue.readBuffer.clear();
+        queue.readPosition = 0;
+        queue.readOffset = 0;
+
+        unlink(queue.segments.front().file.data());
+        queue.segments.pop_front();
+    }
+
+    void OfflineQueue::discard(Queue& queue) {
+        while (!queue.segments.empty()) {
+            dropSegment(queue);
+        }
+
+        memoryBytes -= queue.headBytes + queue.spill.size();
+        totalBytes -= queue.bytes;
+
+        queue.head.clear();
+        queue.headBytes = 0;
+        queue.spill.clear();
+        queue.bytes = 0;
+
+        unlink(queueFile(queue).data());
+    }
+
+    std::string OfflineQueue::segmentFile(const Queue& queue, uint64_t number) const {
+        return directory + "/" + std::to_string(queue.serial) + "-" + std::to_string(number) + ".seg";
+    }
+
+    std::string OfflineQueue::queueFile(const Queue& queue) const {
+        return directory + "/" + std::to_string(queue.serial) + ".queue";
+    }
+
+    // The queue file holds the bytes of the front segment streamed already followed by the client id
+    void OfflineQueue::writeQueueFile(const Queue& queue, uint64_t offset) {
+        std::string data(sizeof(offset), '\0');
+        std::memcpy(data.data(), &offset, sizeof(offset));
+        data += queue.clientId;
+
+        const std::string file = queueFile(queue);
+        const int fd = ::open(file.data(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+
+        if (fd < 0 || !writeAll(fd, data)) {
+            PLOG(ERROR) << "OfflineQueue: Writing '" << file << "' failed";
+        }
+
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    void OfflineQueue::restore(DIR* dir) {
+        std::map<uint64_t, std::string> queueFiles;                       // serial -> file
+        std::map<uint64_t, std::map<uint64_t, std::string>> segmentFiles; // serial -> number -> file
+
+        for (const dirent* entry = readdir(dir); entry != nullptr; entry = readdir(dir)) {
+            const std::string_view name(entry->d_name);
+            const char* const end = name.data() + name.size();
+
+            uint64_t serial = 0;
+            uint64_t number = 0;
+
+            const std::from_chars_result parsed = std::from_chars(name.data(), end, serial);
+
+            if (parsed.ec == std::errc() && std::string_view(parsed.ptr, end) == ".queue") {
+                queueFiles[serial] = name;
+            } else if (name.ends_with(".seg")) {
+                const std::from_chars_result parsedNumber =
+                    parsed.ec == std::errc() && *parsed.ptr == '-' ? std::from_chars(parsed.ptr + 1, end, number) : parsed;
+
+                if (parsedNumber.ec == std::errc() && parsedNumber.ptr != parsed.ptr && std::string_view(parsedNumber.ptr, end) == ".seg") {
+                    segmentFiles[serial][number] = name;
+                } else {
+                    unlinkat(dirfd(dir), entry->d_name, 0);
+                }
+            }
+        }
+
+        for (const auto& [serial, file] : queueFiles) {
+            std::string data;
+
+            const int fd = openat(dirfd(dir), file.data(), O_RDONLY | O_CLOEXEC);
+            if (fd >= 0) {
+                char buffer[4096];
+                for (ssize_t ret = ::read(fd, buffer, sizeof(buffer)); ret > 0; ret = ::read(fd, buffer, sizeof(buffer))) {
+                    data.append(buffer, static_cast<std::size_t>(ret));
+                }
+                close(fd);
+            }
+
+            const std::map<uint64_t, std::map<uint64_t, std::string>>::iterator segments = segmentFiles.find(serial);
+
+            if (data.size() >= sizeof(uint64_t) && segments != segmentFiles.end() && !queues.contains(data.substr(sizeof(uint64_t)))) {
+                uint64_t offset = 0;
+                std::memcpy(&offset, data.data(), sizeof(offset));
+
+                Queue& queue = queues[data.substr(sizeof(uint64_t))];
+                queue.clientId = data.substr(sizeof(uint64_t));
+                queue.serial = serial;
+
+                for (const auto& [number, segmentName] : segments->second) {
+                    struct stat st{};
+
+                    if (fstatat(dirfd(dir), segmentName.data(), &st, 0) == 0) {
+                        queue.segments.push_back({number, directory + "/" + segmentName, static_cast<std::size_t>(st.st_size)});
+                        queue.bytes += static_cast<std::size_t>(st.st_size);
+                    }
+                    queue.nextSegment = number + 1;
+                }
+
+                if (!queue.segments.empty()) {
+                    queue.readOffset = std::min(static_cast<std::size_t>(offset), queue.segments.front().size);
+                    queue.bytes -= queue.readOffset;
+                }
+
+                totalBytes += queue.bytes;
+                nextSerial = std::max(nextSerial, serial + 1);
+
+                segmentFiles.erase(segments);
+            } else {
+                unlinkat(dirfd(dir), file.data(), 0);
+            }
+        }
+
+        // Segments without a queue file
+        for (const auto& [serial, segments] : segmentFiles) {
+            for (const auto& [number, segmentName] : segments) {
+                unlinkat(dirfd(dir), segmentName.data(), 0);
+            }
+        }
+    }
+
+    void OfflineQueue::persist(Queue& queue) {
+        if (queue.bytes > 0) {
+            if (!queue.head.empty()) {
+                // Older than all segments - while there are segments the head is not filled and their front is unread
+                const uint64_t number = queue.segments.empty() ? queue.nextSegment++ : queue.segments.front().number - 1;
+
+                std::string records;
+                for (const std::string& record : queue.head) {
+                    records += record;
+                }
+
+                const std::string file = segmentFile(queue, number);
+                const int fd = ::open(file.data(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+
+                if (fd >= 0 && writeAll(fd, records)) {
+                    queue.segments.push_front({number, file, records.size()});
+                } else {
+                    PLOG(ERROR) << "OfflineQueue: Writing '" << file << "' failed - " << records.size() << " bytes dropped";
+                }
+
+                if (fd >= 0) {
+                    close(fd);
+                }
+
+                memoryBytes -= queue.headBytes;
+                queue.head.clear();
+                queue.headBytes = 0;
+            }
+
+            if (!queue.spill.empty()) {
+                flush(queue);
+            }
+
+            writeQueueFile(queue, queue.readOffset - (queue.readBuffer.size() - queue.readPosition));
+        } else {
+            discard(queue);
+        }
+
+        if (queue.readFd >= 0) {
+            close(queue.readFd);
+            queue.readFd = -1;
+        }
+    }
+
+    void OfflineQueue::tick() {
+        const std::vector<Queue*> current(streaming.begin(), streaming.end());
+
+        for (Queue* queue : current) {
+            stream(*queue);
+        }
+    }
+
+    void OfflineQueue::stream(Queue& queue) {
+        std::size_t sent = 0;
+        bool blocked = false;
+
+        std::string_view data;
+        while (sent < streamBytesPerTick && !blocked && next(queue, data)) {
+            const RecordHeader recordHeader = header(data.data());
+
+            const std::string topic(data.substr(sizeof(RecordHeader), recordHeader.topicSize));
+            const std::string message(data.substr(sizeof(RecordHeader) + recordHeader.topicSize, recordHeader.messageSize));
+
+            blocked = !queue.deliver(topic, message, recordHeader.qoS);
+
+            if (!blocked) {
+                sent += data.size();
+                consume(queue, data.size());
+            }
+        }
+
+        if (queue.bytes == 0) {
+            streaming.erase(&queue);
+
+            const std::list<std::unordered_map<std::string, Queue>::node_type>::iterator handover =
+                std::ranges::find_if(handovers, [&queue](const std::unordered_map<std::string, Queue>::node_type& node) -> bool {
+                    return &node.mapped() == &queue;
+                });
+
+            if (handover != handovers.end()) {
+                discard(queue);
+                handovers.erase(handover);
+            }
+        }
+    }
+
+    bool OfflineQueue::next(Queue& queue, std::string_view& data) {
+        bool available = false;
+
+        if (!queue.head.empty()) {
+            data = queue.head.front();
+            available = true;
+        }
+
+        while (!available && !queue.segments.empty()) {
+            const Segment& segment = queue.segments.front();
+
+            if (queue.readFd < 0) {
+                queue.readFd = ::open(segment.file.data(), O_RDONLY | O_CLOEXEC);
+
+                if (queue.readFd >= 0) {
+                    lseek(queue.readFd, static_cast<off_t>(queue.readOffset), SEEK_SET);
+                    posix_fadvise(queue.readFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+                }
+            }
+
+            const std::size_t buffered = queue.readBuffer.size() - queue.readPosition;
+
+            if (queue.readFd < 0) {
+                PLOG(ERROR) << "OfflineQueue: Opening '" << segment.file << "' failed";
+
+                droppedBytes += segment.size - queue.readOffset;
+                queue.bytes -= segment.size - queue.readOffset;
+                totalBytes -= segment.size - queue.readOffset;
+                dropSegment(queue);
+            } else if (buffered >= sizeof(RecordHeader) && buffered >= recordSize(queue.readBuffer.data() + queue.readPosition)) {
+                const char* record = queue.readBuffer.data() + queue.readPosition;
+
+                data = std::string_view(record, recordSize(record));
+                available = true;
+            } else if (queue.readOffset >= segment.size) {
+                // Completely streamed - a remainder would be a torn record
+                droppedBytes += buffered;
+                queue.bytes -= buffered;
+                totalBytes -= buffered;
+                dropSegment(queue);
+            } else {
+                queue.readBuffer.erase(0, queue.readPosition);
+                queue.readPosition = 0;
+
+                const std::size_t size = queue.readBuffer.size();
+                queue.readBuffer.resize(size + std::min(readChunkSize, segment.size - queue.readOffset));
+
+                const ssize_t ret = ::read(queue.readFd, queue.readBuffer.data() + size, queue.readBuffer.size() - size);
+
+                if (ret > 0) {
+                    queue.readBuffer.resize(size + static_cast<std::size_t>(ret));
+                    queue.readOffset += static_cast<std::size_t>(ret);
+
+                    posix_fadvise(queue.readFd, static_cast<off_t>(queue.readOffset), readAheadSize, POSIX_FADV_WILLNEED);
+                } else {
+                    PLOG(ERROR) << "OfflineQueue: Reading '" << segment.file << "' failed";
+
+                    queue.readBuffer.resize(size);
+
+                    // Drop the unread rest of the segment - the buffered remainder goes with the next iteration
+                    droppedBytes += segment.size - queue.readOffset;
+                    queue.bytes -= segment.size - queue.readOffset;
+                    totalBytes -= segment.size - queue.readOffset;
+                    queue.readOffset = segment.size;
+                }
+            }
+        }
+
+        if (!available && !queue.spill.empty()) {
+            data = std::string_view(queue.spill.data(), recordSize(queue.spill.data()));
+            available = true;
+        }
+
+        return available;
+    }
+
+    void OfflineQueue::consume(Queue& queue, std::size_t size) {
+        if (!queue.head.empty()) {
+            queue.headBytes -= size;
+            memoryBytes -= size;
+            queue.head.pop_front();
+        } else if (!queue.segments.empty()) {
+            queue.readPosition += size;
+        } else {
+            memoryBytes -= size;
+            queue.spill.erase(0, size);
+        }
+
+        queue.bytes -= size;
+        totalBytes -= size;
+    }
+
+} // namespace mqtt::mqttbroker::lib
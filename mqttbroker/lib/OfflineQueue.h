@@ -0,0 +1,190 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MQTTBROKER_LIB_OFFLINEQUEUE_H
+#define MQTTBROKER_LIB_OFFLINEQUEUE_H
+
+#include "TopicFilterTrie.h"
+
+namespace iot::mqtt::server::broker {
+    class Broker;
+} // namespace iot::mqtt::server::broker
+
+#include <core/timer/Timer.h>
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <dirent.h>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+#endif
+
+namespace mqtt::mqttbroker::lib {
+
+    /* Bounded, disk backed queues for offline persistent (clean session = false) sessions.
+     *
+     * When a persistent session goes offline it is "parked": its subscriptions are removed from the broker, which would queue
+     * every matching message in RAM, and registered here instead. Matching QoS 1 and 2 publishes are appended to the queue of
+     * the session - the first bytes to an in-memory head, everything behind it to segment files in the spool directory.
+     *
+     * When the client reconnects the queue is streamed to it from a timer, a limited number of bytes per tick and only while its
+     * outbound backlog is small, reading the segments sequentially with readahead. Publishes arriving meanwhile, QoS 0 included,
+     * are appended, so the order is kept. Once the queue is empty matching publishes are delivered to the connection directly -
+     * the subscriptions stay here, as subscribing them at the broker again would make it resend its retained messages.
+     *
+     * The queues are kept in the spool directory on shutdown and restored together with the sessions of the session journal.
+     * After a crash the streamed part of a segment may be delivered again.
+     *
+     * A per session and a global byte budget bound the queues. If a message exceeds a budget either the oldest queued messages
+     * of that session are dropped to make room or the new message is dropped. */
+    class OfflineQueue {
+    private:
+        OfflineQueue() = default;
+
+    public:
+        using Deliver = std::function<bool(const std::string& topic, const std::string& message, uint8_t qoS)>; // false: retry later
+
+        struct Limits {
+            std::size_t headBytes;    // in-memory head per session
+            std::size_t clientBytes;  // budget per session
+            std::size_t totalBytes;   // budget of all sessions
+            std::size_t memoryBytes;  // in-memory heads and spill buffers of all sessions
+            bool dropOldest;
+        };
+
+        OfflineQueue(const OfflineQueue&) = delete;
+        OfflineQueue& operator=(const OfflineQueue&) = delete;
+
+        ~OfflineQueue();
+
+        static OfflineQueue& instance();
+
+        // Called once after core::SNodeC::init() - the queues spooled by a previous run are read back
+        bool open(const std::string& directory, const Limits& limits);
+        // Called once the sessions have been restored - drops the queues read back for sessions which are gone
+        void restored();
+        bool isEnabled() const;
+
+        // Subscriptions of persistent sessions
+        void subscribed(const std::string& clientId, const std::string& filter, uint8_t qoS);
+        void unsubscribed(const std::string& clientId, const std::string& filter);
+        void cleared(const std::string& clientId);
+
+        // Keyed by connection: a park is ignored if another connection has resumed the session meanwhile. nullptr parks a session
+        // restored or adopted without a connection.
+        void park(const std::string& clientId, const void* connection);
+        void resume(const std::string& clientId, const void* connection, const Deliver& deliver);
+
+        // Session moved to another worker - streams the queue to deliver and forgets it, the subscriptions are dropped
+        void handOver(const std::string& clientId, const Deliver& deliver);
+        void queued(const std::string& clientId, const std::string& topic, const std::string& message, uint8_t qoS);
+
+        void publish(const std::string& topic, const std::string& message, uint8_t qoS);
+
+        std::size_t getQueuedBytes() const;
+        std::size_t getMemoryBytes() const;
+        uint64_t getDroppedBytes() const;
+
+    private:
+        struct Segment {
+            uint64_t number = 0;
+            std::string file;
+            std::size_t size = 0;
+        };
+
+        struct Queue {
+            std::string clientId;
+            uint64_t serial = 0;
+
+            std::map<std::string, uint8_t> filters;
+            bool parked = false;
+            const void* connection = nullptr; // resumed by
+            Deliver deliver;
+
+            std::deque<std::string> head; // oldest records in memory
+            std::size_t headBytes = 0;
+            std::deque<Segment> segments; // then the spilled ones
+            uint64_t nextSegment = 1;     // 0 is left for persisting the head in front of the first segment
+            std::string spill;            // then the newest, not yet written ones
+
+            int readFd = -1;              // streaming the front segment
+            std::string readBuffer;
+            std::size_t readPosition = 0;
+            std::size_t readOffset = 0;   // bytes read from the front segment
+
+            std::size_t bytes = 0;
+        };
+
+        Queue& queue(const std::string& clientId);
+
+        void park(Queue& queue, const std::string& filter, uint8_t qoS);
+        void unpark(Queue& queue, const std::string& filter);
+
+        void enqueue(Queue& queue, const std::string& record);
+        void store(Queue& queue, const std::string& record);
+        bool dropOldest(Queue& queue);
+        void dropSegment(Queue& queue);
+        void flush(Queue& queue);
+        void discard(Queue& queue);
+
+        std::string segmentFile(const Queue& queue, uint64_t number) const;
+        std::string queueFile(const Queue& queue) const;
+        void writeQueueFile(const Queue& queue, uint64_t offset);
+        void restore(DIR* dir);
+        void persist(Queue& queue);
+
+        void tick();
+        void stream(Queue& queue);
+        bool next(Queue& queue, std::string_view& record);
+        void consume(Queue& queue, std::size_t size);
+
+        std::string directory;
+        Limits limits{};
+        bool enabled = false;
+
+        std::unordered_map<std::string, Queue> queues;
+        std::list<std::unordered_map<std::string, Queue>::node_type> handovers; // streamed to another worker
+        uint64_t nextSerial = 0;
+
+        TopicFilterTrie parkedFilters;
+        std::unordered_map<std::string, std::unordered_map<Queue*, uint8_t>> parkedQueues; // filter -> parked queue -> qos
+        std::unordered_set<Queue*> streaming;
+
+        std::size_t totalBytes = 0;
+        std::size_t memoryBytes = 0;
+        uint64_t droppedBytes = 0;
+
+        std::shared_ptr<iot::mqtt::server::broker::Broker> broker;
+        std::optional<core::timer::Timer> timer;
+    };
+
+} // namespace mqtt::mqttbroker::lib
+
+#endif // MQTTBROKER_LIB_OFFLINEQUEUE_H
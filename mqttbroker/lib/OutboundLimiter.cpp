@@ -0,0 +1,109 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "OutboundLimiter.h"
+
+#include "Mqtt.h"
+#include "MqttModel.h"
+#include "lib/LoopMonitor.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <algorithm>
+#include <chrono>
+#include <log/Logger.h>
+#include <vector>
+
+#endif
+
+namespace mqtt::mqttbroker::lib {
+
+    OutboundLimiter& OutboundLimiter::instance() {
+        static OutboundLimiter outboundLimiter;
+
+        return outboundLimiter;
+    }
+
+    void OutboundLimiter::start(std::size_t highWater, std::size_t lowWater, const std::string& policies, double interval) {
+        static const std::map<std::string, Policy> policyNames = {
+            {"none", Policy::NONE}, {"drop-qos0", Policy::DROP_QOS0}, {"pause", Policy::PAUSE}, {"disconnect", Policy::DISCONNECT}};
+
+        this->highWater = highWater;
+        this->lowWater = std::min(lowWater, highWater);
+
+        std::size_t begin = 0;
+        while (begin < policies.size()) {
+            const std::size_t end = std::min(policies.find(',', begin), policies.size());
+            const std::string entry = policies.substr(begin, end - begin);
+            const std::size_t separator = entry.find('=');
+
+            const std::map<std::string, Policy>::const_iterator policy =
+                separator != std::string::npos ? policyNames.find(entry.substr(separator + 1)) : policyNames.end();
+
+            if (policy == policyNames.end()) {
+                LOG(WARNING) << "OutboundLimiter: Ignoring policy '" << entry << "'";
+            } else if (entry.substr(0, separator) == "*") {
+                defaultPolicy = policy->second;
+            } else {
+                this->policies[entry.substr(0, separator)] = policy->second;
+            }
+
+            begin = end + 1;
+        }
+
+        if (highWater > 0 && !timer) {
+            timer = core::timer::Timer::intervalTimer(
+                [this]() -> void {
+                    const mqtt::lib::LoopMonitor::Probe probe("timer: outbound limiter");
+
+                    check();
+                },
+                interval);
+        }
+    }
+
+    OutboundLimiter::Policy OutboundLimiter::getPolicy(const std::string& listener) const {
+        const std::map<std::string, Policy>::const_iterator it = policies.find(listener);
+
+        return it != policies.end() ? it->second : defaultPolicy;
+    }
+
+    std::size_t OutboundLimiter::getHighWater() const {
+        return highWater;
+    }
+
+    std::size_t OutboundLimiter::getLowWater() const {
+        return lowWater;
+    }
+
+    void OutboundLimiter::check() {
+        const double now = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+        // Indexed access - a connection closed by its policy may compact the registry
+        const MqttModel& mqttModel = MqttModel::instance();
+        for (std::size_t index = 0; index < mqttModel.getClients().size(); ++index) {
+            Mqtt* mqtt = mqttModel.getClients()[index].mqtt;
+
+            if (mqtt != nullptr) {
+                mqtt->checkOutbound(now);
+            }
+        }
+    }
+
+} // namespace mqtt::mqttbroker::lib
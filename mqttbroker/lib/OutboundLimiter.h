@@ -0,0 +1,84 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MQTTBROKER_LIB_OUTBOUNDLIMITER_H
+#define MQTTBROKER_LIB_OUTBOUNDLIMITER_H
+
+namespace mqtt::mqttbroker::lib {
+    class Mqtt;
+} // namespace mqtt::mqttbroker::lib
+
+#include <core/timer/Timer.h>
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+
+#endif
+
+namespace mqtt::mqttbroker::lib {
+
+    /* Outbound high and low water marks of the client connections.
+     *
+     * A timer compares the outbound backlog (bytes queued but not yet written to the socket) of each connection with the water
+     * marks. Once a connection exceeds the high water mark the policy of its listener is applied until the backlog has fallen
+     * below the low water mark again:
+     *   drop-qos0  - messages delivered with QoS 0 are dropped by the connection instead of being sent
+     *   pause      - a persistent session is parked in the offline queue, which replays in order on release; a clean session
+     *                has nowhere to park, its QoS 0 messages are dropped as with drop-qos0
+     *   disconnect - the connection is closed
+     * The subscriptions stay in the broker, thus lifting a policy does not make the broker resend its retained messages. QoS 1
+     * and 2 messages of a connected session are never dropped. Dropped messages are counted per connection. */
+    class OutboundLimiter {
+    private:
+        OutboundLimiter() = default;
+
+    public:
+        enum class Policy : uint8_t { NONE, DROP_QOS0, PAUSE, DISCONNECT };
+
+        OutboundLimiter(const OutboundLimiter&) = delete;
+        OutboundLimiter& operator=(const OutboundLimiter&) = delete;
+
+        static OutboundLimiter& instance();
+
+        // policies: comma separated list of <listener instance>=<policy>, "*" names the default
+        void start(std::size_t highWater, std::size_t lowWater, const std::string& policies, double interval);
+
+        Policy getPolicy(const std::string& listener) const;
+        std::size_t getHighWater() const;
+        std::size_t getLowWater() const;
+
+    private:
+        void check();
+
+        std::size_t highWater = 0;
+        std::size_t lowWater = 0;
+        std::map<std::string, Policy> policies;
+        Policy defaultPolicy = Policy::NONE;
+
+        std::optional<core::timer::Timer> timer;
+    };
+
+} // namespace mqtt::mqttbroker::lib
+
+#endif // MQTTBROKER_LIB_OUTBOUNDLIMITER_H
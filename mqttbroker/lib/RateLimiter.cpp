@@ -0,0 +1,225 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "RateLimiter.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <log/Logger.h>
+
+#endif
+
+namespace mqtt::mqttbroker::lib {
+
+    namespace {
+
+        template <typename Apply>
+        void parseSpec(const std::string& spec, const Apply& apply) {
+            std::size_t begin = 0;
+            while (begin < spec.size()) {
+                const std::size_t end = std::min(spec.find(',', begin), spec.size());
+                const std::string entry = spec.substr(begin, end - begin);
+                const std::size_t separator = entry.find('=');
+
+                if (separator == std::string::npos || !apply(entry.substr(0, separator), entry.substr(separator + 1))) {
+                    LOG(WARNING) << "RateLimiter: Ignoring '" << entry << "'";
+                }
+
+                begin = end + 1;
+            }
+        }
+
+    } // namespace
+
+    bool RateLimiter::Bucket::available(double rate, double amount, double now) {
+        bool available = true;
+
+        if (rate > 0) {
+            tokens = std::min(rate, tokens + (now - updated) * rate);
+            updated = now;
+
+            // A message larger than the burst needs a full bucket and leaves it in debt
+            available = tokens >= std::min(amount, rate);
+        }
+
+        return available;
+    }
+
+    void RateLimiter::Bucket::take(double rate, double amount) {
+        if (rate > 0) {
+            tokens -= amount;
+        }
+    }
+
+    bool RateLimiter::Bucket::take(double rate, double amount, double now) {
+        const bool taken = available(rate, amount, now);
+
+        if (taken) {
+            take(rate, amount);
+        }
+
+        return taken;
+    }
+
+    RateLimiter& RateLimiter::instance() {
+        static RateLimiter rateLimiter;
+
+        return rateLimiter;
+    }
+
+    void RateLimiter::configure(const std::string& clientMessages,
+                                const std::string& clientBytes,
+                                const std::string& listenerMessages,
+                                const std::string& listenerBytes,
+                                const std::string& accepts,
+                                const std::string& actions) {
+        const auto rates = [this](const std::string& spec, double Listener::* rate) -> void {
+            parseSpec(spec, [this, rate](const std::string& instanceName, const std::string& value) -> bool {
+                char* end = nullptr;
+                const double parsed = std::strtod(value.data(), &end);
+
+                const bool valid = end != value.data() && *end == '\0' && parsed >= 0;
+                if (valid) {
+                    listeners[instanceName].*rate = parsed;
+                }
+
+                return valid;
+            });
+        };
+
+        rates(clientMessages, &Listener::clientMessages);
+        rates(clientBytes, &Listener::clientBytes);
+        rates(listenerMessages, &Listener::listenerMessages);
+        rates(listenerBytes, &Listener::listenerBytes);
+        rates(accepts, &Listener::accepts);
+
+        parseSpec(actions, [this](const std::string& instanceName, const std::string& value) -> bool {
+            static const std::map<std::string, Action> actionNames = {
+                {"drop", Action::DROP}, {"delay", Action::DELAY}, {"disconnect", Action::DISCONNECT}};
+
+            const std::map<std::string, Action>::const_iterator action = actionNames.find(value);
+            if (action != actionNames.end()) {
+                listeners[instanceName].action = action->second;
+            }
+
+            return action != actionNames.end();
+        });
+
+        // Limits not configured for an instance are inherited from "*"
+        const Listener defaults = listeners.contains("*") ? listeners["*"] : Listener{};
+        for (auto& [instanceName, listener] : listeners) {
+            for (double Listener::* rate : {&Listener::clientMessages,
+                                            &Listener::clientBytes,
+                                            &Listener::listenerMessages,
+                                            &Listener::listenerBytes,
+                                            &Listener::accepts}) {
+                if (listener.*rate < 0) {
+                    listener.*rate = defaults.*rate;
+                }
+            }
+            if (!listener.action) {
+                listener.action = defaults.action.value_or(Action::DROP);
+            }
+
+            VLOG(1) << "RateLimiter: '" << instanceName << "' client " << listener.clientMessages << " msg/s " << listener.clientBytes
+                    << " B/s, listener " << listener.listenerMessages << " msg/s " << listener.listenerBytes << " B/s, accepts "
+                    << listener.accepts << "/s per source";
+        }
+    }
+
+    RateLimiter::Listener* RateLimiter::listener(const std::string& instanceName) {
+        Listener* listener = nullptr;
+
+        if (!listeners.empty()) {
+            std::map<std::string, Listener>::iterator it = listeners.find(instanceName);
+
+            if (it == listeners.end()) {
+                // First connection of a listener without own limits - it gets its own buckets with the default limits
+                const std::map<std::string, Listener>::const_iterator defaults = listeners.find("*");
+
+                it = listeners.emplace(instanceName, defaults != listeners.end() ? defaults->second : Listener{}).first;
+            }
+
+            listener = &it->second;
+        }
+
+        return listener;
+    }
+
+    bool RateLimiter::accept(Listener& listener, std::string_view sourceAddress) {
+        return listener.sources[std::hash<std::string_view>{}(sourceAddress) % listener.sources.size()].take(listener.accepts, 1, now());
+    }
+
+    bool RateLimiter::accept(const std::string& instanceName, const std::string& remoteAddress) {
+        Listener* rateListener = listener(instanceName);
+
+        bool admitted = true;
+        if (rateListener != nullptr && rateListener->accepts > 0) {
+            // The port differs with each connection - limit by host
+            admitted = accept(*rateListener, std::string_view(remoteAddress).substr(0, remoteAddress.rfind(':')));
+
+            if (!admitted) {
+                LOG(WARNING) << instanceName << ": Connection from '" << remoteAddress << "' refused - accept rate limit";
+            }
+        }
+
+        return admitted;
+    }
+
+    bool RateLimiter::publish(Listener& listener, Client& client, std::size_t bytes) {
+        const bool admitted = available(listener, client, bytes);
+
+        if (admitted) {
+            take(listener, client, bytes);
+        } else {
+            client.limited++;
+        }
+
+        return admitted;
+    }
+
+    // Nothing is taken before all buckets are checked - a publish refused by one bucket does not drain the others
+    bool RateLimiter::available(Listener& listener, Client& client, std::size_t bytes) {
+        const double current = now();
+        const double amount = static_cast<double>(bytes);
+
+        return client.messages.available(listener.clientMessages, 1, current) &&
+               client.bytes.available(listener.clientBytes, amount, current) &&
+               listener.messages.available(listener.listenerMessages, 1, current) &&
+               listener.bytes.available(listener.listenerBytes, amount, current);
+    }
+
+    void RateLimiter::take(Listener& listener, Client& client, std::size_t bytes) {
+        const double amount = static_cast<double>(bytes);
+
+        client.messages.take(listener.clientMessages, 1);
+        client.bytes.take(listener.clientBytes, amount);
+        listener.messages.take(listener.listenerMessages, 1);
+        listener.bytes.take(listener.listenerBytes, amount);
+    }
+
+    double RateLimiter::now() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+} // namespace mqtt::mqttbroker::lib
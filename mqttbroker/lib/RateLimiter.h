@@ -0,0 +1,123 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MQTTBROKER_LIB_RATELIMITER_H
+#define MQTTBROKER_LIB_RATELIMITER_H
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#endif
+
+namespace mqtt::mqttbroker::lib {
+
+    /* Token bucket rate limits of the listener instances.
+     *
+     * Per listener instance (or "*" for all others) the publish rate of each client and of the listener as a whole can be
+     * limited in messages and bytes per second, as well as the rate of accepted connections per source address. Buckets hold
+     * one second worth of tokens as burst and may run into debt by one oversized message. A check is O(1) and allocates
+     * nothing: client buckets live in the connection, listener buckets are created with the first connection of the listener
+     * and source addresses are hashed into a fixed table, thus colliding addresses share a bucket.
+     *
+     * A publish is admitted only if all buckets hold enough tokens. Over a limit it triggers the action of the listener:
+     *   drop       - a QoS 0 publish is neither mapped nor forwarded to other workers, cluster peers or offline queues
+     *   delay      - the publish is mapped and forwarded once the limits admit it, in order with the following ones
+     *   disconnect - the connection is closed
+     * QoS 1 and 2 publishes are delayed by the drop action as well. While publishes are delayed their PUBACK or PUBREC is
+     * withheld until they are released, which closes the inflight window of the client - SNode.C offers a socket context no
+     * way to suspend reading, thus the acknowledgements are the backpressure. QoS 0 publishes have none: beyond the bound of
+     * delayed publishes they are dropped, QoS 1 and 2 publishes of a client ignoring its window close the connection.
+     * The local broker has delivered the publish already in any case. */
+    class RateLimiter {
+    private:
+        RateLimiter() = default;
+
+    public:
+        enum class Action : uint8_t { DROP, DELAY, DISCONNECT };
+
+        class Bucket {
+        public:
+            bool available(double rate, double amount, double now); // refills the bucket, rate <= 0: unlimited
+            void take(double rate, double amount);
+            bool take(double rate, double amount, double now); // available() and take()
+
+        private:
+            double tokens = 0;
+            double updated = 0;
+        };
+
+        struct Client {
+            Bucket messages;
+            Bucket bytes;
+            uint64_t limited = 0; // publishes over a limit
+        };
+
+        struct Listener {
+            double clientMessages = -1; // per second, 0: unlimited, -1: not configured - the default applies
+            double clientBytes = -1;
+            double listenerMessages = -1;
+            double listenerBytes = -1;
+            double accepts = -1;
+            std::optional<Action> action;
+
+            Bucket messages;
+            Bucket bytes;
+            std::array<Bucket, 1024> sources; // accepts per hashed source address
+        };
+
+        RateLimiter(const RateLimiter&) = delete;
+        RateLimiter& operator=(const RateLimiter&) = delete;
+
+        static RateLimiter& instance();
+
+        // Each a comma separated list of <listener instance>=<value>, "*" names the default
+        void configure(const std::string& clientMessages,
+                       const std::string& clientBytes,
+                       const std::string& listenerMessages,
+                       const std::string& listenerBytes,
+                       const std::string& accepts,
+                       const std::string& actions);
+
+        // nullptr if the listener is not limited
+        Listener* listener(const std::string& instanceName);
+
+        bool accept(Listener& listener, std::string_view sourceAddress);
+        // A new MQTT connection of the listener instance from "<host>:<port>" - applied to plain connections when they are
+        // accepted and to WebSocket connections when they are upgraded
+        bool accept(const std::string& instanceName, const std::string& remoteAddress);
+        bool publish(Listener& listener, Client& client, std::size_t bytes);   // available() and take(), counts the limited
+        bool available(Listener& listener, Client& client, std::size_t bytes); // within all limits
+        void take(Listener& listener, Client& client, std::size_t bytes);
+
+    private:
+        static double now();
+
+        std::map<std::string, Listener> listeners; // "*" holds the defaults
+    };
+
+} // namespace mqtt::mqttbroker::lib
+
+#endif // MQTTBROKER_LIB_RATELIMITER_H
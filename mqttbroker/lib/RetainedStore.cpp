@@ -0,0 +1,524 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "RetainedStore.h"
+
+#include "lib/LoopMonitor.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <log/Logger.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#endif
+
+namespace mqtt::mqttbroker::lib {
+
+    namespace {
+
+        // Followed by topic and message - the checksum covers the header behind it and the topic but not the message, thus the
+        // index can be rebuilt without touching the payloads
+        struct RecordHeader {
+            uint32_t checksum;
+            uint32_t messageSize;
+            uint16_t topicSize;
+            uint8_t qoS;
+            uint8_t flags;
+        };
+
+        static_assert(sizeof(RecordHeader) == 12);
+
+        constexpr uint8_t DELETED = 0x01;
+
+        constexpr std::size_t minMappingSize = 1024 * 1024;
+        constexpr std::size_t minCompactSize = 4 * 1024 * 1024;
+        constexpr std::size_t compactBatchSize = 1024 * 1024;
+        constexpr double tickInterval = 0.01;
+
+        uint32_t checksum(const char* data, std::size_t size, uint32_t hash = 2166136261U) {
+            for (std::size_t i = 0; i < size; ++i) {
+                hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619U;
+            }
+
+            return hash;
+        }
+
+        std::string record(const std::string& topic, const std::string& message, uint8_t qoS, uint8_t flags) {
+            RecordHeader header{0, static_cast<uint32_t>(message.size()), static_cast<uint16_t>(topic.size()), qoS, flags};
+
+            std::string record(sizeof(header), '\0');
+            record += topic;
+
+            std::memcpy(record.data(), &header, sizeof(header));
+            header.checksum = checksum(record.data() + sizeof(header.checksum), record.size() - sizeof(header.checksum));
+            std::memcpy(record.data(), &header, sizeof(header));
+
+            record += message;
+
+            return record;
+        }
+
+        bool writeAll(int fd, const std::string& data) {
+            std::size_t written = 0;
+
+            while (written < data.size()) {
+                const ssize_t ret = ::write(fd, data.data() + written, data.size() - written);
+
+                if (ret > 0) {
+                    written += static_cast<std::size_t>(ret);
+                } else if (ret < 0 && errno != EINTR) {
+                    break;
+                }
+            }
+
+            return written == data.size();
+        }
+
+    } // namespace
+
+    RetainedStore::~RetainedStore() {
+        if (mapping != nullptr) {
+            munmap(mapping, mappingSize);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (compactFd >= 0) {
+            close(compactFd);
+            unlink((path + ".compact").data());
+        }
+    }
+
+    RetainedStore& RetainedStore::instance() {
+        static RetainedStore retainedStore;
+
+        return retainedStore;
+    }
+
+    bool RetainedStore::open(const std::string& path) {
+        if (!path.empty() && fd < 0) {
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+            this->path = path;
+
+            fd = ::open(path.data(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+
+            struct stat status{};
+            if (fd >= 0 && fstat(fd, &status) == 0 && map(static_cast<std::size_t>(status.st_size))) {
+                fileSize = static_cast<std::size_t>(status.st_size);
+
+                const std::size_t valid = scan();
+                if (valid < fileSize) {
+                    LOG(WARNING) << "RetainedStore: '" << path << "' truncated after " << valid << " of " << fileSize << " bytes";
+
+                    if (ftruncate(fd, static_cast<off_t>(valid)) != 0) {
+                        PLOG(ERROR) << "RetainedStore: Truncating '" << path << "' failed";
+                    }
+                    fileSize = valid;
+                }
+
+                timer = core::timer::Timer::intervalTimer(
+                    [this]() -> void {
+                        const mqtt::lib::LoopMonitor::Probe probe("timer: retained store");
+
+                        tick();
+                    },
+                    tickInterval);
+
+                VLOG(1) << "RetainedStore: " << index.size() << " retained messages indexed in "
+                        << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s";
+            } else {
+                PLOG(ERROR) << "RetainedStore: Opening '" << path << "' failed";
+
+                if (fd >= 0) {
+                    close(fd);
+                    fd = -1;
+                }
+            }
+        }
+
+        return fd >= 0;
+    }
+
+    bool RetainedStore::isEnabled() const {
+        return fd >= 0;
+    }
+
+    std::size_t RetainedStore::getTopicCount() const {
+        return index.size();
+    }
+
+    bool RetainedStore::map(std::size_t size) {
+        bool mapped = size <= mappingSize;
+
+        if (!mapped) {
+            // Mapped ahead of the end of the file - appended records become visible without remapping
+            const std::size_t newSize = std::max({size, mappingSize * 2, minMappingSize});
+
+            void* newMapping = mapping != nullptr ? mremap(mapping, mappingSize, newSize, MREMAP_MAYMOVE)
+                                                  : mmap(nullptr, newSize, PROT_READ, MAP_SHARED, fd, 0);
+
+            if (newMapping != MAP_FAILED) {
+                mapping = static_cast<char*>(newMapping);
+                mappingSize = newSize;
+                mapped = true;
+            } else {
+                PLOG(ERROR) << "RetainedStore: Mapping " << newSize << " bytes of '" << path << "' failed";
+            }
+        }
+
+        return mapped;
+    }
+
+    bool RetainedStore::read(std::size_t offset, Record& record) const {
+        bool valid = false;
+
+        RecordHeader header{};
+        if (offset + sizeof(header) <= fileSize) {
+            std::memcpy(&header, mapping + offset, sizeof(header));
+
+            record.size = sizeof(header) + header.topicSize + header.messageSize;
+
+            valid = offset + record.size <= fileSize &&
+                    header.checksum == checksum(mapping + offset + sizeof(header.checksum),
+                                                sizeof(header) - sizeof(header.checksum) + header.topicSize);
+
+            if (valid) {
+                record.topic = std::string_view(mapping + offset + sizeof(header), header.topicSize);
+                record.message = std::string_view(mapping + offset + sizeof(header) + header.topicSize, header.messageSize);
+                record.qoS = header.qoS;
+                record.deleted = (header.flags & DELETED) != 0;
+            }
+        }
+
+        return valid;
+    }
+
+    std::size_t RetainedStore::scan() {
+        std::size_t offset = 0;
+
+        Record record{};
+        while (read(offset, record)) {
+            const std::unordered_map<std::string, Entry>::iterator it = index.find(std::string(record.topic));
+
+            if (it != index.end()) {
+                liveBytes -= it->second.size;
+            }
+
+            if (record.deleted) {
+                if (it != index.end()) {
+                    eraseTopic(it->first);
+                    index.erase(it);
+                }
+            } else {
+                const Entry entry{offset, 0, static_cast<uint32_t>(record.size), false};
+
+                if (it != index.end()) {
+                    it->second = entry;
+                } else {
+                    insertTopic(index.emplace(record.topic, entry).first->first);
+                }
+                liveBytes += record.size;
+            }
+
+            offset += record.size;
+        }
+
+        return offset;
+    }
+
+    bool RetainedStore::append(const std::string& data) {
+        const bool appended = writeAll(fd, data);
+
+        if (appended) {
+            fileSize += data.size();
+            map(fileSize);
+        } else {
+            PLOG(ERROR) << "RetainedStore: Appending to '" << path << "' failed";
+
+            if (ftruncate(fd, static_cast<off_t>(fileSize)) != 0) { // keep the file parseable
+                PLOG(ERROR) << "RetainedStore: Truncating '" << path << "' failed";
+            }
+        }
+
+        return appended;
+    }
+
+    bool RetainedStore::retain(const std::string& topic, const std::string& message, uint8_t qoS, bool brokerRetained) {
+        bool stored = false;
+
+        if (fd >= 0 && topic.size() <= UINT16_MAX && message.size() <= UINT32_MAX - UINT16_MAX - sizeof(RecordHeader)) {
+            std::unordered_map<std::string, Entry>::iterator it = index.find(topic);
+
+            if (it != index.end()) {
+                liveBytes -= it->second.size;
+                brokerRetained = brokerRetained || it->second.brokerRetained;
+            }
+
+            if (message.empty()) {
+                if (it != index.end()) {
+                    append(record(topic, message, qoS, DELETED));
+
+                    eraseTopic(topic);
+                    index.erase(it);
+                }
+                stored = true;
+            } else {
+                const uint64_t offset = fileSize;
+                const std::string data = record(topic, message, qoS, 0);
+
+                if (append(data)) {
+                    if (it == index.end()) {
+                        it = index.emplace(topic, Entry{}).first;
+                        insertTopic(it->first);
+                    }
+
+                    it->second = Entry{offset, 0, static_cast<uint32_t>(data.size()), brokerRetained};
+                    liveBytes += data.size();
+
+                    stored = true;
+                } else if (it != index.end()) {
+                    eraseTopic(topic);
+                    index.erase(it);
+                }
+            }
+        }
+
+        return brokerRetained || !stored;
+    }
+
+    void RetainedStore::subscribed(const std::string& filter, const Deliver& deliver) const {
+        if (fd >= 0) {
+            std::string topic;
+
+            matchTopics(topics, filter, topic, [this, &deliver](const std::string& topic) -> void {
+                const std::unordered_map<std::string, Entry>::const_iterator it = index.find(topic);
+
+                Record record{};
+                if (it != index.end() && !it->second.brokerRetained && read(it->second.offset, record)) {
+                    deliver(topic, std::string(record.message), record.qoS);
+                }
+            });
+        }
+    }
+
+    void RetainedStore::insertTopic(const std::string& topic) {
+        Level* level = &topics;
+
+        std::size_t begin = 0;
+        for (std::size_t end = topic.find('/'); begin <= topic.size(); end = topic.find('/', begin)) {
+            end = std::min(end, topic.size());
+
+            std::unique_ptr<Level>& child = level->children[topic.substr(begin, end - begin)];
+            if (!child) {
+                child = std::make_unique<Level>();
+            }
+            level = child.get();
+
+            begin = end + 1;
+        }
+
+        level->topic = true;
+    }
+
+    void RetainedStore::eraseTopic(const std::string& topic) {
+        eraseTopic(topics, topic);
+    }
+
+    // Returns whether the level has become empty and is to be removed by the caller
+    bool RetainedStore::eraseTopic(Level& level, std::string_view topic) {
+        const std::size_t end = std::min(topic.find('/'), topic.size());
+
+        const std::map<std::string, std::unique_ptr<Level>, std::less<>>::iterator it = level.children.find(topic.substr(0, end));
+
+        if (it != level.children.end()) {
+            const bool empty = end < topic.size() ? eraseTopic(*it->second, topic.substr(end + 1))
+                                                  : (it->second->topic = false, it->second->children.empty());
+
+            if (empty) {
+                level.children.erase(it);
+            }
+        }
+
+        return !level.topic && level.children.empty();
+    }
+
+    // topic holds the levels matched so far, each followed by a '/'
+    void RetainedStore::matchTopics(const Level& level,
+                                    std::string_view filter,
+                                    std::string& topic,
+                                    const std::function<void(const std::string& topic)>& onMatch) {
+        const std::size_t end = std::min(filter.find('/'), filter.size());
+        const std::string_view filterLevel = filter.substr(0, end);
+        const bool last = end == filter.size();
+        const std::size_t size = topic.size();
+
+        // Wildcards at the first level do not match topics starting with '$'
+        const auto visible = [size](const std::string& name) -> bool {
+            return size > 0 || !name.starts_with('$');
+        };
+
+        const auto descend = [&filter, &topic, &onMatch, end, last, size](const std::string_view name, const Level& child) -> void {
+            topic.append(name);
+            if (last) {
+                if (child.topic) {
+                    onMatch(topic);
+                }
+            } else {
+                topic.append("/");
+                matchTopics(child, filter.substr(end + 1), topic, onMatch);
+            }
+            topic.resize(size);
+        };
+
+        if (filterLevel == "#") {
+            // "a/#" matches "a" too
+            if (size > 0 && level.topic) {
+                topic.pop_back();
+                onMatch(topic);
+                topic.push_back('/');
+            }
+
+            for (const auto& [name, child] : level.children) {
+                if (visible(name)) {
+                    topic.append(name);
+                    allTopics(*child, topic, onMatch);
+                    topic.resize(size);
+                }
+            }
+        } else if (filterLevel == "+") {
+            for (const auto& [name, child] : level.children) {
+                if (visible(name)) {
+                    descend(name, *child);
+                }
+            }
+        } else {
+            const std::map<std::string, std::unique_ptr<Level>, std::less<>>::const_iterator it = level.children.find(filterLevel);
+
+            if (it != level.children.end()) {
+                descend(filterLevel, *it->second);
+            }
+        }
+    }
+
+    void RetainedStore::allTopics(const Level& level, std::string& topic, const std::function<void(const std::string& topic)>& onMatch) {
+        if (level.topic) {
+            onMatch(topic);
+        }
+
+        const std::size_t size = topic.size();
+
+        for (const auto& [name, child] : level.children) {
+            topic.append("/").append(name);
+            allTopics(*child, topic, onMatch);
+            topic.resize(size);
+        }
+    }
+
+    void RetainedStore::tick() {
+        if (compactFd >= 0) {
+            compactStep();
+        } else if (fileSize > minCompactSize && liveBytes * 2 < fileSize) {
+            compactFd = ::open((path + ".compact").data(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+            compactCursor = 0;
+            compactSize = 0;
+            compactStart = fileSize;
+
+            if (compactFd < 0) {
+                PLOG(ERROR) << "RetainedStore: Creating '" << path << ".compact' failed";
+            }
+        }
+    }
+
+    void RetainedStore::compactStep() {
+        std::string batch;
+
+        Record record{};
+        while (compactCursor < fileSize && batch.size() < compactBatchSize && read(compactCursor, record)) {
+            if (!record.deleted) {
+                const std::unordered_map<std::string, Entry>::iterator it = index.find(std::string(record.topic));
+
+                // Only the latest record of a topic is live - records appended meanwhile are reached by the cursor later
+                if (it != index.end() && it->second.offset == compactCursor) {
+                    it->second.compactedOffset = compactSize + batch.size();
+                    batch.append(mapping + compactCursor, record.size);
+                }
+            } else if (compactCursor >= compactStart) {
+                // A deletion during the compaction may hit a record already copied
+                batch.append(mapping + compactCursor, record.size);
+            }
+
+            compactCursor += record.size;
+        }
+
+        if (writeAll(compactFd, batch)) {
+            compactSize += batch.size();
+
+            if (compactCursor >= fileSize) {
+                finishCompaction();
+            }
+        } else {
+            PLOG(ERROR) << "RetainedStore: Writing '" << path << ".compact' failed";
+
+            close(compactFd);
+            compactFd = -1;
+            unlink((path + ".compact").data());
+        }
+    }
+
+    void RetainedStore::finishCompaction() {
+        if (fdatasync(compactFd) == 0 && rename((path + ".compact").data(), path.data()) == 0) {
+            const std::size_t oldSize = fileSize;
+
+            munmap(mapping, mappingSize);
+            mapping = nullptr;
+            mappingSize = 0;
+
+            close(fd);
+            fd = compactFd;
+            fileSize = compactSize;
+
+            for (auto& [topic, entry] : index) {
+                entry.offset = entry.compactedOffset;
+            }
+
+            if (!map(fileSize)) {
+                close(fd);
+                fd = -1;
+            }
+
+            VLOG(1) << "RetainedStore: Compacted from " << oldSize << " to " << fileSize << " bytes";
+        } else {
+            PLOG(ERROR) << "RetainedStore: Replacing '" << path << "' by its compacted copy failed";
+
+            close(compactFd);
+            unlink((path + ".compact").data());
+        }
+
+        compactFd = -1;
+    }
+
+} // namespace mqtt::mqttbroker::lib
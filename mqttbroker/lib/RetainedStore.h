@@ -0,0 +1,143 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MQTTBROKER_LIB_RETAINEDSTORE_H
+#define MQTTBROKER_LIB_RETAINEDSTORE_H
+
+#include <core/timer/Timer.h>
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#endif
+
+namespace mqtt::mqttbroker::lib {
+
+    /* Persistent store of retained messages.
+     *
+     * Retained publishes are appended to one payload file which is mmap'ed read only, an in-memory index maps each topic to the
+     * offset of its latest record. On start only the record headers and topics are scanned to rebuild the index - payloads stay
+     * untouched in the page cache until they are needed.
+     *
+     * The store delivers the retained messages to a new subscription itself, directly to the subscribing connection: a trie of
+     * the topic levels of the stored topics yields the topics matching the topic filter without looking at the others. The broker
+     * is kept free of them. Only a retained publish of a client is stored by the broker as well, which can not be prevented -
+     * such a topic is marked, delivered by the broker and kept up to date in the broker.
+     *
+     * Records superseded by a newer message or a deletion (empty message) are garbage. When it makes up more than half of the
+     * file, the live records are copied to a new file step by step from a timer and the files are swapped once the copy has
+     * caught up with the end of the old file. */
+    class RetainedStore {
+    private:
+        RetainedStore() = default;
+
+    public:
+        using Deliver = std::function<void(const std::string& topic, const std::string& message, uint8_t qoS)>;
+
+        RetainedStore(const RetainedStore&) = delete;
+        RetainedStore& operator=(const RetainedStore&) = delete;
+
+        ~RetainedStore();
+
+        static RetainedStore& instance();
+
+        // Called once after core::SNodeC::init()
+        bool open(const std::string& path);
+        bool isEnabled() const;
+
+        // brokerRetained: the broker has retained the publish already. Returns whether the broker has to retain it (as well) - if
+        // it holds an older message of the topic or the store is not able to take it.
+        bool retain(const std::string& topic, const std::string& message, uint8_t qoS, bool brokerRetained);
+
+        // Delivers the stored messages matching the filter which the broker does not deliver by itself
+        void subscribed(const std::string& filter, const Deliver& deliver) const;
+
+        std::size_t getTopicCount() const;
+
+    private:
+        struct Entry {
+            uint64_t offset;
+            uint64_t compactedOffset;
+            uint32_t size;
+            bool brokerRetained;
+        };
+
+        struct Record {
+            std::string_view topic;
+            std::string_view message;
+            uint8_t qoS;
+            bool deleted;
+            std::size_t size;
+        };
+
+        // Topic levels of the stored topics
+        struct Level {
+            std::map<std::string, std::unique_ptr<Level>, std::less<>> children;
+            bool topic = false; // a stored topic ends here
+        };
+
+        bool map(std::size_t size);
+        std::size_t scan();
+        bool read(std::size_t offset, Record& record) const;
+
+        bool append(const std::string& data);
+
+        void insertTopic(const std::string& topic);
+        void eraseTopic(const std::string& topic);
+        static bool eraseTopic(Level& level, std::string_view topic);
+        static void matchTopics(const Level& level,
+                                std::string_view filter,
+                                std::string& topic,
+                                const std::function<void(const std::string& topic)>& onMatch);
+        static void allTopics(const Level& level, std::string& topic, const std::function<void(const std::string& topic)>& onMatch);
+
+        void tick();
+        void compactStep();
+        void finishCompaction();
+
+        std::string path;
+        int fd = -1;
+        char* mapping = nullptr;
+        std::size_t mappingSize = 0;
+        std::size_t fileSize = 0;
+        std::size_t liveBytes = 0;
+
+        std::unordered_map<std::string, Entry> index;
+        Level topics;
+
+        int compactFd = -1;
+        std::size_t compactCursor = 0;
+        std::size_t compactSize = 0;
+        std::size_t compactStart = 0; // file size when the compaction started
+
+        std::optional<core::timer::Timer> timer;
+    };
+
+} // namespace mqtt::mqttbroker::lib
+
+#endif // MQTTBROKER_LIB_RETAINEDSTORE_H
@@ -0,0 +1,207 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SessionHandover.h"
+
+#include "Cluster.h"
+#include "Metrics.h"
+#include "Mqtt.h"
+#include "MqttModel.h"
+#include "OfflineQueue.h"
+#include "SessionJournal.h"
+#include "SharedSubscriptions.h"
+
+#include <iot/mqtt/server/broker/Broker.h>
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <log/Logger.h>
+
+#endif
+
+#ifndef SUBSCRIBTION_MAX_QOS
+#define SUBSCRIBTION_MAX_QOS 2
+#endif
+
+namespace mqtt::mqttbroker::lib {
+
+    SessionHandover::SessionHandover()
+        : broker(iot::mqtt::server::broker::Broker::instance(SUBSCRIBTION_MAX_QOS)) {
+    }
+
+    SessionHandover& SessionHandover::instance() {
+        static SessionHandover sessionHandover;
+
+        return sessionHandover;
+    }
+
+    uint64_t SessionHandover::claim(const std::string& clientId, bool cleanSession) {
+        ShardBus& shardBus = ShardBus::instance();
+
+        uint64_t epoch = 0;
+
+        if (shardBus.isEnabled()) {
+            epoch = shardBus.nextEpoch();
+
+            if (cleanSession) {
+                epochs.erase(clientId);
+            } else {
+                epochs[clientId] = epoch;
+            }
+
+            if (!shardBus.control(ShardBus::Control::CLAIM, shardBus.getWorkers(), epoch, clientId, "", "", cleanSession ? 1 : 0)) {
+                LOG(WARNING) << "SessionHandover: Claiming '" << clientId << "' failed - the ring of this worker is full";
+            }
+        }
+
+        return epoch;
+    }
+
+    void SessionHandover::received(ShardBus::Control control,
+                                   std::size_t from,
+                                   uint64_t epoch,
+                                   const std::string& clientId,
+                                   const std::string& topic,
+                                   const std::string& message,
+                                   uint8_t qoS) {
+        switch (control) {
+            case ShardBus::Control::CLAIM:
+                claimed(from, epoch, clientId, qoS != 0);
+                break;
+            case ShardBus::Control::SUBSCRIPTION:
+                adopt(epoch, clientId, topic, qoS);
+                break;
+            case ShardBus::Control::QUEUED:
+                deliver(epoch, clientId, topic, message, qoS);
+                break;
+            case ShardBus::Control::ANNOUNCE:
+            case ShardBus::Control::GROUPS:
+            case ShardBus::Control::SHARED:
+                // Dispatched by the ShardBus to the Cluster and the SharedSubscriptions
+                break;
+        }
+    }
+
+    void SessionHandover::claimed(std::size_t from, uint64_t epoch, const std::string& clientId, bool cleanSession) {
+        const MqttModel::Client* client = MqttModel::instance().findClient(clientId);
+        Mqtt* mqtt = client != nullptr ? client->mqtt : nullptr;
+
+        const std::unordered_map<std::string, uint64_t>::iterator it = epochs.find(clientId);
+
+        // A newer connection to this worker wins - its own claim closes the connection of the claiming worker
+        const uint64_t localEpoch = mqtt != nullptr ? mqtt->getEpoch() : it != epochs.end() ? it->second : 0;
+
+        if (localEpoch < epoch) {
+            if (mqtt != nullptr) {
+                LOG(INFO) << "SessionHandover: '" << clientId << "' connected to worker " << from << " - taking the connection over";
+
+                mqtt->handOver();
+            }
+
+            if (it != epochs.end()) {
+                epochs.erase(it);
+
+                handOver(from, epoch, clientId, cleanSession);
+            }
+        }
+    }
+
+    void SessionHandover::handOver(std::size_t to, uint64_t epoch, const std::string& clientId, bool cleanSession) {
+        Metrics& metrics = Metrics::instance();
+        ShardBus& shardBus = ShardBus::instance();
+
+        std::size_t handedOver = 0;
+
+        for (const auto& [filter, qoS] : metrics.getSubscriptions(clientId)) {
+            broker->unsubscribe(clientId, filter);
+
+            // Shared subscriptions do not outlast their connection
+            if (!cleanSession && !SharedSubscriptions::isShared(filter)) {
+                if (shardBus.control(ShardBus::Control::SUBSCRIPTION, to, epoch, clientId, filter, "", qoS)) {
+                    handedOver++;
+                } else {
+                    LOG(WARNING) << "SessionHandover: Subscription '" << filter << "' of '" << clientId << "' lost - ring full";
+                }
+            }
+        }
+
+        for (const std::string& filter : metrics.clearSubscriptions(clientId)) {
+            Cluster::instance().unsubscribed(filter);
+        }
+        metrics.session(clientId, true);
+
+        SessionJournal::instance().cleared(clientId);
+
+        if (cleanSession) {
+            OfflineQueue::instance().cleared(clientId);
+        } else {
+            OfflineQueue::instance().handOver(
+                clientId, [to, epoch, clientId](const std::string& topic, const std::string& message, uint8_t qoS) -> bool {
+                    return ShardBus::instance().control(ShardBus::Control::QUEUED, to, epoch, clientId, topic, message, qoS);
+                });
+        }
+
+        VLOG(1) << "SessionHandover: Session '" << clientId << "' handed over to worker " << to << " - " << handedOver
+                << " subscriptions";
+    }
+
+    void SessionHandover::adopt(uint64_t epoch, const std::string& clientId, const std::string& filter, uint8_t qoS) {
+        Mqtt* mqtt = connection(epoch, clientId);
+
+        const std::unordered_map<std::string, uint64_t>::const_iterator it = epochs.find(clientId);
+
+        if (mqtt != nullptr) {
+            mqtt->adoptSubscription(filter, qoS);
+        } else if (it != epochs.end() && it->second == epoch) {
+            // Disconnected meanwhile - the session is offline on this worker now
+            SessionJournal::instance().subscribed(clientId, filter, qoS);
+
+            if (OfflineQueue::instance().isEnabled()) {
+                OfflineQueue::instance().subscribed(clientId, filter, qoS);
+                OfflineQueue::instance().park(clientId, nullptr);
+            } else {
+                broker->subscribe(clientId, filter, qoS);
+            }
+
+            if (Metrics::instance().subscribe(clientId, filter, qoS)) {
+                Cluster::instance().subscribed(filter);
+            }
+        }
+    }
+
+    void SessionHandover::deliver(
+        uint64_t epoch, const std::string& clientId, const std::string& topic, const std::string& message, uint8_t qoS) {
+        Mqtt* mqtt = connection(epoch, clientId);
+
+        const std::unordered_map<std::string, uint64_t>::const_iterator it = epochs.find(clientId);
+
+        if (mqtt != nullptr) {
+            mqtt->sendPublish(topic, message, qoS, false);
+        } else if (it != epochs.end() && it->second == epoch) {
+            OfflineQueue::instance().queued(clientId, topic, message, qoS);
+        }
+    }
+
+    Mqtt* SessionHandover::connection(uint64_t epoch, const std::string& clientId) const {
+        const MqttModel::Client* client = MqttModel::instance().findClient(clientId);
+
+        return client != nullptr && client->mqtt != nullptr && client->mqtt->getEpoch() == epoch ? client->mqtt : nullptr;
+    }
+
+} // namespace mqtt::mqttbroker::lib
@@ -0,0 +1,91 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MQTTBROKER_LIB_SESSIONHANDOVER_H
+#define MQTTBROKER_LIB_SESSIONHANDOVER_H
+
+#include "ShardBus.h"
+
+namespace mqtt::mqttbroker::lib {
+    class Mqtt;
+} // namespace mqtt::mqttbroker::lib
+
+namespace iot::mqtt::server::broker {
+    class Broker;
+} // namespace iot::mqtt::server::broker
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#endif
+
+namespace mqtt::mqttbroker::lib {
+
+    /* Keeps each client id owned by one worker of a broker started with --workers N.
+     *
+     * The kernel spreads the connections over the workers, thus a client may reconnect to another worker than the one holding its
+     * session. Each CONNECT is therefore claimed on the ShardBus with an epoch from a bus wide counter. A worker with an older
+     * connection of the client id closes it - the session takeover of MQTT across workers. A worker holding an older persistent
+     * session hands it to the claiming worker and forgets it: the subscriptions right away, the messages of its offline queue
+     * streamed behind them. A clean session claim only makes the other workers forget the session. */
+    class SessionHandover {
+    private:
+        SessionHandover();
+
+    public:
+        SessionHandover(const SessionHandover&) = delete;
+        SessionHandover& operator=(const SessionHandover&) = delete;
+
+        static SessionHandover& instance();
+
+        // Called on CONNECT - returns the epoch of the connection, 0 without ShardBus
+        uint64_t claim(const std::string& clientId, bool cleanSession);
+
+        // Control records of the other workers
+        void received(ShardBus::Control control,
+                      std::size_t from,
+                      uint64_t epoch,
+                      const std::string& clientId,
+                      const std::string& topic,
+                      const std::string& message,
+                      uint8_t qoS);
+
+    private:
+        void claimed(std::size_t from, uint64_t epoch, const std::string& clientId, bool cleanSession);
+        void handOver(std::size_t to, uint64_t epoch, const std::string& clientId, bool cleanSession);
+
+        void adopt(uint64_t epoch, const std::string& clientId, const std::string& filter, uint8_t qoS);
+        void deliver(uint64_t epoch, const std::string& clientId, const std::string& topic, const std::string& message, uint8_t qoS);
+
+        // The connection of the claim if still connected to this worker
+        Mqtt* connection(uint64_t epoch, const std::string& clientId) const;
+
+        std::unordered_map<std::string, uint64_t> epochs; // client id -> epoch of the persistent session held by this worker
+
+        std::shared_ptr<iot::mqtt::server::broker::Broker> broker;
+    };
+
+} // namespace mqtt::mqttbroker::lib
+
+#endif // MQTTBROKER_LIB_SESSIONHANDOVER_H
@@ -0,0 +1,395 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SessionJournal.h"
+
+#include "Cluster.h"
+#include "Metrics.h"
+#include "OfflineQueue.h"
+#include "lib/LoopMonitor.h"
+
+#include <iot/mqtt/server/broker/Broker.h>
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <log/Logger.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#endif
+
+#ifndef SUBSCRIBTION_MAX_QOS
+#define SUBSCRIBTION_MAX_QOS 2
+#endif
+
+namespace mqtt::mqttbroker::lib {
+
+    namespace {
+
+        // Followed by client id and topic - the checksum covers everything behind it
+        struct RecordHeader {
+            uint32_t checksum;
+            uint16_t clientIdSize;
+            uint16_t topicSize;
+            uint8_t op;
+            uint8_t qoS;
+            uint16_t reserved;
+        };
+
+        static_assert(sizeof(RecordHeader) == 12);
+
+        constexpr std::size_t minCompactSize = 1024 * 1024;
+
+        uint32_t checksum(const char* data, std::size_t size, uint32_t hash = 2166136261U) {
+            for (std::size_t i = 0; i < size; ++i) {
+                hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619U;
+            }
+
+            return hash;
+        }
+
+        std::string record(uint8_t op, const std::string& clientId, const std::string& topic, uint8_t qoS) {
+            RecordHeader header{0, static_cast<uint16_t>(clientId.size()), static_cast<uint16_t>(topic.size()), op, qoS, 0};
+
+            std::string record(sizeof(header), '\0');
+            record += clientId;
+            record += topic;
+
+            std::memcpy(record.data(), &header, sizeof(header));
+            header.checksum = checksum(record.data() + sizeof(header.checksum), record.size() - sizeof(header.checksum));
+            std::memcpy(record.data(), &header, sizeof(header));
+
+            return record;
+        }
+
+        bool writeAll(int fd, const std::string& data) {
+            std::size_t written = 0;
+
+            while (written < data.size()) {
+                const ssize_t ret = ::write(fd, data.data() + written, data.size() - written);
+
+                if (ret > 0) {
+                    written += static_cast<std::size_t>(ret);
+                } else if (ret < 0 && errno != EINTR) {
+                    break;
+                }
+            }
+
+            return written == data.size();
+        }
+
+    } // namespace
+
+    SessionJournal::~SessionJournal() {
+        if (fd >= 0) {
+            fdatasync(fd);
+            close(fd);
+        }
+    }
+
+    SessionJournal& SessionJournal::instance() {
+        static SessionJournal sessionJournal;
+
+        return sessionJournal;
+    }
+
+    bool SessionJournal::open(const std::string& path, double syncInterval) {
+        if (!path.empty() && fd < 0) {
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+            this->path = path;
+
+            snapshotSize = load(path + ".snapshot");
+            load(path + ".wal.1");
+            logSize = load(path + ".wal");
+
+            fd = ::open((path + ".wal").data(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+
+            if (fd < 0) {
+                PLOG(ERROR) << "SessionJournal: Opening '" << path << ".wal' failed";
+            } else {
+                if (ftruncate(fd, static_cast<off_t>(logSize)) != 0) { // cut off a torn last record
+                    PLOG(ERROR) << "SessionJournal: Truncating '" << path << ".wal' failed";
+                }
+
+                restore();
+
+                syncTimer = core::timer::Timer::intervalTimer(
+                    [this]() -> void {
+                        const mqtt::lib::LoopMonitor::Probe probe("timer: session journal");
+
+                        sync();
+                        reap();
+
+                        if (logSize > std::max(minCompactSize, snapshotSize)) {
+                            compact();
+                        }
+                    },
+                    syncInterval);
+
+                VLOG(1) << "SessionJournal: " << sessions.size() << " persistent sessions restored in "
+                        << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s";
+            }
+        }
+
+        return fd >= 0;
+    }
+
+    bool SessionJournal::isEnabled() const {
+        return fd >= 0;
+    }
+
+    std::size_t SessionJournal::getSessionCount() const {
+        return sessions.size();
+    }
+
+    std::size_t SessionJournal::load(const std::string& file) {
+        std::size_t valid = 0;
+
+        const int loadFd = ::open(file.data(), O_RDONLY | O_CLOEXEC);
+
+        struct stat status{};
+        if (loadFd >= 0 && fstat(loadFd, &status) == 0 && status.st_size > 0) {
+            const std::size_t size = static_cast<std::size_t>(status.st_size);
+
+            void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, loadFd, 0);
+
+            if (data != MAP_FAILED) {
+                madvise(data, size, MADV_SEQUENTIAL);
+
+                valid = replay(static_cast<const char*>(data), size);
+                if (valid < size) {
+                    LOG(WARNING) << "SessionJournal: '" << file << "' truncated after " << valid << " of " << size << " bytes";
+                }
+
+                munmap(data, size);
+            } else {
+                PLOG(ERROR) << "SessionJournal: Mapping '" << file << "' failed";
+            }
+        } else if (loadFd < 0 && errno != ENOENT) {
+            PLOG(ERROR) << "SessionJournal: Opening '" << file << "' failed";
+        }
+
+        if (loadFd >= 0) {
+            close(loadFd);
+        }
+
+        return valid;
+    }
+
+    std::size_t SessionJournal::replay(const char* data, std::size_t size) {
+        std::size_t offset = 0;
+
+        while (offset + sizeof(RecordHeader) <= size) {
+            RecordHeader header{};
+            std::memcpy(&header, data + offset, sizeof(header));
+
+            const std::size_t recordSize = sizeof(header) + header.clientIdSize + header.topicSize;
+
+            if (offset + recordSize > size ||
+                header.checksum != checksum(data + offset + sizeof(header.checksum), recordSize - sizeof(header.checksum))) {
+                break;
+            }
+
+            const char* clientId = data + offset + sizeof(header);
+            apply(static_cast<Op>(header.op),
+                  std::string(clientId, header.clientIdSize),
+                  std::string(clientId + header.clientIdSize, header.topicSize),
+                  header.qoS);
+
+            offset += recordSize;
+        }
+
+        return offset;
+    }
+
+    bool SessionJournal::apply(Op op, const std::string& clientId, const std::string& topic, uint8_t qoS) {
+        bool changed = false;
+
+        switch (op) {
+            case Op::SUBSCRIBE: {
+                const auto [it, inserted] = sessions[clientId].try_emplace(topic, qoS);
+
+                changed = inserted || it->second != qoS;
+                it->second = qoS;
+                break;
+            }
+            case Op::UNSUBSCRIBE: {
+                const std::unordered_map<std::string, std::map<std::string, uint8_t>>::iterator it = sessions.find(clientId);
+
+                if (it != sessions.end()) {
+                    changed = it->second.erase(topic) > 0;
+
+                    if (it->second.empty()) {
+                        sessions.erase(it);
+                    }
+                }
+                break;
+            }
+            case Op::CLEAR:
+                changed = sessions.erase(clientId) > 0;
+                break;
+        }
+
+        return changed;
+    }
+
+    void SessionJournal::restore() {
+        broker = iot::mqtt::server::broker::Broker::instance(SUBSCRIBTION_MAX_QOS);
+
+        OfflineQueue& offlineQueue = OfflineQueue::instance();
+
+        for (const auto& [clientId, topics] : sessions) {
+            for (const auto& [topic, qoS] : topics) {
+                // With offline queues the restored sessions are parked right away instead
+                if (offlineQueue.isEnabled()) {
+                    offlineQueue.subscribed(clientId, topic, qoS);
+                } else {
+                    broker->subscribe(clientId, topic, qoS);
+                }
+
+                if (Metrics::instance().subscribe(clientId, topic, qoS)) {
+                    Cluster::instance().subscribed(topic);
+                }
+            }
+
+            offlineQueue.park(clientId, nullptr);
+        }
+    }
+
+    void SessionJournal::subscribed(const std::string& clientId, const std::string& topic, uint8_t qoS) {
+        append(Op::SUBSCRIBE, clientId, topic, qoS);
+    }
+
+    void SessionJournal::unsubscribed(const std::string& clientId, const std::string& topic) {
+        append(Op::UNSUBSCRIBE, clientId, topic, 0);
+    }
+
+    void SessionJournal::cleared(const std::string& clientId) {
+        append(Op::CLEAR, clientId, "", 0);
+    }
+
+    void SessionJournal::append(Op op, const std::string& clientId, const std::string& topic, uint8_t qoS) {
+        if (fd >= 0 && clientId.size() <= UINT16_MAX && topic.size() <= UINT16_MAX && apply(op, clientId, topic, qoS)) {
+            const std::string data = record(static_cast<uint8_t>(op), clientId, topic, qoS);
+
+            if (writeAll(fd, data)) {
+                logSize += data.size();
+                dirty = true;
+            } else {
+                PLOG(ERROR) << "SessionJournal: Appending to '" << path << ".wal' failed";
+            }
+        }
+    }
+
+    void SessionJournal::sync() {
+        if (dirty) {
+            if (fdatasync(fd) != 0) {
+                PLOG(ERROR) << "SessionJournal: Syncing '" << path << ".wal' failed";
+            }
+
+            dirty = false;
+        }
+    }
+
+    void SessionJournal::compact() {
+        if (compactor < 0) {
+            // A left over rotated log is not yet covered by a snapshot - keep it and let the next snapshot cover both
+            if (access((path + ".wal.1").data(), F_OK) != 0) {
+                if (rename((path + ".wal").data(), (path + ".wal.1").data()) == 0) {
+                    close(fd);
+
+                    fd = ::open((path + ".wal").data(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+                    logSize = 0;
+
+                    if (fd < 0) {
+                        PLOG(ERROR) << "SessionJournal: Reopening '" << path << ".wal' failed - journal disabled";
+                    }
+                } else {
+                    PLOG(ERROR) << "SessionJournal: Rotating '" << path << ".wal' failed";
+                }
+            }
+
+            compactor = fork();
+
+            if (compactor == 0) {
+                const bool written = writeSnapshot(path + ".snapshot");
+
+                if (written) {
+                    unlink((path + ".wal.1").data());
+                }
+
+                _exit(written ? 0 : 1);
+            } else if (compactor < 0) {
+                PLOG(ERROR) << "SessionJournal: Forking the compactor failed";
+            }
+        }
+    }
+
+    bool SessionJournal::writeSnapshot(const std::string& file) const {
+        bool written = false;
+
+        FILE* snapshot = std::fopen((file + ".tmp").data(), "w");
+
+        if (snapshot != nullptr) {
+            bool ok = true;
+
+            for (const auto& [clientId, topics] : sessions) {
+                for (const auto& [topic, qoS] : topics) {
+                    const std::string data = record(static_cast<uint8_t>(Op::SUBSCRIBE), clientId, topic, qoS);
+
+                    ok = ok && std::fwrite(data.data(), 1, data.size(), snapshot) == data.size();
+                }
+            }
+
+            ok = ok && std::fflush(snapshot) == 0 && fdatasync(fileno(snapshot)) == 0;
+            ok = std::fclose(snapshot) == 0 && ok;
+
+            written = ok && std::rename((file + ".tmp").data(), file.data()) == 0;
+        }
+
+        return written;
+    }
+
+    void SessionJournal::reap() {
+        int status = 0;
+
+        if (compactor > 0 && waitpid(compactor, &status, WNOHANG) == compactor) {
+            compactor = -1;
+
+            struct stat snapshotStatus{};
+            if (WIFEXITED(status) && WEXITSTATUS(status) == 0 && stat((path + ".snapshot").data(), &snapshotStatus) == 0) {
+                snapshotSize = static_cast<std::size_t>(snapshotStatus.st_size);
+
+                VLOG(1) << "SessionJournal: Snapshot of " << snapshotSize << " bytes written";
+            } else {
+                LOG(ERROR) << "SessionJournal: Writing the snapshot '" << path << ".snapshot' failed";
+            }
+        }
+    }
+
+} // namespace mqtt::mqttbroker::lib
@@ -0,0 +1,109 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MQTTBROKER_LIB_SESSIONJOURNAL_H
+#define MQTTBROKER_LIB_SESSIONJOURNAL_H
+
+namespace iot::mqtt::server::broker {
+    class Broker;
+} // namespace iot::mqtt::server::broker
+
+#include <core/timer/Timer.h>
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+
+#endif
+
+namespace mqtt::mqttbroker::lib {
+
+    /* Crash safe store of the subscriptions of persistent (clean session = false) sessions.
+     *
+     * Each mutation is appended as checksummed record to "<path>.wal" when it happens. The log is fdatasync'ed by a timer every
+     * syncInterval seconds if it has grown, which bounds the window of mutations a power loss can lose. A process crash loses
+     * nothing. When the log outgrows the last snapshot, it is rotated to "<path>.wal.1" and a forked child writes the copy on
+     * write image of the in-memory state to "<path>.snapshot" and removes the rotated log - the event loop never blocks on a
+     * snapshot.
+     *
+     * On start the snapshot, a possibly left over rotated log and the log are mmap'ed and replayed in that order (replaying a
+     * log suffix twice is harmless as all operations are absolute), a torn record at the end of the log is cut off and the
+     * sessions are subscribed in the broker again, which keeps them as offline sessions queueing messages until the clients
+     * reconnect. */
+    class SessionJournal {
+    private:
+        SessionJournal() = default;
+
+    public:
+        SessionJournal(const SessionJournal&) = delete;
+        SessionJournal& operator=(const SessionJournal&) = delete;
+
+        ~SessionJournal();
+
+        static SessionJournal& instance();
+
+        // Called once after core::SNodeC::init()
+        bool open(const std::string& path, double syncInterval);
+        bool isEnabled() const;
+
+        void subscribed(const std::string& clientId, const std::string& topic, uint8_t qoS);
+        void unsubscribed(const std::string& clientId, const std::string& topic);
+        void cleared(const std::string& clientId);
+
+        std::size_t getSessionCount() const;
+
+    private:
+        enum class Op : uint8_t { SUBSCRIBE = 1, UNSUBSCRIBE = 2, CLEAR = 3 };
+
+        std::size_t load(const std::string& file);
+        std::size_t replay(const char* data, std::size_t size);
+        bool apply(Op op, const std::string& clientId, const std::string& topic, uint8_t qoS); // true if the state changed
+        void restore();
+
+        void append(Op op, const std::string& clientId, const std::string& topic, uint8_t qoS);
+        void sync();
+
+        void compact();
+        bool writeSnapshot(const std::string& file) const;
+        void reap();
+
+        std::string path;
+        int fd = -1;
+
+        std::size_t logSize = 0;
+        std::size_t snapshotSize = 0;
+        bool dirty = false;
+        pid_t compactor = -1;
+
+        std::unordered_map<std::string, std::map<std::string, uint8_t>> sessions; // client id -> topic filter -> qos
+
+        std::shared_ptr<iot::mqtt::server::broker::Broker> broker;
+        std::optional<core::timer::Timer> syncTimer;
+    };
+
+} // namespace mqtt::mqttbroker::lib
+
+#endif // MQTTBROKER_LIB_SESSIONJOURNAL_H
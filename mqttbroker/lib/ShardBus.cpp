@@ -0,0 +1,438 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ShardBus.h"
+
+#include "Cluster.h"
+#include "Fanout.h"
+#include "Metrics.h"
+#include "SessionHandover.h"
+#include "SharedSubscriptions.h"
+#include "lib/LoopMonitor.h"
+
+#include <core/eventreceiver/ReadEventReceiver.h>
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <algorithm>
+#include <cstring>
+#include <log/Logger.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#endif
+
+namespace mqtt::mqttbroker::lib {
+
+    namespace {
+
+        // Each record starts 8 byte aligned with this header, followed by topic and message
+        struct RecordHeader {
+            uint32_t size; // topic + message bytes
+            uint16_t topicSize;
+            uint8_t qoS;
+            uint8_t flags;
+        };
+
+        constexpr uint8_t RETAIN = 0x01;
+        constexpr uint8_t WRAP = 0x02;    // no record until the end of the ring - continue at its start
+        constexpr uint8_t CONTROL = 0x04; // the topic is a client id, the message starts with a ControlHeader
+
+        // Followed by topic and message of the control record
+        struct ControlHeader {
+            uint64_t epoch;
+            uint32_t topicSize;
+            uint16_t to;
+            uint8_t control;
+            uint8_t qoS;
+        };
+
+        constexpr std::size_t maxRecordsPerDrain = 1024;
+
+        std::size_t align(std::size_t size) {
+            return (size + 7) & ~static_cast<std::size_t>(7);
+        }
+
+        static_assert(sizeof(RecordHeader) == 8);
+        static_assert(sizeof(ControlHeader) == 16);
+        static_assert(std::atomic<uint64_t>::is_always_lock_free, "ShardBus rings need lock-free 64 bit atomics");
+
+    } // namespace
+
+    class ShardBus::Doorbell : public core::eventreceiver::ReadEventReceiver {
+    public:
+        explicit Doorbell(int eventFd)
+            : core::eventreceiver::ReadEventReceiver("ShardBus", core::DescriptorEventReceiver::TIMEOUT::DISABLE) {
+            enable(eventFd);
+        }
+
+    private:
+        void readEvent() final {
+            const mqtt::lib::LoopMonitor::Probe probe("shard bus");
+
+            ShardBus::instance().wake();
+
+            // Deliveries of handed over sessions are no fan-out of a publish
+            Metrics::instance().fanoutMark();
+        }
+
+        void unobservedEvent() final {
+            delete this;
+        }
+    };
+
+    ShardBus::~ShardBus() {
+        if (mapping != nullptr) {
+            munmap(mapping, mappingSize);
+        }
+
+        for (const int eventFd : doorbells) {
+            close(eventFd);
+        }
+    }
+
+    ShardBus& ShardBus::instance() {
+        static ShardBus shardBus;
+
+        return shardBus;
+    }
+
+    bool ShardBus::create(std::size_t workers, std::size_t ringSize) {
+        // Ring size must be a power of two and hold at least a maximum sized topic
+        std::size_t size = 131072;
+        while (size < ringSize) {
+            size <<= 1;
+        }
+
+        const std::size_t rings = workers;
+        const std::size_t stride = (1 + workers) * sizeof(Cursor) + size;
+
+        mappingSize = sizeof(Shared) + workers * sizeof(Member) + rings * stride;
+        mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+        if (mapping == MAP_FAILED) {
+            PLOG(ERROR) << "ShardBus: Creating shared memory of " << mappingSize << " bytes failed";
+
+            mapping = nullptr;
+            mappingSize = 0;
+        } else {
+            this->workers = workers;
+            this->ringSize = size;
+
+            shared = new (mapping) Shared{};
+
+            members = reinterpret_cast<Member*>(shared + 1);
+            for (std::size_t index = 0; index < workers; ++index) {
+                new (members + index) Member{};
+                members[index].alive.store(1);
+            }
+
+            for (std::size_t index = 0; index < rings; ++index) {
+                Cursor* cursors = ring(index).tail;
+
+                for (std::size_t cursor = 0; cursor < 1 + workers; ++cursor) {
+                    new (cursors + cursor) Cursor{};
+                }
+            }
+
+            for (std::size_t index = 0; index < workers && doorbells.size() == index; ++index) {
+                const int eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+                if (eventFd >= 0) {
+                    doorbells.push_back(eventFd);
+                } else {
+                    PLOG(ERROR) << "ShardBus: Creating the doorbell of worker " << index << " failed";
+                }
+            }
+
+            if (doorbells.size() < workers) {
+                munmap(mapping, mappingSize);
+                mapping = nullptr;
+                mappingSize = 0;
+            } else {
+                VLOG(1) << "ShardBus: " << rings << " rings of " << size << " bytes for " << workers << " workers";
+            }
+        }
+
+        return mapping != nullptr;
+    }
+
+    void ShardBus::start(std::size_t worker) {
+        if (mapping != nullptr && doorbell == nullptr) {
+            this->worker = worker;
+
+            if (members[worker].alive.load() == 0) {
+                // Restarted after a crash - the records missed meanwhile are skipped
+                for (std::size_t from = 0; from < workers; ++from) {
+                    if (from != worker) {
+                        const Ring fromRing = ring(from);
+
+                        fromRing.heads[worker].position.store(fromRing.tail->position.load());
+                    }
+                }
+
+                members[worker].alive.store(1);
+
+                LOG(INFO) << "ShardBus: Worker " << worker << " rejoined";
+            }
+
+            doorbell = new Doorbell(doorbells[worker]);
+
+            // Drains what is pending already and goes to sleep
+            wake();
+        }
+    }
+
+    void ShardBus::retire(std::size_t worker) {
+        if (mapping != nullptr && worker < workers) {
+            members[worker].alive.store(0);
+            members[worker].waiting.store(0);
+        }
+    }
+
+    void ShardBus::wake() {
+        eventfd_t value = 0;
+        eventfd_read(doorbells[worker], &value);
+
+        bool pending = false;
+        for (std::size_t from = 0; from < workers; ++from) {
+            if (from != worker) {
+                pending = drain(from, ring(from)) || pending;
+            }
+        }
+
+        if (!pending) {
+            members[worker].waiting.store(1);
+
+            // A record pushed before the flag became visible did not ring - look once more
+            for (std::size_t from = 0; from < workers && !pending; ++from) {
+                if (from != worker) {
+                    const Ring fromRing = ring(from);
+
+                    pending = fromRing.tail->position.load() != fromRing.heads[worker].position.load(std::memory_order_relaxed);
+                }
+            }
+
+            if (pending) {
+                members[worker].waiting.store(0);
+            }
+        }
+
+        if (pending) {
+            // Continue in the next event loop iteration instead of starving the connections of this worker
+            eventfd_write(doorbells[worker], 1);
+        }
+    }
+
+    void ShardBus::ringDoorbell(std::size_t to) {
+        if (members[to].waiting.load() != 0 && members[to].waiting.exchange(0) != 0) {
+            eventfd_write(doorbells[to], 1);
+        }
+    }
+
+    bool ShardBus::isEnabled() const {
+        return mapping != nullptr;
+    }
+
+    std::size_t ShardBus::getWorker() const {
+        return worker;
+    }
+
+    std::size_t ShardBus::getWorkers() const {
+        return workers;
+    }
+
+    uint64_t ShardBus::nextEpoch() {
+        return shared->epoch.fetch_add(1) + 1;
+    }
+
+    uint64_t ShardBus::getDropped() const {
+        return dropped;
+    }
+
+    ShardBus::Ring ShardBus::ring(std::size_t from) const {
+        // Rings of the producing workers laid out consecutively
+        char* base = reinterpret_cast<char*>(members + workers) + from * ((1 + workers) * sizeof(Cursor) + ringSize);
+
+        return Ring{reinterpret_cast<Cursor*>(base), reinterpret_cast<Cursor*>(base) + 1, base + (1 + workers) * sizeof(Cursor)};
+    }
+
+    void ShardBus::forward(const std::string& topic, const std::string& message, uint8_t qoS, bool retain) {
+        if (mapping != nullptr) {
+            if (push(ring(worker), topic, message, qoS, retain ? RETAIN : 0)) {
+                ringDoorbells();
+            } else if (dropped++ % 1000 == 0) {
+                LOG(WARNING) << "ShardBus: Ring of worker " << worker << " full - publish dropped (" << dropped << " in total)";
+            }
+        }
+    }
+
+    bool ShardBus::control(Control control,
+                           std::size_t to,
+                           uint64_t epoch,
+                           const std::string& clientId,
+                           const std::string& topic,
+                           const std::string& message,
+                           uint8_t qoS) {
+        bool pushed = false;
+
+        if (mapping != nullptr && topic.size() <= UINT32_MAX) {
+            const ControlHeader controlHeader{
+                epoch, static_cast<uint32_t>(topic.size()), static_cast<uint16_t>(to), static_cast<uint8_t>(control), qoS};
+
+            std::string data(sizeof(controlHeader), '\0');
+            std::memcpy(data.data(), &controlHeader, sizeof(controlHeader));
+            data += topic;
+            data += message;
+
+            pushed = push(ring(worker), clientId, data, 0, CONTROL);
+
+            if (pushed) {
+                ringDoorbells();
+            }
+        }
+
+        return pushed;
+    }
+
+    void ShardBus::ringDoorbells() {
+        for (std::size_t to = 0; to < workers; ++to) {
+            if (to != worker) {
+                ringDoorbell(to);
+            }
+        }
+    }
+
+    bool ShardBus::push(const Ring& ring, const std::string& topic, const std::string& message, uint8_t qoS, uint8_t flags) {
+        const std::size_t size = topic.size() + message.size();
+        const std::size_t recordSize = sizeof(RecordHeader) + align(size);
+
+        uint64_t tail = ring.tail->position.load(std::memory_order_relaxed);
+
+        // The slowest living reader bounds the free space
+        uint64_t head = tail;
+        for (std::size_t to = 0; to < workers; ++to) {
+            if (to != worker && members[to].alive.load() != 0) {
+                head = std::min(head, ring.heads[to].position.load(std::memory_order_acquire));
+            }
+        }
+
+        std::size_t offset = tail & (ringSize - 1);
+        const std::size_t contiguous = ringSize - offset;
+        const std::size_t needed = recordSize + (contiguous < recordSize ? contiguous : 0);
+
+        bool pushed = false;
+
+        if (recordSize <= ringSize && topic.size() <= UINT16_MAX && needed <= ringSize - (tail - head)) {
+            if (contiguous < recordSize) {
+                const RecordHeader wrap{0, 0, 0, WRAP};
+                std::memcpy(ring.data + offset, &wrap, sizeof(wrap));
+
+                tail += contiguous;
+                offset = 0;
+            }
+
+            const RecordHeader recordHeader{static_cast<uint32_t>(size), static_cast<uint16_t>(topic.size()), qoS, flags};
+
+            std::memcpy(ring.data + offset, &recordHeader, sizeof(recordHeader));
+            std::memcpy(ring.data + offset + sizeof(recordHeader), topic.data(), topic.size());
+            std::memcpy(ring.data + offset + sizeof(recordHeader) + topic.size(), message.data(), message.size());
+
+            // Sequentially consistent - ordered before reading the sleep flags of the consumers
+            ring.tail->position.store(tail + recordSize);
+
+            pushed = true;
+        }
+
+        return pushed;
+    }
+
+    bool ShardBus::drain(std::size_t from, const Ring& ring) {
+        std::atomic<uint64_t>& ownHead = ring.heads[worker].position;
+
+        uint64_t head = ownHead.load(std::memory_order_relaxed);
+        const uint64_t tail = ring.tail->position.load(std::memory_order_acquire);
+
+        std::string topic;
+        std::string message;
+
+        for (std::size_t records = 0; head != tail && records < maxRecordsPerDrain; ++records) {
+            const std::size_t offset = head & (ringSize - 1);
+
+            RecordHeader recordHeader{};
+            std::memcpy(&recordHeader, ring.data + offset, sizeof(recordHeader));
+
+            if ((recordHeader.flags & WRAP) != 0) {
+                head += ringSize - offset;
+            } else {
+                const char* payload = ring.data + offset + sizeof(recordHeader);
+
+                topic.assign(payload, recordHeader.topicSize);
+                message.assign(payload + recordHeader.topicSize, recordHeader.size - recordHeader.topicSize);
+
+                // The record is copied out - release its space before publishing
+                head += sizeof(RecordHeader) + align(recordHeader.size);
+                ownHead.store(head, std::memory_order_release);
+
+                if ((recordHeader.flags & CONTROL) == 0) {
+                    Fanout::instance().publish(
+                        Fanout::Origin::WORKER, "", topic, message, recordHeader.qoS, (recordHeader.flags & RETAIN) != 0);
+                } else {
+                    dispatch(from, topic, message);
+                }
+            }
+        }
+
+        ownHead.store(head, std::memory_order_release);
+
+        return head != tail;
+    }
+
+    void ShardBus::dispatch(std::size_t from, const std::string& clientId, const std::string& data) {
+        ControlHeader controlHeader{};
+        std::memcpy(&controlHeader, data.data(), sizeof(controlHeader));
+
+        if (controlHeader.to == worker || controlHeader.to == workers) {
+            const Control control = static_cast<Control>(controlHeader.control);
+
+            if (control == Control::ANNOUNCE) {
+                Cluster::instance().announced(clientId, controlHeader.qoS != 0, data.substr(sizeof(controlHeader)));
+            } else if (control == Control::GROUPS) {
+                SharedSubscriptions::instance().received(from, clientId, controlHeader.qoS, data.substr(sizeof(controlHeader)));
+            } else if (control == Control::SHARED) {
+                SharedSubscriptions::instance().deliver(Cluster::instance().getOrigin(),
+                                                        clientId,
+                                                        static_cast<std::size_t>(controlHeader.epoch),
+                                                        data.substr(sizeof(controlHeader), controlHeader.topicSize),
+                                                        data.substr(sizeof(controlHeader) + controlHeader.topicSize),
+                                                        controlHeader.qoS);
+            } else {
+                SessionHandover::instance().received(control,
+                                                     from,
+                                                     controlHeader.epoch,
+                                                     clientId,
+                                                     data.substr(sizeof(controlHeader), controlHeader.topicSize),
+                                                     data.substr(sizeof(controlHeader) + controlHeader.topicSize),
+                                                     controlHeader.qoS);
+            }
+        }
+    }
+
+} // namespace mqtt::mqttbroker::lib
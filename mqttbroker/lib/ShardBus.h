@@ -0,0 +1,147 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MQTTBROKER_LIB_SHARDBUS_H
+#define MQTTBROKER_LIB_SHARDBUS_H
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#endif
+
+namespace mqtt::mqttbroker::lib {
+
+    /* Forwards publishes between the worker processes of a broker started with --workers N.
+     *
+     * The bus is one shared anonymous mapping created before the workers are forked. It holds one lock-free single producer
+     * multiple consumer ring per worker. A publish received by a worker is encoded once into the ring of that worker and read
+     * by all other workers, each advancing its own head. Space is reclaimed once the slowest reader has passed it, thus the
+     * heads act as reference count of the records. Each worker drains the rings of all other workers and injects the publishes
+     * into its local broker. Retained messages and subscriptions therefore need no partitioning: every worker stores all
+     * retained messages and serves its own subscribers.
+     *
+     * An idle worker sleeps in its event loop on an eventfd. It announces this with a flag in the mapping and the producer of a
+     * record only rings the eventfds of workers announcing to sleep, thus a busy bus exchanges records without system calls.
+     *
+     * Besides publishes the rings carry control records addressed to one or all workers: the session ownership records of the
+     * SessionHandover, the filter announcements of cluster peers, the shared subscription groups and the publishes placed on a
+     * member of a shared subscription on another worker.
+     *
+     * The workers are forked by a supervisor which restarts a crashed worker with the same index. A worker which has ended, crashed
+     * or not, is retired: its heads no longer bound the free space of the rings. A restarted worker skips the records it missed. */
+    class ShardBus {
+    private:
+        ShardBus() = default;
+
+    public:
+        enum class Control : uint8_t { CLAIM = 1, SUBSCRIPTION = 2, QUEUED = 3, ANNOUNCE = 4, GROUPS = 5, SHARED = 6 };
+
+        ShardBus(const ShardBus&) = delete;
+        ShardBus& operator=(const ShardBus&) = delete;
+
+        ~ShardBus();
+
+        static ShardBus& instance();
+
+        // Called once in the supervisor before forking
+        bool create(std::size_t workers, std::size_t ringSize);
+
+        // Called in the supervisor when a worker has ended - before it is restarted
+        void retire(std::size_t worker);
+
+        // Called in each worker after core::SNodeC::init()
+        void start(std::size_t worker);
+
+        bool isEnabled() const;
+        std::size_t getWorker() const;
+        std::size_t getWorkers() const;
+
+        void forward(const std::string& topic, const std::string& message, uint8_t qoS, bool retain);
+
+        // Addressed to worker "to", to == getWorkers() addresses all other workers - false if the ring is full
+        bool control(Control control,
+                     std::size_t to,
+                     uint64_t epoch,
+                     const std::string& clientId,
+                     const std::string& topic,
+                     const std::string& message,
+                     uint8_t qoS);
+
+        // Bus wide increasing - orders the connections of all workers
+        uint64_t nextEpoch();
+
+        uint64_t getDropped() const;
+
+    private:
+        class Doorbell;
+
+        struct alignas(64) Cursor {
+            std::atomic<uint64_t> position;
+        };
+
+        // At the start of the mapping
+        struct alignas(64) Shared {
+            std::atomic<uint64_t> epoch;
+        };
+
+        // In the mapping in front of the rings, one per worker
+        struct alignas(64) Member {
+            std::atomic<uint32_t> alive;   // the worker consumes - cleared by the supervisor when it has died
+            std::atomic<uint32_t> waiting; // the worker waits for its doorbell
+        };
+
+        // In the mapping: tail (written by the producer), one head per worker (each written by that consumer), data
+        struct Ring {
+            Cursor* tail;
+            Cursor* heads;
+            char* data;
+        };
+
+        Ring ring(std::size_t from) const;
+
+        bool push(const Ring& ring, const std::string& topic, const std::string& message, uint8_t qoS, uint8_t flags);
+        void ringDoorbells();
+        bool drain(std::size_t from, const Ring& ring); // true if records are left
+        void dispatch(std::size_t from, const std::string& clientId, const std::string& data);
+        void wake();
+        void ringDoorbell(std::size_t to);
+
+        void* mapping = nullptr;
+        std::size_t mappingSize = 0;
+
+        std::size_t workers = 0;
+        std::size_t ringSize = 0;
+        std::size_t worker = 0;
+
+        Shared* shared = nullptr;
+        Member* members = nullptr;
+        std::vector<int> doorbells; // eventfd of each worker
+        Doorbell* doorbell = nullptr;
+
+        uint64_t dropped = 0;
+    };
+
+} // namespace mqtt::mqttbroker::lib
+
+#endif // MQTTBROKER_LIB_SHARDBUS_H
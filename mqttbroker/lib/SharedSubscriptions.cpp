@@ -0,0 +1,403 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SharedSubscriptions.h"
+
+#include "Cluster.h"
+#include "Mqtt.h"
+#include "ShardBus.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <algorithm>
+#include <charconv>
+#include <functional>
+#include <log/Logger.h>
+#include <string_view>
+#include <system_error>
+
+#endif
+
+namespace mqtt::mqttbroker::lib {
+
+    namespace {
+
+        const std::string sharePrefix = "$share/";
+
+    } // namespace
+
+    SharedSubscriptions& SharedSubscriptions::instance() {
+        static SharedSubscriptions sharedSubscriptions;
+
+        return sharedSubscriptions;
+    }
+
+    bool SharedSubscriptions::parse(const std::string& name, std::string& group, std::string& filter) {
+        bool shared = false;
+
+        if (name.starts_with(sharePrefix)) {
+            const std::size_t slash = name.find('/', sharePrefix.size());
+
+            if (slash != std::string::npos && slash > sharePrefix.size() && slash + 1 < name.size()) {
+                group = name.substr(sharePrefix.size(), slash - sharePrefix.size());
+                filter = name.substr(slash + 1);
+
+                shared = group.find_first_of("+#") == std::string::npos;
+            }
+        }
+
+        return shared;
+    }
+
+    bool SharedSubscriptions::isShared(const std::string& name) {
+        std::string group;
+        std::string filter;
+
+        return parse(name, group, filter);
+    }
+
+    void SharedSubscriptions::configure(const std::string& strategies) {
+        static const std::map<std::string, Strategy> strategyNames = {
+            {"round-robin", Strategy::ROUND_ROBIN}, {"least-inflight", Strategy::LEAST_INFLIGHT}, {"sticky", Strategy::STICKY}};
+
+        std::size_t begin = 0;
+        while (begin < strategies.size()) {
+            const std::size_t end = std::min(strategies.find(',', begin), strategies.size());
+            const std::string entry = strategies.substr(begin, end - begin);
+            const std::size_t separator = entry.find('=');
+
+            const std::map<std::string, Strategy>::const_iterator strategy =
+                separator != std::string::npos ? strategyNames.find(entry.substr(separator + 1)) : strategyNames.end();
+
+            if (strategy == strategyNames.end()) {
+                LOG(WARNING) << "SharedSubscriptions: Ignoring strategy '" << entry << "'";
+            } else if (entry.substr(0, separator) == "*") {
+                defaultStrategy = strategy->second;
+            } else {
+                this->strategies[entry.substr(0, separator)] = strategy->second;
+            }
+
+            begin = end + 1;
+        }
+
+        // A restarted worker drops the groups of its predecessor at its siblings and asks for theirs
+        origin = Cluster::instance().getOrigin();
+        announce(ShardBus::instance().getWorkers(), JOIN, "");
+    }
+
+    void SharedSubscriptions::subscribe(Mqtt* mqtt, const std::string& name, uint8_t qoS) {
+        Group* group = findGroup(name, true);
+
+        if (group != nullptr) {
+            const std::vector<Member>::iterator member =
+                std::find_if(group->members.begin(), group->members.end(), [mqtt](const Member& candidate) -> bool {
+                    return candidate.mqtt == mqtt;
+                });
+
+            if (member != group->members.end()) {
+                member->qoS = qoS;
+            } else {
+                group->members.push_back({mqtt, qoS});
+                memberships[mqtt].push_back(name);
+
+                setCount(origin, name, group->members.size());
+                announce(name, group->members.size());
+
+                VLOG(1) << "SharedSubscriptions: Group '" << name << "' has " << group->members.size() << " members on this worker";
+            }
+        }
+    }
+
+    void SharedSubscriptions::unsubscribe(Mqtt* mqtt, const std::string& name) {
+        Group* group = findGroup(name, false);
+
+        if (group != nullptr) {
+            std::vector<Member>& members = group->members;
+
+            const std::vector<Member>::iterator member =
+                std::find_if(members.begin(), members.end(), [mqtt](const Member& candidate) -> bool {
+                    return candidate.mqtt == mqtt;
+                });
+
+            if (member != members.end()) {
+                members.erase(member);
+
+                std::vector<std::string>& names = memberships[mqtt];
+                names.erase(std::find(names.begin(), names.end(), name));
+                if (names.empty()) {
+                    memberships.erase(mqtt);
+                }
+
+                const std::size_t count = members.size();
+
+                setCount(origin, name, count); // the group is gone if this was its last member anywhere
+                announce(name, count);
+            }
+        }
+    }
+
+    void SharedSubscriptions::unsubscribe(Mqtt* mqtt) {
+        const std::unordered_map<Mqtt*, std::vector<std::string>>::iterator it = memberships.find(mqtt);
+
+        if (it != memberships.end()) {
+            const std::vector<std::string> names = it->second; // unsubscribe() edits the memberships
+
+            for (const std::string& name : names) {
+                unsubscribe(mqtt, name);
+            }
+        }
+    }
+
+    void SharedSubscriptions::publish(const std::string& topic, const std::string& message, uint8_t qoS) {
+        if (!groups.empty()) {
+            struct Placement {
+                std::string target;
+                std::string name;
+                std::size_t offset;
+            };
+
+            std::vector<Placement> placements;
+
+            filters.match(topic, [this, &topic, &placements](const std::string& filter) -> void {
+                for (auto& [groupName, group] : groups[filter]) {
+                    std::size_t total = 0;
+                    for (const auto& [memberOrigin, count] : group.counts) {
+                        total += count;
+                    }
+
+                    // In the members of all workers, ordered by origin - the same order on every worker
+                    std::size_t offset =
+                        group.strategy == Strategy::STICKY ? std::hash<std::string>{}(topic) % total : group.turn++ % total;
+
+                    std::map<std::string, std::size_t>::const_iterator target = group.counts.begin();
+                    while (offset >= target->second) {
+                        offset -= target->second;
+                        ++target;
+                    }
+
+                    placements.push_back({target->first, sharePrefix + groupName + "/" + filter, offset});
+                }
+            });
+
+            // Delivered once all are placed - a failed send may disconnect a member and change the groups
+            for (const Placement& placement : placements) {
+                deliver(placement.target, placement.name, placement.offset, topic, message, qoS);
+            }
+        }
+    }
+
+    void SharedSubscriptions::deliver(const std::string& target,
+                                      const std::string& name,
+                                      std::size_t offset,
+                                      const std::string& topic,
+                                      const std::string& message,
+                                      uint8_t qoS) {
+        const std::size_t slash = target.rfind('/');
+        const std::string_view targetNode = std::string_view(target).substr(0, slash != std::string::npos ? slash : 0);
+
+        if (target == origin) {
+            Group* group = findGroup(name, false);
+
+            if (group != nullptr && !group->members.empty()) {
+                uint8_t memberQoS = 0;
+                Mqtt* mqtt = select(*group, offset, memberQoS);
+
+                mqtt->sendPublish(topic, message, std::min(qoS, memberQoS), false);
+            } else {
+                VLOG(1) << "SharedSubscriptions: Publish on '" << topic << "' lost - group '" << name << "' left meanwhile";
+            }
+        } else if (targetNode == Cluster::instance().getNodeName()) {
+            std::size_t worker = 0;
+            std::from_chars(target.data() + slash + 1, target.data() + target.size(), worker);
+
+            if (!ShardBus::instance().control(ShardBus::Control::SHARED, worker, offset, name, topic, message, qoS)) {
+                VLOG(1) << "SharedSubscriptions: Publish on '" << topic << "' for worker " << worker << " lost - the ring is full";
+            }
+        } else {
+            Cluster::instance().share(target, name, offset, topic, message, qoS);
+        }
+    }
+
+    Mqtt* SharedSubscriptions::select(Group& group, std::size_t offset, uint8_t& qoS) {
+        const std::size_t size = group.members.size();
+        std::size_t index = offset % size; // the member count may have changed since the publish was placed
+
+        if (group.strategy == Strategy::LEAST_INFLIGHT) {
+            // Scan from the last position, thus idle members share the load evenly
+            std::size_t leastBacklog = SIZE_MAX;
+
+            for (std::size_t scanned = 0; scanned < size; ++scanned) {
+                const std::size_t candidate = (group.next + scanned) % size;
+                const std::size_t backlog = group.members[candidate].mqtt->getOutboundBacklog();
+
+                if (backlog < leastBacklog) {
+                    leastBacklog = backlog;
+                    index = candidate;
+                }
+            }
+            group.next = index + 1;
+        }
+
+        qoS = group.members[index].qoS;
+
+        return group.members[index].mqtt;
+    }
+
+    SharedSubscriptions::Group* SharedSubscriptions::findGroup(const std::string& name, bool create) {
+        std::string groupName;
+        std::string filter;
+
+        Group* group = nullptr;
+
+        if (parse(name, groupName, filter)) {
+            std::unordered_map<std::string, std::map<std::string, Group>>::iterator filterIt = groups.find(filter);
+
+            if (filterIt == groups.end() && create) {
+                filters.insert(filter);
+                filterIt = groups.try_emplace(filter).first;
+            }
+
+            if (filterIt != groups.end()) {
+                std::map<std::string, Group>::iterator groupIt = filterIt->second.find(groupName);
+
+                if (groupIt == filterIt->second.end() && create) {
+                    const std::map<std::string, Strategy>::const_iterator strategy = strategies.find(groupName);
+
+                    groupIt = filterIt->second.try_emplace(groupName).first;
+                    groupIt->second.strategy = strategy != strategies.end() ? strategy->second : defaultStrategy;
+                }
+
+                if (groupIt != filterIt->second.end()) {
+                    group = &groupIt->second;
+                }
+            }
+        }
+
+        return group;
+    }
+
+    void SharedSubscriptions::setCount(const std::string& origin, const std::string& name, std::size_t count) {
+        Group* group = findGroup(name, count > 0);
+
+        if (group != nullptr) {
+            if (count > 0) {
+                group->counts[origin] = count;
+            } else {
+                group->counts.erase(origin);
+            }
+
+            if (group->counts.empty()) {
+                std::string groupName;
+                std::string filter;
+                parse(name, groupName, filter);
+
+                const std::unordered_map<std::string, std::map<std::string, Group>>::iterator filterIt = groups.find(filter);
+                filterIt->second.erase(groupName);
+
+                if (filterIt->second.empty()) {
+                    groups.erase(filterIt);
+                    filters.erase(filter);
+                }
+            }
+        }
+    }
+
+    std::string SharedSubscriptions::list() const {
+        std::string list;
+
+        for (const auto& [filter, filterGroups] : groups) {
+            for (const auto& [groupName, group] : filterGroups) {
+                if (!group.members.empty()) {
+                    list += std::to_string(group.members.size()) + " " + sharePrefix + groupName + "/" + filter + "\n";
+                }
+            }
+        }
+
+        return list;
+    }
+
+    void SharedSubscriptions::announce(std::size_t to, Kind kind, const std::string& counts) const {
+        ShardBus& shardBus = ShardBus::instance();
+
+        if (shardBus.isEnabled() && !shardBus.control(ShardBus::Control::GROUPS, to, 0, origin, "", counts, kind)) {
+            LOG(WARNING) << "SharedSubscriptions: Announcing the groups of '" << origin << "' failed - the ring of this worker is full";
+        }
+    }
+
+    void SharedSubscriptions::announce(const std::string& name, std::size_t count) const {
+        announce(ShardBus::instance().getWorkers(), DELTA, std::to_string(count) + " " + name + "\n");
+
+        Cluster::instance().groupsChanged();
+    }
+
+    void SharedSubscriptions::apply(const std::string& origin, bool full, const std::string& counts) {
+        std::set<std::string>& names = originNames[origin];
+
+        if (full) {
+            for (const std::string& name : names) {
+                setCount(origin, name, 0);
+            }
+            names.clear();
+        }
+
+        std::size_t begin = 0;
+        while (begin < counts.size()) {
+            const std::size_t end = std::min(counts.find('\n', begin), counts.size());
+            const std::size_t space = std::min(counts.find(' ', begin), end);
+
+            std::size_t count = 0;
+            const std::from_chars_result parsed = std::from_chars(counts.data() + begin, counts.data() + space, count);
+            const std::string name = counts.substr(std::min(space + 1, end), end - std::min(space + 1, end));
+
+            if (parsed.ec == std::errc() && parsed.ptr == counts.data() + space && isShared(name)) {
+                setCount(origin, name, count);
+
+                if (count > 0) {
+                    names.insert(name);
+                } else {
+                    names.erase(name);
+                }
+            }
+
+            begin = end + 1;
+        }
+
+        if (names.empty()) {
+            originNames.erase(origin);
+        }
+    }
+
+    void SharedSubscriptions::announced(const std::string& origin, const std::string& counts) {
+        apply(origin, true, counts);
+
+        ShardBus& shardBus = ShardBus::instance();
+        if (shardBus.isEnabled() && !shardBus.control(ShardBus::Control::GROUPS, shardBus.getWorkers(), 0, origin, "", counts, FULL)) {
+            LOG(WARNING) << "SharedSubscriptions: Relaying the groups of '" << origin << "' failed - the ring of this worker is full";
+        }
+    }
+
+    void SharedSubscriptions::received(std::size_t from, const std::string& origin, uint8_t kind, const std::string& counts) {
+        apply(origin, kind != DELTA, counts);
+
+        if (kind == JOIN) {
+            announce(from, FULL, list());
+        }
+    }
+
+} // namespace mqtt::mqttbroker::lib
@@ -0,0 +1,137 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MQTTBROKER_LIB_SHAREDSUBSCRIPTIONS_H
+#define MQTTBROKER_LIB_SHAREDSUBSCRIPTIONS_H
+
+#include "TopicFilterTrie.h"
+
+namespace mqtt::mqttbroker::lib {
+    class Mqtt;
+} // namespace mqtt::mqttbroker::lib
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#endif
+
+namespace mqtt::mqttbroker::lib {
+
+    /* Shared subscriptions "$share/<group>/<filter>".
+     *
+     * The connections subscribed to the same group and filter form a consumer group: each matching publish is delivered to
+     * exactly one of its members instead of to all of them. Shared subscriptions are not handed to the broker. They last as long
+     * as the connection of the member and retained messages are not delivered to them.
+     *
+     * A group may have members on several workers and cluster nodes. Each worker announces the number of members it has of
+     * each group: to its siblings over the ShardBus and to the peer nodes over the cluster links, which relay them to their
+     * workers. Thus every worker knows the members of all workers "<node>/<worker>", ordered by origin. A publish is placed
+     * once, by the worker it enters the broker at, in this global member list by the strategy of the group:
+     *   round-robin    - the members in turn
+     *   least-inflight - the workers in turn, the worker delivers to its member with the smallest outbound backlog
+     *   sticky         - by hash of the topic, thus all publishes of a topic go to the same member while the group is stable
+     * The publish is then delivered to that member: directly, over the ShardBus by the sibling worker or over the cluster link
+     * by the worker of the peer node owning it. Publishes forwarded by other workers or peer nodes are never placed again.
+     * While an announcement is on its way a publish may be placed on a member which has left meanwhile - it is lost then. */
+    class SharedSubscriptions {
+    private:
+        SharedSubscriptions() = default;
+
+    public:
+        enum class Strategy : uint8_t { ROUND_ROBIN, LEAST_INFLIGHT, STICKY };
+
+        SharedSubscriptions(const SharedSubscriptions&) = delete;
+        SharedSubscriptions& operator=(const SharedSubscriptions&) = delete;
+
+        static SharedSubscriptions& instance();
+
+        // Splits "$share/<group>/<filter>" - false if name is not a shared subscription
+        static bool parse(const std::string& name, std::string& group, std::string& filter);
+        static bool isShared(const std::string& name);
+
+        // strategies: comma separated list of <group>=<strategy>, "*" names the default
+        void configure(const std::string& strategies);
+
+        void subscribe(Mqtt* mqtt, const std::string& name, uint8_t qoS);
+        void unsubscribe(Mqtt* mqtt, const std::string& name);
+        void unsubscribe(Mqtt* mqtt);
+
+        // A publish entering the broker at this worker - placed on one member of each matching group
+        void publish(const std::string& topic, const std::string& message, uint8_t qoS);
+        // Delivers a placed publish to the member at offset in the members of the group on worker "<node>/<worker>" target
+        void deliver(const std::string& target,
+                     const std::string& name,
+                     std::size_t offset,
+                     const std::string& topic,
+                     const std::string& message,
+                     uint8_t qoS);
+
+        // "<members> <name>" lines of the groups with members on this worker
+        std::string list() const;
+
+        // Members of the groups on a worker "<node>/<worker>" of a peer node - the full list, relayed to the sibling workers
+        void announced(const std::string& origin, const std::string& counts);
+        // Members of the groups on a sibling worker or relayed by one - "<members> <name>" lines, 0 members: the group is left
+        void received(std::size_t from, const std::string& origin, uint8_t kind, const std::string& counts);
+
+    private:
+        enum Kind : uint8_t { DELTA = 0, FULL = 1, JOIN = 2 }; // JOIN: the full list of a (re)started worker, answered with FULL
+        struct Member {
+            Mqtt* mqtt;
+            uint8_t qoS;
+        };
+
+        struct Group {
+            std::vector<Member> members;               // on this worker
+            std::map<std::string, std::size_t> counts; // origin "<node>/<worker>" -> members there, this worker included
+            std::size_t next = 0;                      // least-inflight scan position
+            std::size_t turn = 0;                      // round-robin position in the members of all workers
+            Strategy strategy = Strategy::ROUND_ROBIN;
+        };
+
+        Group* findGroup(const std::string& name, bool create);
+        void setCount(const std::string& origin, const std::string& name, std::size_t count); // removes a group left by all
+
+        Mqtt* select(Group& group, std::size_t offset, uint8_t& qoS);
+
+        void apply(const std::string& origin, bool full, const std::string& counts);
+        void announce(std::size_t to, Kind kind, const std::string& counts) const;
+        void announce(const std::string& name, std::size_t count) const; // a change of the members of this worker
+
+        std::map<std::string, Strategy> strategies;
+        Strategy defaultStrategy = Strategy::ROUND_ROBIN;
+
+        TopicFilterTrie filters;
+        std::unordered_map<std::string, std::map<std::string, Group>> groups; // filter -> group name -> group
+        std::unordered_map<Mqtt*, std::vector<std::string>> memberships;      // connection -> shared subscription names
+
+        std::string origin;
+        std::map<std::string, std::set<std::string>> originNames; // origin of another worker -> names of groups with members
+    };
+
+} // namespace mqtt::mqttbroker::lib
+
+#endif // MQTTBROKER_LIB_SHAREDSUBSCRIPTIONS_H
@@ -0,0 +1,171 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SysPublisher.h"
+
+#include "Metrics.h"
+#include "lib/LoopMonitor.h"
+
+#include <iot/mqtt/server/broker/Broker.h>
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <log/Logger.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#endif
+
+namespace mqtt::mqttbroker::lib {
+
+    namespace {
+
+        double now() {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        uint64_t residentBytes() {
+            uint64_t pages = 0;
+
+            std::ifstream statm("/proc/self/statm");
+            statm >> pages >> pages; // size, resident
+
+            return pages * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+        }
+
+        std::string toString(double value) {
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%.2f", value);
+
+            return buffer;
+        }
+
+    } // namespace
+
+    SysPublisher& SysPublisher::instance() {
+        static SysPublisher sysPublisher;
+
+        return sysPublisher;
+    }
+
+    void SysPublisher::start(double interval) {
+        if (interval > 0 && !timer) {
+            this->interval = interval;
+            startTime = now();
+
+            timer = core::timer::Timer::intervalTimer(
+                [this]() -> void {
+                    const mqtt::lib::LoopMonitor::Probe probe("timer: $SYS publisher");
+
+                    publish();
+
+                    // The $SYS updates are no fan-out of a client publish
+                    Metrics::instance().fanoutMark();
+                },
+                interval);
+
+            VLOG(1) << "$SYS: Publishing every " << interval << " seconds";
+        }
+    }
+
+    void SysPublisher::setBroker(const std::shared_ptr<iot::mqtt::server::broker::Broker>& broker) {
+        if (!this->broker) {
+            this->broker = broker;
+        }
+    }
+
+    void SysPublisher::subscribed(std::size_t count) {
+        subscribers += count;
+    }
+
+    void SysPublisher::unsubscribed(std::size_t count) {
+        subscribers -= count;
+    }
+
+    void SysPublisher::Load::update(uint64_t total, double interval) {
+        const double rate = static_cast<double>(total - last) * 60 / interval; // per minute
+
+        load1 = rate + (load1 - rate) * std::exp(-interval / 60);
+        load5 = rate + (load5 - rate) * std::exp(-interval / 300);
+        load15 = rate + (load15 - rate) * std::exp(-interval / 900);
+
+        last = total;
+    }
+
+    void SysPublisher::publish() {
+        const Metrics& metrics = Metrics::instance();
+
+        // Loads are updated on every tick - also while nobody listens - to keep them continuous
+        messagesReceived.update(metrics.getPacketsReceived(), interval);
+        messagesSent.update(metrics.getPacketsSent(), interval);
+        publishReceived.update(metrics.getPacketsReceived(Metrics::Packet::PUBLISH), interval);
+        publishSent.update(metrics.getPacketsSent(Metrics::Packet::PUBLISH), interval);
+        bytesReceived.update(metrics.getBytesReceived(), interval);
+        bytesSent.update(metrics.getBytesSent(), interval);
+        connections.update(metrics.getPacketsReceived(Metrics::Packet::CONNECT), interval);
+
+        if (subscribers > 0 && broker) {
+            publish("$SYS/broker/version", "SNode.C mqttbroker");
+            publish("$SYS/broker/uptime", std::to_string(static_cast<uint64_t>(now() - startTime)) + " seconds");
+
+            publish("$SYS/broker/clients/connected", std::to_string(metrics.getConnectedClients()));
+            publish("$SYS/broker/clients/persistent", std::to_string(metrics.getSessionCount()));
+
+            publish("$SYS/broker/messages/received", std::to_string(messagesReceived.last));
+            publish("$SYS/broker/messages/sent", std::to_string(messagesSent.last));
+            publish("$SYS/broker/publish/messages/received", std::to_string(publishReceived.last));
+            publish("$SYS/broker/publish/messages/sent", std::to_string(publishSent.last));
+            publish("$SYS/broker/bytes/received", std::to_string(bytesReceived.last));
+            publish("$SYS/broker/bytes/sent", std::to_string(bytesSent.last));
+
+            publish("$SYS/broker/load/messages/received", messagesReceived);
+            publish("$SYS/broker/load/messages/sent", messagesSent);
+            publish("$SYS/broker/load/publish/received", publishReceived);
+            publish("$SYS/broker/load/publish/sent", publishSent);
+            publish("$SYS/broker/load/bytes/received", bytesReceived);
+            publish("$SYS/broker/load/bytes/sent", bytesSent);
+            publish("$SYS/broker/load/connections", connections);
+
+            publish("$SYS/broker/retained messages/count", std::to_string(metrics.getRetainedCount()));
+            publish("$SYS/broker/subscriptions/count", std::to_string(metrics.getSubscriptionCount()));
+
+            // Sampled from the resident set the kernel keeps count of - cheap, unlike walking the malloc arenas for the heap proper
+            rusage usage{};
+            getrusage(RUSAGE_SELF, &usage);
+
+            publish("$SYS/broker/heap/current", std::to_string(residentBytes()));
+            publish("$SYS/broker/heap/maximum", std::to_string(static_cast<uint64_t>(usage.ru_maxrss) * 1024));
+        }
+    }
+
+    void SysPublisher::publish(const std::string& topic, const std::string& value) {
+        broker->publish("", topic, value, 0, true);
+    }
+
+    void SysPublisher::publish(const std::string& topic, const Load& load) {
+        publish(topic + "/1min", toString(load.load1));
+        publish(topic + "/5min", toString(load.load5));
+        publish(topic + "/15min", toString(load.load15));
+    }
+
+} // namespace mqtt::mqttbroker::lib
@@ -0,0 +1,94 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MQTTBROKER_LIB_SYSPUBLISHER_H
+#define MQTTBROKER_LIB_SYSPUBLISHER_H
+
+namespace iot::mqtt::server::broker {
+    class Broker;
+} // namespace iot::mqtt::server::broker
+
+#include <core/timer/Timer.h>
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+
+#endif
+
+namespace mqtt::mqttbroker::lib {
+
+    /* Periodically publishes broker statistics below $SYS/broker/ using the topic names of mosquitto. Each tick reads the
+     * incrementally maintained Metrics and updates the load averages, thus costs O(1). Nothing is published while no client
+     * is subscribed to a $SYS topic filter. */
+    class SysPublisher {
+    private:
+        SysPublisher() = default;
+
+    public:
+        SysPublisher(const SysPublisher&) = delete;
+        SysPublisher& operator=(const SysPublisher&) = delete;
+
+        static SysPublisher& instance();
+
+        void start(double interval);
+
+        void setBroker(const std::shared_ptr<iot::mqtt::server::broker::Broker>& broker);
+
+        void subscribed(std::size_t count);
+        void unsubscribed(std::size_t count);
+
+    private:
+        // Exponentially damped per minute rates as known from mosquitto's $SYS/broker/load/...
+        struct Load {
+            void update(uint64_t total, double interval);
+
+            uint64_t last = 0;
+            double load1 = 0;
+            double load5 = 0;
+            double load15 = 0;
+        };
+
+        void publish();
+        void publish(const std::string& topic, const std::string& value);
+        void publish(const std::string& topic, const Load& load);
+
+        std::shared_ptr<iot::mqtt::server::broker::Broker> broker;
+        std::size_t subscribers = 0;
+
+        std::optional<core::timer::Timer> timer;
+        double interval = 0;
+        double startTime = 0;
+
+        Load messagesReceived; // all packets
+        Load messagesSent;     // all packets
+        Load publishReceived;
+        Load publishSent;
+        Load bytesReceived;
+        Load bytesSent;
+        Load connections;
+    };
+
+} // namespace mqtt::mqttbroker::lib
+
+#endif // MQTTBROKER_LIB_SYSPUBLISHER_H
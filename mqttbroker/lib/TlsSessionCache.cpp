@@ -0,0 +1,268 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "TlsSessionCache.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <log/Logger.h>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#endif
+
+#endif
+
+namespace mqtt::mqttbroker::lib {
+
+    namespace {
+
+        // HMAC-SHA256(secret, label | epoch), truncated to size
+        void derive(const std::string& secret, const char* label, uint64_t epoch, unsigned char* out, std::size_t size) {
+            std::string data = label;
+            for (int shift = 56; shift >= 0; shift -= 8) {
+                data.push_back(static_cast<char>((epoch >> shift) & 0xFF));
+            }
+
+            std::array<unsigned char, SHA256_DIGEST_LENGTH> digest{};
+            unsigned int digestSize = 0;
+            HMAC(EVP_sha256(),
+                 secret.data(),
+                 static_cast<int>(secret.size()),
+                 reinterpret_cast<const unsigned char*>(data.data()),
+                 data.size(),
+                 digest.data(),
+                 &digestSize);
+
+            std::memcpy(out, digest.data(), std::min(size, static_cast<std::size_t>(digestSize)));
+        }
+
+    } // namespace
+
+    TlsSessionCache& TlsSessionCache::instance() {
+        static TlsSessionCache tlsSessionCache;
+
+        return tlsSessionCache;
+    }
+
+    void TlsSessionCache::seed() {
+        secret.resize(SHA256_DIGEST_LENGTH);
+
+        if (RAND_bytes(reinterpret_cast<unsigned char*>(secret.data()), static_cast<int>(secret.size())) != 1) {
+            LOG(ERROR) << "TlsSessionCache: Generating the ticket key secret failed - session tickets disabled";
+            secret.clear();
+        }
+    }
+
+    void TlsSessionCache::configure(const std::string& sessions, double lifetime, double ticketRotation, const std::string& keyFile) {
+        std::size_t begin = 0;
+        while (begin < sessions.size()) {
+            const std::size_t end = std::min(sessions.find(',', begin), sessions.size());
+            const std::string entry = sessions.substr(begin, end - begin);
+            const std::size_t separator = entry.find('=');
+
+            char* last = nullptr;
+            const unsigned long long size =
+                separator != std::string::npos ? std::strtoull(entry.data() + separator + 1, &last, 10) : 0;
+
+            if (last != nullptr && last != entry.data() + separator + 1 && *last == '\0') {
+                this->sessions[entry.substr(0, separator)] = static_cast<std::size_t>(size);
+            } else {
+                LOG(WARNING) << "TlsSessionCache: Ignoring '" << entry << "'";
+            }
+
+            begin = end + 1;
+        }
+
+        this->lifetime = static_cast<long>(std::max(lifetime, 1.));
+        this->ticketRotation = std::max(ticketRotation, 0.);
+
+        if (!keyFile.empty()) {
+            std::ifstream file(keyFile, std::ios::binary);
+            const std::string key((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+            if (key.size() >= SHA256_DIGEST_LENGTH) {
+                secret = key;
+            } else {
+                LOG(ERROR) << "TlsSessionCache: Ticket key file '" << keyFile << "' missing or shorter than " << SHA256_DIGEST_LENGTH
+                           << " bytes - using a generated secret";
+            }
+        }
+
+        if (secret.empty()) {
+            this->ticketRotation = 0;
+        }
+
+        for (const auto& [instanceName, size] : this->sessions) {
+            VLOG(1) << "TlsSessionCache: '" << instanceName << "' " << size << " sessions";
+        }
+        VLOG(1) << "TlsSessionCache: Lifetime " << this->lifetime << " s, ticket rotation " << this->ticketRotation << " s";
+    }
+
+    void TlsSessionCache::listen(const std::string& instanceName, SSL_CTX* sslCtx) {
+        if (sslCtx != nullptr && !contexts.contains(sslCtx)) {
+            apply(instanceName, sslCtx);
+        }
+    }
+
+    bool TlsSessionCache::resumed(SSL* ssl) {
+        return ssl != nullptr && SSL_session_reused(ssl) == 1;
+    }
+
+    void TlsSessionCache::apply(const std::string& instanceName, SSL_CTX* sslCtx) {
+        const std::map<std::string, std::size_t>::const_iterator it =
+            sessions.contains(instanceName) ? sessions.find(instanceName) : sessions.find("*");
+        const std::size_t size = it != sessions.end() ? it->second : 0;
+
+        contexts[sslCtx] = instanceName;
+
+        // A session is only resumed on the listener it was established on
+        SSL_CTX_set_session_id_context(sslCtx,
+                                       reinterpret_cast<const unsigned char*>(instanceName.data()),
+                                       static_cast<unsigned int>(std::min<std::size_t>(instanceName.size(), SSL_MAX_SID_CTX_LENGTH)));
+        SSL_CTX_set_timeout(sslCtx, lifetime);
+
+        if (size > 0) {
+            SSL_CTX_set_session_cache_mode(sslCtx, SSL_SESS_CACHE_SERVER);
+            SSL_CTX_sess_set_cache_size(sslCtx, static_cast<long>(size));
+        } else {
+            SSL_CTX_set_session_cache_mode(sslCtx, SSL_SESS_CACHE_OFF);
+        }
+
+        if (ticketRotation > 0) {
+            SSL_CTX_clear_options(sslCtx, SSL_OP_NO_TICKET);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+            SSL_CTX_set_tlsext_ticket_key_evp_cb(sslCtx, ticketCallback);
+#else
+            SSL_CTX_set_tlsext_ticket_key_cb(sslCtx, ticketCallback);
+#endif
+        } else {
+            SSL_CTX_set_options(sslCtx, SSL_OP_NO_TICKET);
+        }
+
+        LOG(DEBUG) << instanceName << ": TLS session cache " << size << " sessions, tickets " << (ticketRotation > 0 ? "on" : "off");
+    }
+
+    std::map<std::string, std::size_t> TlsSessionCache::getCachedSessions() const {
+        std::map<std::string, std::size_t> cachedSessions;
+
+        for (const auto& [sslCtx, instanceName] : contexts) {
+            cachedSessions[instanceName] += static_cast<std::size_t>(SSL_CTX_sess_number(sslCtx));
+        }
+
+        return cachedSessions;
+    }
+
+    uint64_t TlsSessionCache::currentEpoch() const {
+        const double now = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+        return static_cast<uint64_t>(now / ticketRotation);
+    }
+
+    const TlsSessionCache::TicketKey& TlsSessionCache::ticketKey(uint64_t epoch) {
+        TicketKey& key = ticketKeys[epoch % ticketKeys.size()];
+
+        if (key.epoch != epoch) {
+            key.epoch = epoch;
+            derive(secret, "mqttbroker ticket name", epoch, key.name.data(), key.name.size());
+            derive(secret, "mqttbroker ticket aes", epoch, key.aesKey.data(), key.aesKey.size());
+            derive(secret, "mqttbroker ticket hmac", epoch, key.hmacKey.data(), key.hmacKey.size());
+        }
+
+        return key;
+    }
+
+    // Returns -1 on error, 0 for an unknown ticket (full handshake), 1 if the ticket was accepted and 2 if it was accepted but
+    // should be renewed as it has been encrypted with the key of the previous epoch
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    int TlsSessionCache::ticketCallback([[maybe_unused]] SSL* ssl,
+                                        unsigned char* keyName,
+                                        unsigned char* iv,
+                                        EVP_CIPHER_CTX* cipherCtx,
+                                        EVP_MAC_CTX* macCtx,
+                                        int encrypt) {
+#else
+    int TlsSessionCache::ticketCallback([[maybe_unused]] SSL* ssl,
+                                        unsigned char* keyName,
+                                        unsigned char* iv,
+                                        EVP_CIPHER_CTX* cipherCtx,
+                                        HMAC_CTX* hmacCtx,
+                                        int encrypt) {
+#endif
+        TlsSessionCache& tlsSessionCache = TlsSessionCache::instance();
+
+        const uint64_t epoch = tlsSessionCache.currentEpoch();
+        const TicketKey* key = nullptr;
+
+        int result = 0;
+
+        if (encrypt == 1) {
+            key = &tlsSessionCache.ticketKey(epoch);
+            std::memcpy(keyName, key->name.data(), key->name.size());
+
+            result = RAND_bytes(iv, EVP_MAX_IV_LENGTH) == 1 &&
+                             EVP_EncryptInit_ex(cipherCtx, EVP_aes_256_cbc(), nullptr, key->aesKey.data(), iv) == 1
+                         ? 1
+                         : -1;
+        } else {
+            for (const uint64_t candidate : {epoch, epoch - 1}) {
+                const TicketKey& candidateKey = tlsSessionCache.ticketKey(candidate);
+
+                if (key == nullptr && std::memcmp(keyName, candidateKey.name.data(), candidateKey.name.size()) == 0) {
+                    key = &candidateKey;
+                    result = candidate == epoch ? 1 : 2;
+                }
+            }
+
+            if (key != nullptr && EVP_DecryptInit_ex(cipherCtx, EVP_aes_256_cbc(), nullptr, key->aesKey.data(), iv) != 1) {
+                result = -1;
+            }
+        }
+
+        if (result > 0) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+            std::array<OSSL_PARAM, 3> params = {
+                OSSL_PARAM_construct_octet_string(
+                    OSSL_MAC_PARAM_KEY, const_cast<unsigned char*>(key->hmacKey.data()), key->hmacKey.size()),
+                OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char*>("SHA256"), 0),
+                OSSL_PARAM_construct_end()};
+
+            if (EVP_MAC_CTX_set_params(macCtx, params.data()) != 1) {
+                result = -1;
+            }
+#else
+            if (HMAC_Init_ex(hmacCtx, key->hmacKey.data(), static_cast<int>(key->hmacKey.size()), EVP_sha256(), nullptr) != 1) {
+                result = -1;
+            }
+#endif
+        }
+
+        return result;
+    }
+
+} // namespace mqtt::mqttbroker::lib
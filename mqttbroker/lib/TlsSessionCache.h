@@ -0,0 +1,116 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MQTTBROKER_LIB_TLSSESSIONCACHE_H
+#define MQTTBROKER_LIB_TLSSESSIONCACHE_H
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/ssl.h>
+#include <string>
+
+#endif
+
+namespace mqtt::mqttbroker::lib {
+
+    /* Session resumption of the TLS listeners.
+     *
+     * Each listener instance (or "*" for all others) gets a bounded server side session cache - OpenSSL evicts the oldest
+     * session once it is full - and, unless disabled, stateless session tickets. Ticket keys rotate: the key of an epoch
+     * (wall clock time / rotation interval) is derived from a secret via HMAC-SHA256, thus all workers and, with a key file,
+     * all broker restarts and cluster nodes agree on the keys without any coordination. Tickets of the previous epoch are still
+     * accepted and renewed, thus a ticket stays valid for at least one rotation interval.
+     *
+     * The secret is generated in the parent process before the workers are forked. A key file replaces it - all nodes sharing
+     * the file resume each others sessions and a restarted broker resumes the sessions of its predecessor. */
+    class TlsSessionCache {
+    private:
+        TlsSessionCache() = default;
+
+    public:
+        TlsSessionCache(const TlsSessionCache&) = delete;
+        TlsSessionCache& operator=(const TlsSessionCache&) = delete;
+
+        static TlsSessionCache& instance();
+
+        // Must be called before the workers are forked
+        void seed();
+
+        // sessions: comma separated list of <listener instance>=<cached sessions>, "*" names the default, 0 disables the cache
+        // ticketRotation: seconds, 0 disables session tickets
+        void configure(const std::string& sessions, double lifetime, double ticketRotation, const std::string& keyFile);
+
+        // Called once the listener is set up, before it accepts the first connection. The SSL_CTXs of SNI certificates need no
+        // configuration: OpenSSL keeps using the cache and the ticket callback of the listener's SSL_CTX after a switch.
+        void listen(const std::string& instanceName, SSL_CTX* sslCtx);
+
+        // Called after each completed handshake - returns true if the handshake resumed a session
+        static bool resumed(SSL* ssl);
+
+        std::map<std::string, std::size_t> getCachedSessions() const; // listener instance -> sessions in the cache
+
+    private:
+        struct TicketKey {
+            uint64_t epoch = UINT64_MAX;
+            std::array<unsigned char, 16> name{};
+            std::array<unsigned char, 32> aesKey{};
+            std::array<unsigned char, 32> hmacKey{};
+        };
+
+        void apply(const std::string& instanceName, SSL_CTX* sslCtx);
+
+        const TicketKey& ticketKey(uint64_t epoch);
+        uint64_t currentEpoch() const;
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        static int ticketCallback(SSL* ssl,
+                                  unsigned char* keyName,
+                                  unsigned char* iv,
+                                  EVP_CIPHER_CTX* cipherCtx,
+                                  EVP_MAC_CTX* macCtx,
+                                  int encrypt);
+#else
+        static int ticketCallback(SSL* ssl,
+                                  unsigned char* keyName,
+                                  unsigned char* iv,
+                                  EVP_CIPHER_CTX* cipherCtx,
+                                  HMAC_CTX* hmacCtx,
+                                  int encrypt);
+#endif
+
+        std::string secret; // key of the ticket key derivation
+
+        std::map<std::string, std::size_t> sessions{{"*", 10000}};
+        long lifetime = 7200;
+        double ticketRotation = 3600;
+
+        std::map<SSL_CTX*, std::string> contexts; // the configured SSL_CTXs -> listener instance
+
+        std::array<TicketKey, 2> ticketKeys{}; // the current and the previous epoch, indexed by epoch % 2
+    };
+
+} // namespace mqtt::mqttbroker::lib
+
+#endif // MQTTBROKER_LIB_TLSSESSIONCACHE_H
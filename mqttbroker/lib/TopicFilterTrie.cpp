@@ -0,0 +1,214 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "TopicFilterTrie.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#endif
+
+namespace mqtt::mqttbroker::lib {
+
+    void TopicFilterTrie::insert(const std::string& filter) {
+        Node* node = &root;
+
+        std::size_t begin = 0;
+        for (;;) {
+            const std::size_t end = std::min(filter.find('/', begin), filter.size());
+            const std::string level = filter.substr(begin, end - begin);
+
+            if (level == "#") {
+                node->multiLevel++;
+                break;
+            }
+
+            std::unique_ptr<Node>& child = node->children[level];
+            if (!child) {
+                child = std::make_unique<Node>();
+            }
+            node = child.get();
+
+            if (end == filter.size()) {
+                node->terminal++;
+                break;
+            }
+
+            begin = end + 1;
+        }
+
+        ++filters;
+    }
+
+    bool TopicFilterTrie::erase(const std::string& filter) {
+        std::vector<std::pair<Node*, std::string>> path; // parent and level of each node below the root
+        Node* node = &root;
+        std::size_t* count = nullptr;
+
+        std::size_t begin = 0;
+        while (node != nullptr && count == nullptr) {
+            const std::size_t end = std::min(filter.find('/', begin), filter.size());
+            const std::string level = filter.substr(begin, end - begin);
+
+            if (level == "#") {
+                count = &node->multiLevel;
+            } else {
+                const std::map<std::string, std::unique_ptr<Node>, std::less<>>::iterator child = node->children.find(level);
+
+                if (child != node->children.end()) {
+                    path.emplace_back(node, level);
+                    node = child->second.get();
+
+                    if (end == filter.size()) {
+                        count = &node->terminal;
+                    }
+                } else {
+                    node = nullptr;
+                }
+            }
+
+            begin = end + 1;
+        }
+
+        const bool erased = count != nullptr && *count > 0;
+
+        if (erased) {
+            --*count;
+            --filters;
+
+            // Prune the nodes which lead to no filter anymore
+            for (std::size_t i = path.size(); i > 0 && node->terminal == 0 && node->multiLevel == 0 && node->children.empty(); --i) {
+                node = path[i - 1].first;
+                node->children.erase(path[i - 1].second);
+            }
+        }
+
+        return erased;
+    }
+
+    void TopicFilterTrie::clear() {
+        root.children.clear();
+        root.terminal = 0;
+        root.multiLevel = 0;
+        filters = 0;
+    }
+
+    std::size_t TopicFilterTrie::size() const {
+        return filters;
+    }
+
+    bool TopicFilterTrie::matches(const std::string& topic) const {
+        return matches(root, topic, 0, true);
+    }
+
+    bool TopicFilterTrie::matches(const Node& node, const std::string& topic, std::size_t begin, bool firstLevel) {
+        // Wildcards at the first level do not match topics starting with '$' (MQTT 3.1.1, 4.7.2)
+        const bool wildcardAllowed = !firstLevel || topic.empty() || topic[0] != '$';
+
+        bool match = node.multiLevel > 0 && wildcardAllowed;
+
+        if (!match) {
+            const std::size_t end = std::min(topic.find('/', begin), topic.size());
+
+            match = matches(node, std::string_view(topic.data() + begin, end - begin), topic, end);
+
+            if (!match && wildcardAllowed) {
+                match = matches(node, "+", topic, end);
+            }
+        }
+
+        return match;
+    }
+
+    bool TopicFilterTrie::matches(const Node& node, std::string_view level, const std::string& topic, std::size_t end) {
+        bool match = false;
+
+        const std::map<std::string, std::unique_ptr<Node>, std::less<>>::const_iterator child = node.children.find(level);
+
+        if (child != node.children.end()) {
+            // "a/#" also matches "a" - the parent level of the multi level wildcard
+            match = end == topic.size() ? child->second->terminal > 0 || child->second->multiLevel > 0
+                                        : matches(*child->second, topic, end + 1, false);
+        }
+
+        return match;
+    }
+
+    void TopicFilterTrie::match(const std::string& topic, const std::function<void(const std::string& filter)>& onMatch) const {
+        std::string filter;
+
+        match(root, topic, 0, filter, onMatch);
+    }
+
+    void TopicFilterTrie::match(const Node& node,
+                                const std::string& topic,
+                                std::size_t begin,
+                                std::string& filter,
+                                const std::function<void(const std::string& filter)>& onMatch) {
+        const bool wildcardAllowed = begin > 0 || topic.empty() || topic[0] != '$';
+        const std::size_t filterSize = filter.size();
+
+        if (node.multiLevel > 0 && wildcardAllowed) {
+            filter += "#";
+            onMatch(filter);
+            filter.resize(filterSize);
+        }
+
+        const std::size_t end = std::min(topic.find('/', begin), topic.size());
+        const std::string_view level(topic.data() + begin, end - begin);
+
+        match(node, level, topic, end, filter, onMatch);
+
+        if (wildcardAllowed && level != "+") {
+            match(node, "+", topic, end, filter, onMatch);
+        }
+    }
+
+    void TopicFilterTrie::match(const Node& node,
+                                std::string_view level,
+                                const std::string& topic,
+                                std::size_t end,
+                                std::string& filter,
+                                const std::function<void(const std::string& filter)>& onMatch) {
+        const std::map<std::string, std::unique_ptr<Node>, std::less<>>::const_iterator child = node.children.find(level);
+
+        if (child != node.children.end()) {
+            const std::size_t filterSize = filter.size();
+            filter += level;
+
+            if (end == topic.size()) {
+                if (child->second->terminal > 0) {
+                    onMatch(filter);
+                }
+                if (child->second->multiLevel > 0) {
+                    onMatch(filter + "/#");
+                }
+            } else {
+                filter += "/";
+                match(*child->second, topic, end + 1, filter, onMatch);
+            }
+
+            filter.resize(filterSize);
+        }
+    }
+
+} // namespace mqtt::mqttbroker::lib
@@ -0,0 +1,79 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MQTTBROKER_LIB_TOPICFILTERTRIE_H
+#define MQTTBROKER_LIB_TOPICFILTERTRIE_H
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#endif
+
+namespace mqtt::mqttbroker::lib {
+
+    /* Multiset of MQTT topic filters organized by topic level. Tells whether a topic matches at least one filter in
+     * O(topic levels) for filters without wildcards; '+' and '#' add one branch per level. */
+    class TopicFilterTrie {
+    public:
+        void insert(const std::string& filter);
+        bool erase(const std::string& filter); // removes one occurrence, false if the filter is not contained
+        void clear();
+
+        bool matches(const std::string& topic) const;
+
+        // Calls onMatch once for each distinct filter matching the topic
+        void match(const std::string& topic, const std::function<void(const std::string& filter)>& onMatch) const;
+
+        std::size_t size() const;
+
+    private:
+        struct Node {
+            std::map<std::string, std::unique_ptr<Node>, std::less<>> children;
+            std::size_t terminal = 0;   // number of filters ending here
+            std::size_t multiLevel = 0; // number of filters ending here with '#'
+        };
+
+        static bool matches(const Node& node, const std::string& topic, std::size_t begin, bool firstLevel);
+        static bool matches(const Node& node, std::string_view level, const std::string& topic, std::size_t end);
+
+        static void match(const Node& node,
+                          const std::string& topic,
+                          std::size_t begin,
+                          std::string& filter,
+                          const std::function<void(const std::string& filter)>& onMatch);
+        static void match(const Node& node,
+                          std::string_view level,
+                          const std::string& topic,
+                          std::size_t end,
+                          std::string& filter,
+                          const std::function<void(const std::string& filter)>& onMatch);
+
+        Node root;
+        std::size_t filters = 0;
+    };
+
+} // namespace mqtt::mqttbroker::lib
+
+#endif // MQTTBROKER_LIB_TOPICFILTERTRIE_H
@@ -17,9 +17,22 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "ClientsApi.h"
+#include "ClusterSocketContextFactory.h"
 #include "SharedSocketContextFactory.h"
-#include "lib/Mqtt.h"
-#include "lib/MqttModel.h"
+#include "ktls/KernelTls.h"
+#include "lib/Cluster.h"
+#include "lib/LoopMonitor.h"
+#include "lib/Metrics.h"
+#include "lib/OfflineQueue.h"
+#include "lib/OutboundLimiter.h"
+#include "lib/RateLimiter.h"
+#include "lib/RetainedStore.h"
+#include "lib/SessionJournal.h"
+#include "lib/ShardBus.h"
+#include "lib/SharedSubscriptions.h"
+#include "lib/SysPublisher.h"
+#include "lib/TlsSessionCache.h"
 
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 
@@ -29,6 +42,7 @@
 #include <express/legacy/in6/WebApp.h>
 #include <express/tls/in/WebApp.h>
 #include <express/tls/in6/WebApp.h>
+#include <net/in/stream/legacy/SocketClient.h>
 #include <net/in/stream/legacy/SocketServer.h>
 #include <net/in/stream/tls/SocketServer.h>
 #include <net/un/stream/legacy/SocketServer.h>
@@ -36,12 +50,25 @@
 #include <log/Logger.h>
 #include <utils/Config.h>
 //
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+#include <nlohmann/json.hpp>
+#include <sstream>
 #include <string>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <thread>
 #include <tuple>
 #include <type_traits>
+#include <unistd.h>
 #include <utility>
 #include <variant>
+#include <vector>
 
 #endif
 
@@ -63,26 +90,57 @@ static void upgrade APPLICATION(req, res) {
 static express::Router getRouter() {
     const express::Router router;
 
-    router.get("/clients", [] APPLICATION(req, res) {
-        std::string responseString = "<html>"
-                                     "  <head>"
-                                     "    <title>Mqtt Broker</title>"
-                                     "  </head>"
-                                     "  <body>"
-                                     "    <h1>List of all Connected Clients</h1>"
-                                     "    <table>"
-                                     "      <tr><th>ClientId</th><th>Locale Address</th><th>Remote Address</th></tr>";
-
-        for (const auto& [mqtt, connectPacket] : mqtt::mqttbroker::lib::MqttModel::instance().getConnectedClients()) {
-            responseString += "<tr><td>" + mqtt->getClientId() + "</td><td>" + mqtt->getSocketConnection()->getLocalAddress().toString() +
-                              "</td><td>" + mqtt->getSocketConnection()->getRemoteAddress().toString() + "</td></tr>";
-        }
+    router.get("/metrics", [] APPLICATION(req, res) {
+        const mqtt::lib::LoopMonitor::Probe probe("http: /metrics");
 
-        responseString += "    </table>"
-                          "  </body>"
-                          "</html>";
+        res->set("Content-Type", "application/openmetrics-text; version=1.0.0; charset=utf-8");
+        res->send(mqtt::mqttbroker::lib::Metrics::instance().expose());
+    });
 
-        res->send(responseString);
+    router.get("/api/clients", [] APPLICATION(req, res) {
+        mqtt::mqttbroker::ClientsApi::list(req, res);
+    });
+
+    router.get("/api/loop", [] APPLICATION(req, res) {
+        res->set("Content-Type", "application/json");
+        res->send(mqtt::lib::LoopMonitor::instance().toJson().dump());
+    });
+
+    router.get("/clients", [] APPLICATION(req, res) {
+        res->send("<html>"
+                  "  <head>"
+                  "    <title>Mqtt Broker</title>"
+                  "  </head>"
+                  "  <body>"
+                  "    <h1>List of all Connected Clients</h1>"
+                  "    <table id='clients'>"
+                  "      <tr>"
+                  "        <th>ClientId</th><th>Locale Address</th><th>Remote Address</th><th>Backlog</th><th>Dropped</th><th>Over</th>"
+                  "      </tr>"
+                  "    </table>"
+                  "    <script>"
+                  "      async function load(after) {"
+                  "        const fields = 'client_id,local_address,remote_address,outbound';"
+                  "        const response = await fetch('/api/clients?limit=500&fields=' + fields + '&after=' + after);"
+                  "        const page = await response.json();"
+                  "        const table = document.getElementById('clients');"
+                  "        for (const client of page.clients) {"
+                  "          const row = table.insertRow();"
+                  "          const outbound = client.outbound;"
+                  "          const over = outbound.over_seconds.toFixed(1) + (outbound.throttled ? ' s *' : ' s');"
+                  "          for (const value of [client.client_id, client.local_address, client.remote_address, outbound.backlog,"
+                  "                               outbound.dropped, over]) {"
+                  "            row.insertCell().textContent = value;"
+                  "          }"
+                  "        }"
+                  "        if (page.next !== null) {"
+                  "          load(page.next);"
+                  "        }"
+                  "      }"
+                  "      load(0);"
+                  "    </script>"
+                  "  </body>"
+                  "</html>");
     });
 
     router.get("/ws/", [] APPLICATION(req, res) -> void {
@@ -123,11 +181,30 @@ template <template <typename, typename...> typename SocketServer,
 void startServer(const std::string& instanceName,
                  const std::function<void(typename Server::Config&)>& configurator,
                  SocketContextFactoryArgs&&... socketContextFactoryArgs) {
-    const Server server(instanceName, std::forward<SocketContextFactoryArgs>(socketContextFactoryArgs)...);
+    Server server(instanceName, std::forward<SocketContextFactoryArgs>(socketContextFactoryArgs)...);
 
     configurator(server.getConfig());
 
-    server.listen([instanceName](const SocketAddress& socketAddress, const core::socket::State& state) -> void {
+    if constexpr (requires(typename Server::SocketConnection* socketConnection) { socketConnection->getSSL(); }) {
+        server.setOnConnected([instanceName](typename Server::SocketConnection* socketConnection) -> void {
+            const bool resumed = mqtt::mqttbroker::lib::TlsSessionCache::resumed(socketConnection->getSSL());
+
+            mqtt::mqttbroker::lib::Metrics::instance().tlsHandshake(instanceName, resumed);
+            mqtt::ktls::KernelTls::instance().handshake(instanceName, socketConnection->getSSL());
+        });
+    }
+
+    typename Server::Config* config = &server.getConfig();
+
+    server.listen([instanceName, config](const SocketAddress& socketAddress, const core::socket::State& state) -> void {
+        // The SSL_CTX of a TLS listener exists once it listens - configured before the first connection is accepted
+        if constexpr (requires { config->getSslCtx(); }) {
+            if (state == core::socket::State::OK) {
+                mqtt::mqttbroker::lib::TlsSessionCache::instance().listen(instanceName, config->getSslCtx());
+                mqtt::ktls::KernelTls::instance().setup(instanceName, config->getSslCtx());
+            }
+        }
+
         reportState(instanceName, socketAddress, state);
     });
 }
@@ -151,6 +228,193 @@ void startServer(const std::string& instanceName, SocketContextFactoryArgs&&...
         });
 }
 
+template <template <typename, typename...> typename SocketClient,
+          typename SocketContextFactory,
+          typename... SocketContextFactoryArgs,
+          typename Client = SocketClient<SocketContextFactory, SocketContextFactoryArgs&&...>,
+          typename SocketAddress = typename Client::SocketAddress,
+          typename = std::enable_if_t<std::is_base_of_v<core::socket::stream::SocketContextFactory, SocketContextFactory>>>
+void startClient(const std::string& instanceName,
+                 const std::function<void(typename Client::Config&)>& configurator,
+                 SocketContextFactoryArgs&&... socketContextFactoryArgs) {
+    const Client client(instanceName, std::forward<SocketContextFactoryArgs>(socketContextFactoryArgs)...);
+
+    configurator(client.getConfig());
+
+    client.connect([instanceName](const SocketAddress& socketAddress, const core::socket::State& state) -> void {
+        reportState(instanceName, socketAddress, state);
+    });
+}
+
+// One link per peer node - the address of peer <name> is configured via the instance "cluster-<name>"
+static void startClusterLinks(const std::string& peers) {
+    std::istringstream peerStream(peers);
+
+    for (std::string peerNode; std::getline(peerStream, peerNode, ',');) {
+        if (!peerNode.empty() && peerNode != mqtt::mqttbroker::lib::Cluster::instance().getNodeName()) {
+            startClient<net::in::stream::legacy::SocketClient, mqtt::mqttbroker::ClusterSocketContextFactory>(
+                "cluster-" + peerNode,
+                [](auto& config) -> void {
+                    config.setRetry();
+                    config.setRetryBase(1);
+                    config.setReconnect();
+                },
+                peerNode);
+        }
+    }
+}
+
+constexpr double clusterSummaryDelay = 0.5;
+
+constexpr std::size_t shardBusRingSize = 4 * 1024 * 1024;
+
+constexpr double outboundCheckInterval = 0.05;
+
+// Minimum lifetime of a worker below which its restart is delayed
+constexpr std::chrono::seconds workerRestartDelay{1};
+
+// Bytes written per writable event of an MQTT connection. SNode.C buffers what is sent during one event loop iteration - e.g.
+// the PUBLISH packets of a fan-out - and writes up to this size per writable event. Raised from the 16 KiB default, a backlog
+// of a subscriber goes out with a quarter of the send() calls. A multiple of the maximum TLS record payload (16 KiB), thus
+// SSL_write() still emits full sized records. The HTTP listeners keep the default.
+constexpr std::size_t writeBlockSize = 4 * 16 * 1024;
+
+static std::size_t toWorkers(const std::string& workers) {
+    return static_cast<std::size_t>(std::max(std::atoi(workers.data()), 1));
+}
+
+// The number of workers is needed before core::SNodeC::init() as the workers are forked before any event loop state exists. Thus
+// --workers is a command line only option - a value from the configuration file or the environment is not known yet.
+static std::size_t getWorkers(int argc, char* argv[]) {
+    std::string workers = "1";
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+
+        if (arg == "--workers" && i + 1 < argc) {
+            workers = argv[i + 1];
+        } else if (arg.starts_with("--workers=")) {
+            workers = arg.substr(std::string("--workers=").size());
+        }
+    }
+
+    return toWorkers(workers);
+}
+
+static std::vector<pid_t> workerPids; // of the supervisor - 0: to be forked, -1: finished
+static volatile std::sig_atomic_t stopping = 0;
+
+static void stopWorkers(int signum) {
+    stopping = 1;
+
+    for (const pid_t pid : workerPids) {
+        if (pid > 0) {
+            kill(pid, signum);
+        }
+    }
+}
+
+// The parent process only supervises: it forks the workers, forwards termination signals to them and restarts a worker which
+// died by a signal with the same index. A worker exiting on its own is not restarted. Returns only in the workers.
+static std::size_t superviseWorkers(std::size_t workers) {
+    struct sigaction action {};
+    action.sa_handler = stopWorkers;
+    sigemptyset(&action.sa_mask);
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    for (const int signum : {SIGTERM, SIGINT, SIGHUP}) {
+        sigaction(signum, &action, nullptr);
+        sigaddset(&signals, signum);
+    }
+
+    const pid_t supervisor = getpid();
+    std::vector<std::chrono::steady_clock::time_point> startedAt(workers);
+
+    workerPids.assign(workers, 0);
+
+    std::size_t worker = workers;
+    std::size_t running = 0;
+    int exitStatus = EXIT_SUCCESS;
+
+    while (worker == workers && (running > 0 || (stopping == 0 && std::ranges::count(workerPids, 0) > 0))) {
+        for (std::size_t index = 0; index < workers && worker == workers && stopping == 0; ++index) {
+            if (workerPids[index] == 0) {
+                // A signal arriving in between would miss the new worker
+                sigprocmask(SIG_BLOCK, &signals, nullptr);
+
+                const pid_t pid = fork();
+
+                if (pid == 0) {
+                    prctl(PR_SET_PDEATHSIG, SIGTERM);
+
+                    for (const int signum : {SIGTERM, SIGINT, SIGHUP}) {
+                        signal(signum, SIG_DFL);
+                    }
+
+                    if (getppid() != supervisor) {
+                        std::_Exit(EXIT_FAILURE);
+                    }
+
+                    worker = index;
+                } else if (pid > 0) {
+                    workerPids[index] = pid;
+                    startedAt[index] = std::chrono::steady_clock::now();
+                    running++;
+                } else {
+                    PLOG(ERROR) << "Forking worker " << index << " failed";
+                }
+
+                sigprocmask(SIG_UNBLOCK, &signals, nullptr);
+            }
+        }
+
+        if (worker == workers && running == 0) {
+            // Forking failed - try again later
+            std::this_thread::sleep_for(workerRestartDelay);
+        } else if (worker == workers) {
+            int status = 0;
+            const pid_t pid = waitpid(-1, &status, 0);
+
+            const std::vector<pid_t>::iterator it = std::ranges::find(workerPids, pid);
+
+            if (pid > 0 && it != workerPids.end()) {
+                const std::size_t index = static_cast<std::size_t>(it - workerPids.begin());
+                running--;
+
+                // However it ended - its siblings stop ringing it and the records they push to it are skipped by its successor
+                mqtt::mqttbroker::lib::ShardBus::instance().retire(index);
+
+                if (WIFSIGNALED(status) && stopping == 0) {
+                    LOG(ERROR) << "Worker " << index << " died by signal " << WTERMSIG(status) << " - restarting";
+
+                    *it = 0;
+
+                    if (std::chrono::steady_clock::now() - startedAt[index] < workerRestartDelay) {
+                        // Crashing right after start - do not fork at full speed
+                        std::this_thread::sleep_for(workerRestartDelay);
+                    }
+                } else {
+                    if (WIFEXITED(status) && WEXITSTATUS(status) != EXIT_SUCCESS) {
+                        exitStatus = WEXITSTATUS(status);
+                    }
+                    *it = -1;
+                }
+            } else if (pid < 0 && errno != EINTR) {
+                PLOG(ERROR) << "Waiting for the workers failed";
+
+                std::this_thread::sleep_for(workerRestartDelay);
+            }
+        }
+    }
+
+    if (worker == workers) {
+        std::exit(exitStatus);
+    }
+
+    return worker;
+}
+
 template <typename HttpExpressServer>
 void startServer(const std::string& instanceName, const std::function<void(typename HttpExpressServer::Config&)>& configurator = nullptr) {
     using SocketAddress = typename HttpExpressServer::SocketAddress;
@@ -169,59 +433,216 @@ void startServer(const std::string& instanceName, const std::function<void(typen
 int main(int argc, char* argv[]) {
     utils::Config::addStringOption("--mqtt-mapping-file", "MQTT mapping file (json format) for integration", "[path]", "");
     utils::Config::addStringOption("--mqtt-session-store", "Path to file for the persistent session store", "[path]", "");
+    utils::Config::addStringOption(
+        "--mqtt-session-journal", "Path prefix of the write-ahead log of persistent session subscriptions", "[path]", "");
+    utils::Config::addStringOption("--mqtt-session-journal-sync", "Interval of syncing the session journal to disk", "[seconds]", "1");
+    utils::Config::addStringOption("--mqtt-retained-store", "Path of the persistent store of retained messages", "[path]", "");
+    utils::Config::addStringOption("--mqtt-offline-queue", "Spool directory of the queues of offline persistent sessions", "[path]", "");
+    utils::Config::addStringOption("--mqtt-offline-queue-head", "In-memory bytes of each offline queue", "[bytes]", "16384");
+    utils::Config::addStringOption("--mqtt-offline-queue-client-budget", "Maximum bytes queued per offline session", "[bytes]", "67108864");
+    utils::Config::addStringOption("--mqtt-offline-queue-budget", "Maximum bytes queued for all offline sessions", "[bytes]", "4294967296");
+    utils::Config::addStringOption("--mqtt-offline-queue-memory", "Maximum in-memory bytes of all offline queues", "[bytes]", "268435456");
+    utils::Config::addStringOption(
+        "--mqtt-offline-queue-policy", "Message dropped if a budget is exceeded", "[drop-oldest|drop-new]", "drop-oldest");
+    utils::Config::addStringOption(
+        "--outbound-high-water", "Outbound backlog of a connection applying the slow consumer policy, 0 disables", "[bytes]", "1048576");
+    utils::Config::addStringOption(
+        "--outbound-low-water", "Outbound backlog of a connection lifting the slow consumer policy", "[bytes]", "262144");
+    utils::Config::addStringOption("--outbound-policy",
+                                   "Slow consumer policy per listener instance, '*' for all others",
+                                   "[instance=drop-qos0|pause|disconnect,...]",
+                                   "");
+    utils::Config::addStringOption(
+        "--rate-client-messages", "Publishes per second of each client per listener instance", "[instance=rate,...]", "");
+    utils::Config::addStringOption(
+        "--rate-client-bytes", "Published bytes per second of each client per listener instance", "[instance=rate,...]", "");
+    utils::Config::addStringOption(
+        "--rate-listener-messages", "Publishes per second of all clients of a listener instance", "[instance=rate,...]", "");
+    utils::Config::addStringOption(
+        "--rate-listener-bytes", "Published bytes per second of all clients of a listener instance", "[instance=rate,...]", "");
+    utils::Config::addStringOption("--rate-accept",
+                                   "Accepted connections and WebSocket upgrades per second of each source address per listener instance",
+                                   "[instance=rate,...]",
+                                   "");
+    utils::Config::addStringOption(
+        "--rate-action", "Action on a publish over a rate limit per listener instance", "[instance=drop|delay|disconnect,...]", "");
+    utils::Config::addStringOption("--mqtt-shared-strategy",
+                                   "Distribution of $share/<group>/<filter> subscriptions per group, '*' for all others",
+                                   "[group=round-robin|least-inflight|sticky,...]",
+                                   "");
+    utils::Config::addStringOption("--tls-session-cache",
+                                   "Sessions cached per TLS listener instance, '*' for all others, 0 disables the cache",
+                                   "[instance=sessions,...]",
+                                   "*=10000");
+    utils::Config::addStringOption("--tls-session-lifetime", "Lifetime of cached TLS sessions and session tickets", "[seconds]", "7200");
+    utils::Config::addStringOption(
+        "--tls-ticket-rotation", "Rotation interval of the TLS session ticket keys, 0 disables session tickets", "[seconds]", "3600");
+    utils::Config::addStringOption("--tls-ticket-key-file",
+                                   "File of at least 32 random bytes the ticket keys are derived from, shared by cluster nodes",
+                                   "[path]",
+                                   "");
+    utils::Config::addStringOption(
+        "--ktls", "Kernel TLS offload per TLS listener instance, '*' for all others", "[instance=on|off,...]", "");
+    utils::Config::addStringOption("--sys-interval", "Interval of $SYS topic updates in seconds, 0 disables", "[seconds]", "10");
+
+    utils::Config::addStringOption(
+        "--loop-stall-threshold", "Duration of an event loop callback counted as stall", "[seconds]", "0.05");
+    utils::Config::addStringOption("--loop-log-interval", "Interval of the event loop summary log, 0 disables", "[seconds]", "0");
+
+    utils::Config::addStringOption("--cluster-node", "Name of this node in a broker cluster, empty disables clustering", "[name]", "");
+    utils::Config::addStringOption("--cluster-peers", "Comma separated names of the peer nodes of the cluster", "[names]", "");
+    utils::Config::addStringOption("--cluster-secret-file",
+                                   "File of at least 16 bytes shared by all cluster nodes, authenticates the cluster links",
+                                   "[path]",
+                                   "");
+
+    utils::Config::addStringOption("--workers",
+                                   "Number of worker processes sharing the MQTT listeners, command line only. The HTTP listeners of "
+                                   "worker n default to port 8080+n and 8088+n",
+                                   "[n]",
+                                   "1");
+
+    const std::size_t workers = getWorkers(argc, argv);
+    mqtt::mqttbroker::lib::TlsSessionCache::instance().seed(); // all workers derive the same session ticket keys
+    const std::size_t worker =
+        workers > 1 && mqtt::mqttbroker::lib::ShardBus::instance().create(workers, shardBusRingSize) ? superviseWorkers(workers) : 0;
+    const bool reusePort = workers > 1;
 
     core::SNodeC::init(argc, argv);
 
-    setenv("MQTT_SESSION_STORE", utils::Config::getStringOptionValue("--mqtt-session-store").data(), 0);
+    if (toWorkers(utils::Config::getStringOptionValue("--workers")) != workers) {
+        LOG(WARNING) << "--workers is a command line only option - the value of the configuration file or the environment is ignored";
+    }
 
-    startServer<net::in::stream::legacy::SocketServer, mqtt::mqttbroker::SharedSocketContextFactory>("in-mqtt", [](auto& config) -> void {
-        config.setPort(1883);
-        config.setRetry();
-    });
+    std::string sessionStore = utils::Config::getStringOptionValue("--mqtt-session-store");
+    if (!sessionStore.empty() && workers > 1) {
+        sessionStore += "." + std::to_string(worker);
+    }
+    setenv("MQTT_SESSION_STORE", sessionStore.data(), 0);
 
-    startServer<net::in::stream::tls::SocketServer, mqtt::mqttbroker::SharedSocketContextFactory>("in-mqtts", [](auto& config) -> void {
-        config.setPort(8883);
-        config.setRetry();
-    });
+    std::string offlineQueue = utils::Config::getStringOptionValue("--mqtt-offline-queue");
+    if (!offlineQueue.empty() && workers > 1) {
+        offlineQueue += "." + std::to_string(worker);
+    }
 
-    startServer<net::in6::stream::legacy::SocketServer, mqtt::mqttbroker::SharedSocketContextFactory>("in6-mqtt", [](auto& config) -> void {
-        config.setPort(1883);
-        config.setRetry();
+    std::string retainedStore = utils::Config::getStringOptionValue("--mqtt-retained-store");
+    if (!retainedStore.empty() && workers > 1) {
+        retainedStore += "." + std::to_string(worker);
+    }
 
-        config.setIPv6Only();
-    });
+    std::string sessionJournal = utils::Config::getStringOptionValue("--mqtt-session-journal");
+    if (!sessionJournal.empty() && workers > 1) {
+        sessionJournal += "." + std::to_string(worker);
+    }
 
-    startServer<net::in6::stream::tls::SocketServer, mqtt::mqttbroker::SharedSocketContextFactory>("in6-mqtts", [](auto& config) -> void {
-        config.setPort(8883);
-        config.setRetry();
+    mqtt::lib::LoopMonitor::instance().start(std::atof(utils::Config::getStringOptionValue("--loop-stall-threshold").data()),
+                                             std::atof(utils::Config::getStringOptionValue("--loop-log-interval").data()));
 
-        config.setIPv6Only();
-    });
+    mqtt::mqttbroker::lib::ShardBus::instance().start(worker);
 
-    startServer<net::un::stream::legacy::SocketServer, mqtt::mqttbroker::SharedSocketContextFactory>("un-mqtt", [](auto& config) -> void {
-        config.setSunPath("/tmp/" + utils::Config::getApplicationName());
-        config.setRetry();
-    });
+    mqtt::mqttbroker::lib::Cluster::instance().configure(utils::Config::getStringOptionValue("--cluster-node"),
+                                                         clusterSummaryDelay,
+                                                         utils::Config::getStringOptionValue("--cluster-secret-file"));
+    if (mqtt::mqttbroker::lib::Cluster::instance().isEnabled()) {
+        startClusterLinks(utils::Config::getStringOptionValue("--cluster-peers"));
+    }
+
+    mqtt::mqttbroker::lib::RetainedStore::instance().open(retainedStore);
+    mqtt::mqttbroker::lib::OfflineQueue::instance().open(
+        offlineQueue,
+        {std::strtoull(utils::Config::getStringOptionValue("--mqtt-offline-queue-head").data(), nullptr, 10),
+         std::strtoull(utils::Config::getStringOptionValue("--mqtt-offline-queue-client-budget").data(), nullptr, 10),
+         std::strtoull(utils::Config::getStringOptionValue("--mqtt-offline-queue-budget").data(), nullptr, 10),
+         std::strtoull(utils::Config::getStringOptionValue("--mqtt-offline-queue-memory").data(), nullptr, 10),
+         utils::Config::getStringOptionValue("--mqtt-offline-queue-policy") != "drop-new"});
+    mqtt::mqttbroker::lib::SessionJournal::instance().open(
+        sessionJournal, std::atof(utils::Config::getStringOptionValue("--mqtt-session-journal-sync").data()));
+    mqtt::mqttbroker::lib::OfflineQueue::instance().restored();
+    mqtt::mqttbroker::lib::OutboundLimiter::instance().start(
+        std::strtoull(utils::Config::getStringOptionValue("--outbound-high-water").data(), nullptr, 10),
+        std::strtoull(utils::Config::getStringOptionValue("--outbound-low-water").data(), nullptr, 10),
+        utils::Config::getStringOptionValue("--outbound-policy"),
+        outboundCheckInterval);
+    mqtt::mqttbroker::lib::RateLimiter::instance().configure(utils::Config::getStringOptionValue("--rate-client-messages"),
+                                                             utils::Config::getStringOptionValue("--rate-client-bytes"),
+                                                             utils::Config::getStringOptionValue("--rate-listener-messages"),
+                                                             utils::Config::getStringOptionValue("--rate-listener-bytes"),
+                                                             utils::Config::getStringOptionValue("--rate-accept"),
+                                                             utils::Config::getStringOptionValue("--rate-action"));
+    mqtt::mqttbroker::lib::TlsSessionCache::instance().configure(
+        utils::Config::getStringOptionValue("--tls-session-cache"),
+        std::atof(utils::Config::getStringOptionValue("--tls-session-lifetime").data()),
+        std::atof(utils::Config::getStringOptionValue("--tls-ticket-rotation").data()),
+        utils::Config::getStringOptionValue("--tls-ticket-key-file"));
+    mqtt::ktls::KernelTls::instance().configure(utils::Config::getStringOptionValue("--ktls"));
+    mqtt::mqttbroker::lib::SharedSubscriptions::instance().configure(utils::Config::getStringOptionValue("--mqtt-shared-strategy"));
+    mqtt::mqttbroker::lib::SysPublisher::instance().start(std::atof(utils::Config::getStringOptionValue("--sys-interval").data()));
+
+    startServer<net::in::stream::legacy::SocketServer, mqtt::mqttbroker::SharedSocketContextFactory>(
+        "in-mqtt", [reusePort](auto& config) -> void {
+            config.setReusePort(reusePort);
+            config.setPort(1883);
+            config.setRetry();
+            config.setWriteBlockSize(writeBlockSize);
+        });
+
+    startServer<net::in::stream::tls::SocketServer, mqtt::mqttbroker::SharedSocketContextFactory>(
+        "in-mqtts", [reusePort](auto& config) -> void {
+            config.setReusePort(reusePort);
+            config.setPort(8883);
+            config.setRetry();
+            config.setWriteBlockSize(writeBlockSize);
+        });
+
+    startServer<net::in6::stream::legacy::SocketServer, mqtt::mqttbroker::SharedSocketContextFactory>(
+        "in6-mqtt", [reusePort](auto& config) -> void {
+            config.setReusePort(reusePort);
+            config.setPort(1883);
+            config.setRetry();
+            config.setWriteBlockSize(writeBlockSize);
+
+            config.setIPv6Only();
+        });
+
+    startServer<net::in6::stream::tls::SocketServer, mqtt::mqttbroker::SharedSocketContextFactory>(
+        "in6-mqtts", [reusePort](auto& config) -> void {
+            config.setReusePort(reusePort);
+            config.setPort(8883);
+            config.setRetry();
+            config.setWriteBlockSize(writeBlockSize);
+
+            config.setIPv6Only();
+        });
+
+    if (worker == 0) { // a unix domain socket can not be shared
+        startServer<net::un::stream::legacy::SocketServer, mqtt::mqttbroker::SharedSocketContextFactory>(
+            "un-mqtt", [](auto& config) -> void {
+                config.setSunPath("/tmp/" + utils::Config::getApplicationName());
+                config.setRetry();
+                config.setWriteBlockSize(writeBlockSize);
+            });
+    }
 
-    startServer<express::legacy::in::WebApp>("in-http", [](auto& config) -> void {
-        config.setPort(8080);
+    // Each worker serves its own metrics and clients - the HTTP listeners are not shared but offset by the index of the worker
+    startServer<express::legacy::in::WebApp>("in-http", [worker](auto& config) -> void {
+        config.setPort(static_cast<uint16_t>(8080 + worker));
         config.setRetry();
     });
 
-    startServer<express::tls::in::WebApp>("in-https", [](auto& config) -> void {
-        config.setPort(8088);
+    startServer<express::tls::in::WebApp>("in-https", [worker](auto& config) -> void {
+        config.setPort(static_cast<uint16_t>(8088 + worker));
         config.setRetry();
     });
 
-    startServer<express::legacy::in6::WebApp>("in6-http", [](auto& config) -> void {
-        config.setPort(8080);
+    startServer<express::legacy::in6::WebApp>("in6-http", [worker](auto& config) -> void {
+        config.setPort(static_cast<uint16_t>(8080 + worker));
         config.setRetry();
 
         config.setIPv6Only();
     });
 
-    startServer<express::tls::in6::WebApp>("in6-https", [](auto& config) -> void {
-        config.setPort(8088);
+    startServer<express::tls::in6::WebApp>("in6-https", [worker](auto& config) -> void {
+        config.setPort(static_cast<uint16_t>(8088 + worker));
         config.setRetry();
 
         config.setIPv6Only();
@@ -0,0 +1,51 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef APPS_WEBSOCKET_SUBPROTOCOL_SERVER_MQTTSUBPROTOCOL_H
+#define APPS_WEBSOCKET_SUBPROTOCOL_SERVER_MQTTSUBPROTOCOL_H
+
+#include <iot/mqtt/server/SubProtocol.h>
+
+namespace mqtt::mqttbroker::lib {
+    class Mqtt;
+} // namespace mqtt::mqttbroker::lib
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <cstddef>
+#include <string>
+
+#endif
+
+namespace mqtt::mqttbroker::websocket {
+
+    // MQTT over WebSocket - each control packet passes lib::Mqtt::sending() before it is sent as binary message
+    class SubProtocol : public iot::mqtt::server::SubProtocol {
+    public:
+        SubProtocol(web::websocket::SubProtocolContext* subProtocolContext, const std::string& name, lib::Mqtt* mqtt);
+
+    private:
+        void send(const char* chunk, std::size_t chunklen) final;
+
+        lib::Mqtt* mqtt;
+    };
+
+} // namespace mqtt::mqttbroker::websocket
+
+#endif // APPS_WEBSOCKET_SUBPROTOCOL_SERVER_MQTTSUBPROTOCOL_H
@@ -19,10 +19,14 @@
 
 #include "SubProtocolFactory.h"
 
+#include "SubProtocol.h"
 #include "lib/JsonMappingReader.h"
 #include "lib/Mqtt.h"
+#include "lib/RateLimiter.h"
 
+#include <core/socket/stream/SocketConnection.h>
 #include <iot/mqtt/server/broker/Broker.h>
+#include <web/websocket/SubProtocolContext.h>
 
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 
@@ -40,12 +44,22 @@ namespace mqtt::mqttbroker::websocket {
     }
 
     iot::mqtt::server::SubProtocol* SubProtocolFactory::create(web::websocket::SubProtocolContext* subProtocolContext) {
-        return new iot::mqtt::server::SubProtocol(
-            subProtocolContext,
-            getName(),
-            new mqtt::mqttbroker::lib::Mqtt(
-                iot::mqtt::server::broker::Broker::instance(SUBSCRIBTION_MAX_QOS),
-                mqtt::lib::JsonMappingReader::readMappingFromFile(utils::Config::getStringOptionValue("--mqtt-mapping-file"))["mapping"]));
+        iot::mqtt::server::SubProtocol* subProtocol = nullptr;
+
+        // The HTTP connection has been accepted by the web listener - the accept rate limit applies to the upgrade to MQTT, a
+        // refused upgrade fails and the HTTP response reports it
+        const core::socket::stream::SocketConnection* socketConnection = subProtocolContext->getSocketConnection();
+
+        if (lib::RateLimiter::instance().accept(socketConnection->getInstanceName(), socketConnection->getRemoteAddress().toString())) {
+            subProtocol = new SubProtocol(
+                subProtocolContext,
+                getName(),
+                new mqtt::mqttbroker::lib::Mqtt(iot::mqtt::server::broker::Broker::instance(SUBSCRIBTION_MAX_QOS),
+                                                mqtt::lib::JsonMappingReader::readMappingFromFile(
+                                                    utils::Config::getStringOptionValue("--mqtt-mapping-file"))["mapping"]));
+        }
+
+        return subProtocol;
     }
 
 } // namespace mqtt::mqttbroker::websocket
@@ -19,6 +19,8 @@
 
 #include "Mqtt.h"
 
+#include "lib/LoopMonitor.h"
+
 #include <iot/mqtt/Topic.h>
 #include <iot/mqtt/packets/Connack.h>
 
@@ -68,6 +70,7 @@ namespace mqtt::mqttintegrator::lib {
         VLOG(1) << "MQTT: On Exit due to '" << strsignal(signum) << "' (SIG" << utils::system::sigabbrev_np(signum) << " = " << signum
                 << ")";
 
+        flushBatches();
         sendDisconnect();
 
         return Super::onSignal(signum);
@@ -88,6 +91,8 @@ namespace mqtt::mqttintegrator::lib {
     }
 
     void Mqtt::onPublish(const iot::mqtt::packets::Publish& publish) {
+        const mqtt::lib::LoopMonitor::Probe probe("socket read: mqtt publish");
+
         publishMappings(publish);
     }
 
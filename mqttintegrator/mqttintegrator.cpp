@@ -18,6 +18,8 @@
  */
 
 #include "SocketContextFactory.h"
+#include "ktls/KernelTls.h"
+#include "lib/LoopMonitor.h"
 
 #ifdef LINK_SUBPROTOCOL_STATIC
 
@@ -77,6 +79,22 @@ reportState(const std::string& instanceName, const core::socket::SocketAddress&
     }
 }
 
+// Hands the record encryption of a TLS client to the kernel if kTLS is enabled for its instance. SNode.C starts TLS after
+// onConnect, thus the SSL_CTX is set up there - before the handshake of the first connection.
+template <typename Client>
+void enableKernelTls(Client& client, const std::string& instanceName) {
+    if constexpr (requires(typename Client::SocketConnection* socketConnection) { socketConnection->getSSL(); }) {
+        typename Client::Config* config = &client.getConfig();
+
+        client.setOnConnect([instanceName, config]([[maybe_unused]] typename Client::SocketConnection* socketConnection) -> void {
+            mqtt::ktls::KernelTls::instance().setup(instanceName, config->getSslCtx());
+        });
+        client.setOnConnected([instanceName](typename Client::SocketConnection* socketConnection) -> void {
+            mqtt::ktls::KernelTls::instance().handshake(instanceName, socketConnection->getSSL());
+        });
+    }
+}
+
 template <template <typename, typename...> typename SocketClient,
           typename SocketContextFactory,
           typename... SocketContextFactoryArgs,
@@ -86,7 +104,8 @@ template <template <typename, typename...> typename SocketClient,
 void startClient(const std::string& instanceName,
                  const std::function<void(typename Client::Config&)>& configurator,
                  SocketContextFactoryArgs&&... socketContextFactoryArgs) {
-    const Client client(instanceName, std::forward<SocketContextFactoryArgs>(socketContextFactoryArgs)...);
+    Client client(instanceName, std::forward<SocketContextFactoryArgs>(socketContextFactoryArgs)...);
+    enableKernelTls(client, instanceName);
 
     configurator(client.getConfig());
 
@@ -104,7 +123,8 @@ template <template <typename, typename...> typename SocketClient,
           typename = std::enable_if_t<not std::is_invocable_v<std::tuple_element_t<0, std::tuple<SocketContextFactoryArgs...>>,
                                                               typename SocketClient<SocketContextFactory>::Config&>>>
 void startClient(const std::string& instanceName, SocketContextFactoryArgs&&... socketContextFactoryArgs) {
-    const Client client(instanceName, std::forward<SocketContextFactoryArgs>(socketContextFactoryArgs)...);
+    Client client(instanceName, std::forward<SocketContextFactoryArgs>(socketContextFactoryArgs)...);
+    enableKernelTls(client, instanceName);
 
     client.connect([instanceName](const SocketAddress& socketAddress, const core::socket::State& state) -> void {
         reportState(instanceName, socketAddress, state);
@@ -162,11 +182,20 @@ int main(int argc, char* argv[]) {
 
     utils::Config::addStringOption("--mqtt-mapping-file", "MQTT mapping file (json format) for integration", "[path]");
     utils::Config::addStringOption("--mqtt-session-store", "Path to file for the persistent session store", "[path]", "");
+    utils::Config::addStringOption(
+        "--loop-stall-threshold", "Duration of an event loop callback counted as stall", "[seconds]", "0.05");
+    utils::Config::addStringOption("--loop-log-interval", "Interval of the event loop summary log, 0 disables", "[seconds]", "60");
+    utils::Config::addStringOption(
+        "--ktls", "Kernel TLS offload per TLS client instance, '*' for all others", "[instance=on|off,...]", "");
 
     core::SNodeC::init(argc, argv);
 
     setenv("MQTT_SESSION_STORE", utils::Config::getStringOptionValue("--mqtt-session-store").data(), 0);
 
+    mqtt::lib::LoopMonitor::instance().start(std::atof(utils::Config::getStringOptionValue("--loop-stall-threshold").data()),
+                                             std::atof(utils::Config::getStringOptionValue("--loop-log-interval").data()));
+    mqtt::ktls::KernelTls::instance().configure(utils::Config::getStringOptionValue("--ktls"));
+
     startClient<net::in::stream::legacy::SocketClient, mqtt::mqttintegrator::SocketContextFactory>("in-mqtt", [](auto& config) -> void {
         config.Remote::setPort(1883);
 
@@ -0,0 +1,55 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TESTS_CHECK_H
+#define TESTS_CHECK_H
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <cstdlib>
+#include <iostream>
+
+#endif
+
+namespace mqtt::tests {
+
+    /* Minimal expectation checking of the unit tests. A failed CHECK is reported with its source location and the test
+     * continues - result() is the exit code of the test executable as evaluated by ctest. */
+    inline int failures = 0;
+
+    inline void check(bool condition, const char* expression, const char* file, int line) {
+        if (!condition) {
+            std::cerr << file << ":" << line << ": CHECK(" << expression << ") failed" << std::endl;
+            ++failures;
+        }
+    }
+
+    inline int result() {
+        if (failures > 0) {
+            std::cerr << failures << " check(s) failed" << std::endl;
+        }
+
+        return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+} // namespace mqtt::tests
+
+#define CHECK(expression) mqtt::tests::check((expression), #expression, __FILE__, __LINE__)
+
+#endif // TESTS_CHECK_H
@@ -0,0 +1,142 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Check.h"
+#include "mqttbench/lib/LatencyHistogram.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <vector>
+
+#endif
+
+using mqtt::mqttbench::lib::LatencyHistogram;
+
+static void testEmpty() {
+    LatencyHistogram histogram;
+
+    CHECK(histogram.getCount() == 0);
+    CHECK(histogram.getMin() == 0);
+    CHECK(histogram.getMax() == 0);
+    CHECK(std::abs(histogram.getMean()) < 1e-9);
+    CHECK(histogram.percentile(0.5) == 0);
+}
+
+// Below 32 ns every value has a bucket of its own
+static void testSmallValuesExact() {
+    LatencyHistogram histogram;
+
+    for (uint64_t value = 0; value < 32; ++value) {
+        histogram.record(value);
+    }
+
+    CHECK(histogram.getCount() == 32);
+    CHECK(histogram.getMin() == 0);
+    CHECK(histogram.getMax() == 31);
+    CHECK(std::abs(histogram.getMean() - 15.5) < 1e-9);
+    CHECK(histogram.percentile(0) == 0);
+    CHECK(histogram.percentile(0.5) == 15);
+    CHECK(histogram.percentile(0.9) == 28);
+    CHECK(histogram.percentile(1) == 31);
+}
+
+// Bucket boundaries: each power of two holds 32 buckets, the upper bound of a bucket is the largest value in it
+static void testBucketBounds() {
+    for (const uint64_t value : {uint64_t{32}, uint64_t{33}, uint64_t{63}, uint64_t{64}, uint64_t{65}, uint64_t{66}, uint64_t{1000}}) {
+        LatencyHistogram histogram;
+        histogram.record(0);
+        histogram.record(value);
+        histogram.record(std::numeric_limits<uint64_t>::max());
+
+        const uint64_t width = value < 64 ? 1 : uint64_t{1} << (std::bit_width(value) - 6);
+
+        CHECK(histogram.percentile(0.5) == (value / width + 1) * width - 1);
+    }
+
+    LatencyHistogram histogram;
+    histogram.record(std::numeric_limits<uint64_t>::max());
+
+    CHECK(histogram.percentile(0.5) == std::numeric_limits<uint64_t>::max());
+}
+
+// Against the exact percentiles of the samples: never below, at most a bucket width (1/32) above
+static void testAgainstSorted() {
+    std::mt19937_64 random(4711);
+    std::lognormal_distribution<double> latency(std::log(200000.0), 1.5);
+
+    LatencyHistogram histogram;
+    std::vector<uint64_t> samples;
+
+    for (int i = 0; i < 100000; ++i) {
+        const uint64_t sample = static_cast<uint64_t>(latency(random));
+
+        histogram.record(sample);
+        samples.push_back(sample);
+    }
+    std::ranges::sort(samples);
+
+    double sum = 0;
+    for (const uint64_t sample : samples) {
+        sum += static_cast<double>(sample);
+    }
+
+    CHECK(histogram.getCount() == samples.size());
+    CHECK(histogram.getMin() == samples.front());
+    CHECK(histogram.getMax() == samples.back());
+    CHECK(std::abs(histogram.getMean() - sum / static_cast<double>(samples.size())) < 1e-6 * histogram.getMean());
+
+    uint64_t previous = 0;
+    for (const double quantile : {0.0, 0.001, 0.1, 0.5, 0.9, 0.99, 0.999, 0.9999, 1.0}) {
+        const std::size_t rank =
+            std::max<std::size_t>(1, static_cast<std::size_t>(std::ceil(quantile * static_cast<double>(samples.size()))));
+        const uint64_t exact = samples[rank - 1];
+        const uint64_t percentile = histogram.percentile(quantile);
+
+        CHECK(percentile >= exact);
+        CHECK(percentile <= exact + exact / 32);
+        CHECK(percentile >= previous);
+
+        previous = percentile;
+    }
+
+    CHECK(histogram.percentile(1) == samples.back());
+
+    histogram.reset();
+    CHECK(histogram.getCount() == 0);
+    CHECK(histogram.percentile(0.99) == 0);
+
+    histogram.record(7);
+    CHECK(histogram.getMin() == 7 && histogram.getMax() == 7 && histogram.percentile(0.5) == 7);
+}
+
+int main() {
+    testEmpty();
+    testSmallValuesExact();
+    testBucketBounds();
+    testAgainstSorted();
+
+    return mqtt::tests::result();
+}
@@ -0,0 +1,143 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Check.h"
+#include "lib/MappingPredicate.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <string>
+
+#endif
+
+using mqtt::lib::MappingPredicate;
+
+static bool evaluate(const std::string& expression, const nlohmann::json& json) {
+    return MappingPredicate(expression).evaluate(json);
+}
+
+static bool rejects(const std::string& expression) {
+    bool rejected = false;
+
+    try {
+        MappingPredicate predicate(expression);
+    } catch (const std::invalid_argument&) {
+        rejected = true;
+    }
+
+    return rejected;
+}
+
+static void testComparisons() {
+    const nlohmann::json json = {{"topic", "sensors/kitchen"},
+                                 {"qos", 1},
+                                 {"retain", false},
+                                 {"message", {{"temperature", 21.5}, {"unit", "C"}, {"sensors", {{{"id", 7}}, {{"id", 8}}}}}}};
+
+    CHECK(evaluate("message.temperature > 20", json));
+    CHECK(!evaluate("message.temperature > 21.5", json));
+    CHECK(evaluate("message.temperature >= 21.5", json));
+    CHECK(evaluate("message.temperature <= 21.5 && message.temperature < 22", json));
+    CHECK(evaluate("message.unit == 'C'", json));
+    CHECK(evaluate("message.unit != \"F\"", json));
+    CHECK(evaluate("topic == 'sensors/kitchen'", json));
+    CHECK(evaluate("qos == 1", json));
+    CHECK(evaluate("retain == false", json));
+    CHECK(evaluate("message.sensors[1].id == 8", json));
+    CHECK(!evaluate("message.sensors[0].id == 8", json));
+    CHECK(evaluate("-1 < 0", json));
+}
+
+static void testNumericStrings() {
+    // Value mappings render the payload as a string - a number compared with it is compared numerically
+    CHECK(evaluate("message > 20", {{"message", "21"}}));
+    CHECK(!evaluate("message > 20", {{"message", "19.5"}}));
+    CHECK(evaluate("20 < message", {{"message", "21"}}));
+    CHECK(evaluate("message == 21", {{"message", "21"}}));
+
+    // Not a number - neither equal nor ordered
+    CHECK(!evaluate("message == 21", {{"message", "21abc"}}));
+    CHECK(!evaluate("message < 21", {{"message", "abc"}}));
+    CHECK(!evaluate("message > 21", {{"message", "abc"}}));
+    CHECK(evaluate("message != 21", {{"message", "abc"}}));
+}
+
+static void testLogic() {
+    const nlohmann::json json = {{"a", true}, {"b", false}, {"n", 0}, {"s", ""}, {"list", nlohmann::json::array({1})}};
+
+    CHECK(evaluate("a", json));
+    CHECK(!evaluate("b", json));
+    CHECK(!evaluate("n", json));
+    CHECK(!evaluate("s", json));
+    CHECK(evaluate("list", json));
+    CHECK(!evaluate("missing", json));
+    CHECK(evaluate("!missing", json));
+
+    CHECK(evaluate("a || b", json));
+    CHECK(evaluate("a or b", json));
+    CHECK(!evaluate("a && b", json));
+    CHECK(!evaluate("a and b", json));
+    CHECK(evaluate("not b", json));
+    CHECK(evaluate("!b && !n", json));
+
+    // && binds stronger than ||, parentheses override
+    CHECK(evaluate("a || b && b", json));
+    CHECK(!evaluate("(a || b) && b", json));
+
+    // Words are only operators as a whole - "order" is a path, not "or" followed by "der"
+    CHECK(evaluate("order == 1", {{"order", 1}}));
+    CHECK(evaluate("notice", {{"notice", true}}));
+}
+
+static void testMissingPaths() {
+    const nlohmann::json json = {{"message", {{"value", 1}}}};
+
+    // A missing path compares unordered - every comparison but != is false
+    CHECK(!evaluate("message.missing == 1", json));
+    CHECK(!evaluate("message.missing < 1", json));
+    CHECK(!evaluate("message.missing >= 1", json));
+    CHECK(evaluate("message.missing != 1", json));
+    CHECK(!evaluate("message.value[0] == 1", json));
+
+    CHECK(evaluate("message.value == 1 || message.missing", json));
+}
+
+static void testSyntaxErrors() {
+    CHECK(rejects(""));
+    CHECK(rejects("a =="));
+    CHECK(rejects("(a"));
+    CHECK(rejects("a b"));
+    CHECK(rejects("'unterminated"));
+    CHECK(rejects("list[]"));
+    CHECK(rejects("list[x]"));
+    CHECK(rejects("a."));
+    CHECK(!rejects("  a  ==  1  "));
+}
+
+int main() {
+    testComparisons();
+    testNumericStrings();
+    testLogic();
+    testMissingPaths();
+    testSyntaxErrors();
+
+    return mqtt::tests::result();
+}
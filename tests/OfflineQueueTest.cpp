@@ -0,0 +1,260 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Check.h"
+#include "mqttbroker/lib/OfflineQueue.h"
+
+#include <core/SNodeC.h>
+#include <core/timer/Timer.h>
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <dirent.h>
+#include <optional>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#endif
+
+// Segment accounting of the offline queues: every published byte is either queued or dropped, the queued bytes are the in-memory
+// ones plus the segment files in the spool directory, and streamed or dropped segments are removed from it.
+//
+// Streaming runs from the timer of the queue, thus the test runs in the event loop: a check timer waits for a queue to drain and
+// then continues with the next step.
+
+using mqtt::mqttbroker::lib::OfflineQueue;
+
+static constexpr std::size_t messageSize = 200;
+static constexpr std::size_t recordSize = 8 + 3 + messageSize; // record header, topic "a/x" or "b/x", message
+
+static const OfflineQueue::Limits limits{4096, 16 * 1024 * 1024, 24 * 1024 * 1024, 64 * 1024, true};
+
+static std::string directory;
+
+struct SpoolFiles {
+    std::size_t segments = 0;
+    std::size_t segmentBytes = 0;
+    std::size_t files = 0;
+};
+
+static SpoolFiles spoolFiles() {
+    SpoolFiles spoolFiles;
+
+    if (DIR* dir = opendir(directory.data()); dir != nullptr) {
+        for (const dirent* entry = readdir(dir); entry != nullptr; entry = readdir(dir)) {
+            const std::string name(entry->d_name);
+
+            struct stat st{};
+            if (name != "." && name != ".." && fstatat(dirfd(dir), name.data(), &st, 0) == 0) {
+                ++spoolFiles.files;
+
+                if (name.ends_with(".seg")) {
+                    ++spoolFiles.segments;
+                    spoolFiles.segmentBytes += static_cast<std::size_t>(st.st_size);
+                }
+            }
+        }
+        closedir(dir);
+    }
+
+    return spoolFiles;
+}
+
+// The sequence number leads the message, thus the delivered order is checked by parsing it back
+static std::string message(std::size_t sequence) {
+    std::string message = std::to_string(sequence);
+    message.resize(messageSize, '.');
+
+    return message;
+}
+
+static std::size_t sequence(const std::string& message) {
+    return std::stoul(message);
+}
+
+// What a session received: in order, without gaps
+struct Received {
+    std::vector<std::size_t> sequences;
+    std::size_t calls = 0;
+    std::size_t refuseEvery = 1000;
+
+    OfflineQueue::Deliver deliver() {
+        return [this](const std::string& topic, const std::string& message, uint8_t qoS) -> bool {
+            // Back pressure now and then - the refused record is offered again
+            const bool accepted = refuseEvery == 0 || ++calls % refuseEvery != 0;
+
+            if (accepted) {
+                CHECK(topic.size() == 3 && qoS == 1);
+                sequences.push_back(sequence(message));
+            }
+
+            return accepted;
+        };
+    }
+
+    bool contiguous(std::size_t first, std::size_t end) const {
+        bool contiguous = sequences.size() == end - first;
+
+        for (std::size_t i = 0; contiguous && i < sequences.size(); ++i) {
+            contiguous = sequences[i] == first + i;
+        }
+
+        return contiguous;
+    }
+};
+
+static int connection = 0;
+
+static Received c;
+static Received d;
+
+static constexpr std::size_t cRecords = 50000; // about 10 MiB - three segments
+static constexpr std::size_t dRecords = 100000; // about 20 MiB - over the budget of a session
+
+static std::size_t dQueued = 0;
+static uint64_t dDropped = 0;
+
+// Within budget: nothing dropped, the queue spills into segment files once the head is full
+static void testSpill() {
+    OfflineQueue& offlineQueue = OfflineQueue::instance();
+
+    offlineQueue.subscribed("c", "a/#", 1);
+    offlineQueue.park("c", nullptr);
+    offlineQueue.restored();
+
+    for (std::size_t i = 0; i < cRecords; ++i) {
+        offlineQueue.publish("a/x", message(i), 1);
+    }
+    offlineQueue.publish("a/x", "not queued", 0); // QoS 0 only for a connected session
+
+    const SpoolFiles files = spoolFiles();
+
+    CHECK(offlineQueue.getQueuedBytes() == cRecords * recordSize);
+    CHECK(offlineQueue.getDroppedBytes() == 0);
+    CHECK(offlineQueue.getMemoryBytes() <= limits.memoryBytes);
+    CHECK(files.segments == 3);
+    CHECK(files.segmentBytes + offlineQueue.getMemoryBytes() == offlineQueue.getQueuedBytes());
+
+    offlineQueue.resume("c", &connection, c.deliver());
+}
+
+// Streamed completely: the segment files are gone, new publishes are delivered directly
+static void testDrained() {
+    OfflineQueue& offlineQueue = OfflineQueue::instance();
+
+    CHECK(c.contiguous(0, cRecords));
+    CHECK(offlineQueue.getMemoryBytes() == 0);
+    CHECK(spoolFiles().segments == 0);
+
+    c.refuseEvery = 0;
+    offlineQueue.publish("a/x", message(cRecords), 1);
+    CHECK(c.contiguous(0, cRecords + 1));
+    CHECK(offlineQueue.getQueuedBytes() == 0);
+}
+
+// Over the budget of the session: the oldest records and then whole segments are dropped, the files of the latter are removed
+static void testDropOldest() {
+    OfflineQueue& offlineQueue = OfflineQueue::instance();
+
+    offlineQueue.subscribed("d", "b/#", 1);
+    offlineQueue.park("d", nullptr);
+
+    const uint64_t dropped = offlineQueue.getDroppedBytes();
+
+    for (std::size_t i = 0; i < dRecords; ++i) {
+        offlineQueue.publish("b/x", message(i), 1);
+    }
+
+    const SpoolFiles files = spoolFiles();
+
+    dQueued = offlineQueue.getQueuedBytes();
+    dDropped = offlineQueue.getDroppedBytes() - dropped;
+
+    CHECK(dQueued <= limits.clientBytes);
+    CHECK(dQueued + dDropped == dRecords * recordSize);
+    CHECK(dDropped % recordSize == 0);
+    CHECK(files.segments > 0 && files.segments <= limits.clientBytes / (4 * 1024 * 1024) + 1);
+    CHECK(files.segmentBytes + offlineQueue.getMemoryBytes() == dQueued);
+
+    offlineQueue.resume("d", &connection, d.deliver());
+}
+
+// What is left is the newest records, in order
+static void testSuffix() {
+    OfflineQueue& offlineQueue = OfflineQueue::instance();
+
+    CHECK(d.contiguous(dRecords - dQueued / recordSize, dRecords));
+    CHECK(spoolFiles().segments == 0);
+
+    offlineQueue.cleared("c");
+    offlineQueue.cleared("d");
+
+    CHECK(offlineQueue.getQueuedBytes() == 0);
+    CHECK(offlineQueue.getMemoryBytes() == 0);
+    CHECK(spoolFiles().files == 0);
+}
+
+int main(int argc, char* argv[]) {
+    core::SNodeC::init(argc, argv);
+
+    char spool[] = "/tmp/offline-queue-test-XXXXXX";
+    CHECK(mkdtemp(spool) != nullptr);
+    directory = spool;
+
+    CHECK(OfflineQueue::instance().open(directory, limits));
+
+    testSpill();
+
+    std::optional<core::timer::Timer> checkTimer;
+    int step = 0;
+    int ticks = 0;
+
+    checkTimer = core::timer::Timer::intervalTimer(
+        [&checkTimer, &step, &ticks]() -> void {
+            if (OfflineQueue::instance().getQueuedBytes() == 0) {
+                if (step == 0) {
+                    testDrained();
+                    testDropOldest();
+                } else {
+                    testSuffix();
+                }
+                ++step;
+            }
+
+            // Streaming runs at 25 MiB/s - a stalled queue fails instead of hanging
+            if (step == 2 || ++ticks > 600) {
+                CHECK(step == 2);
+
+                checkTimer->cancel();
+                core::SNodeC::stop();
+            }
+        },
+        0.05);
+
+    core::SNodeC::start();
+
+    CHECK(rmdir(spool) == 0);
+
+    return mqtt::tests::result();
+}
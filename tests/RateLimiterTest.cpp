@@ -0,0 +1,130 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Check.h"
+#include "mqttbroker/lib/RateLimiter.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <cmath>
+
+#endif
+
+using mqtt::mqttbroker::lib::RateLimiter;
+
+static void testBurst() {
+    RateLimiter::Bucket bucket;
+
+    // Starts full with one second worth of tokens
+    for (int i = 0; i < 10; ++i) {
+        CHECK(bucket.take(10, 1, 1000));
+    }
+    CHECK(!bucket.take(10, 1, 1000));
+
+    // Refills with the rate
+    CHECK(!bucket.take(10, 1, 1000.05));
+    CHECK(bucket.take(10, 1, 1000.15));
+    CHECK(!bucket.take(10, 1, 1000.15));
+
+    // but never beyond the burst
+    for (int i = 0; i < 10; ++i) {
+        CHECK(bucket.take(10, 1, 2000));
+    }
+    CHECK(!bucket.take(10, 1, 2000));
+}
+
+static void testUnlimited() {
+    RateLimiter::Bucket bucket;
+
+    for (int i = 0; i < 1000; ++i) {
+        CHECK(bucket.take(0, 1e9, 1000));
+    }
+}
+
+static void testOversized() {
+    RateLimiter::Bucket bucket;
+
+    // Larger than the burst: admitted with a full bucket, which is left in debt
+    CHECK(bucket.take(100, 250, 1000));
+    CHECK(!bucket.available(100, 1, 1001.5));
+    CHECK(bucket.available(100, 5, 1001.6));
+    CHECK(!bucket.available(100, 250, 1002.4));
+    CHECK(bucket.available(100, 250, 1002.6));
+}
+
+static void testRefusedTakesNothing() {
+    RateLimiter::Bucket bucket;
+
+    CHECK(bucket.take(100, 60, 1000));
+    CHECK(!bucket.take(100, 60, 1000));
+    CHECK(bucket.take(100, 40, 1000)); // the refused 60 were not taken
+    CHECK(!bucket.take(100, 1, 1000));
+}
+
+// Slow rates - the few milliseconds the test runs refill next to nothing
+static void testAllOrNothing() {
+    RateLimiter& rateLimiter = RateLimiter::instance();
+
+    rateLimiter.configure("*=7,t=5", "t=1000", "", "t=1500", "t=2", "*=delay");
+
+    RateLimiter::Listener* listener = rateLimiter.listener("t");
+    CHECK(listener != nullptr);
+
+    if (listener != nullptr) {
+        RateLimiter::Client a;
+        RateLimiter::Client b;
+
+        // Refused by the byte bucket of the client - its message bucket keeps the token
+        CHECK(rateLimiter.publish(*listener, a, 600));
+        CHECK(!rateLimiter.publish(*listener, a, 600));
+        for (int i = 0; i < 4; ++i) {
+            CHECK(rateLimiter.publish(*listener, a, 1));
+        }
+        CHECK(!rateLimiter.publish(*listener, a, 1));
+        CHECK(a.limited == 2);
+
+        // Refused by the byte bucket of the listener, 896 bytes left - the buckets of the client keep their tokens
+        CHECK(!rateLimiter.available(*listener, b, 1000));
+        CHECK(!rateLimiter.publish(*listener, b, 1000));
+        CHECK(rateLimiter.publish(*listener, b, 800));
+        CHECK(b.limited == 1);
+
+        // Accepts per source address
+        CHECK(rateLimiter.accept(*listener, "192.0.2.1"));
+        CHECK(rateLimiter.accept(*listener, "192.0.2.1"));
+        CHECK(!rateLimiter.accept(*listener, "192.0.2.1"));
+        CHECK(rateLimiter.accept(*listener, "192.0.2.2"));
+    }
+
+    // Not configured limits are inherited from "*"
+    RateLimiter::Listener* other = rateLimiter.listener("other");
+    CHECK(other != nullptr && std::abs(other->clientMessages - 7) < 1e-9 && other->listenerBytes <= 0 &&
+          other->action == RateLimiter::Action::DELAY);
+    CHECK(listener != nullptr && std::abs(listener->clientMessages - 5) < 1e-9 && listener->action == RateLimiter::Action::DELAY);
+}
+
+int main() {
+    testBurst();
+    testUnlimited();
+    testOversized();
+    testRefusedTakesNothing();
+    testAllOrNothing();
+
+    return mqtt::tests::result();
+}
@@ -0,0 +1,213 @@
+/*
+ * snode.c - a slim toolkit for network communication
+ * Copyright (C) Volker Christian <me@vchrist.at>
+ *               2020, 2021, 2022, 2023, 2024, 2025
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Check.h"
+#include "mqttbroker/lib/TopicFilterTrie.h"
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#include <cstddef>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#endif
+
+using mqtt::mqttbroker::lib::TopicFilterTrie;
+
+static std::vector<std::string> split(const std::string& string) {
+    std::vector<std::string> levels;
+
+    std::size_t begin = 0;
+    for (std::size_t end = string.find('/'); end != std::string::npos; end = string.find('/', begin)) {
+        levels.push_back(string.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    levels.push_back(string.substr(begin));
+
+    return levels;
+}
+
+// Straightforward level by level matching as specified by MQTT 3.1.1, 4.7 - the reference the trie is compared with
+static bool referenceMatches(const std::string& filter, const std::string& topic) {
+    const std::vector<std::string> filterLevels = split(filter);
+    const std::vector<std::string> topicLevels = split(topic);
+
+    bool match = !(topic.starts_with("$") && (filterLevels[0] == "+" || filterLevels[0] == "#"));
+
+    std::size_t level = 0;
+    bool done = !match;
+    while (!done) {
+        if (level < filterLevels.size() && filterLevels[level] == "#") {
+            done = true;
+        } else if (level == filterLevels.size() || level == topicLevels.size()) {
+            match = level == filterLevels.size() && level == topicLevels.size();
+            done = true;
+        } else if (filterLevels[level] != "+" && filterLevels[level] != topicLevels[level]) {
+            match = false;
+            done = true;
+        } else {
+            ++level;
+        }
+    }
+
+    return match;
+}
+
+static std::set<std::string> matching(const TopicFilterTrie& trie, const std::string& topic) {
+    std::set<std::string> filters;
+
+    trie.match(topic, [&filters](const std::string& filter) -> void {
+        CHECK(filters.insert(filter).second); // each distinct filter is reported once
+    });
+
+    return filters;
+}
+
+static void testWildcards() {
+    TopicFilterTrie trie;
+    trie.insert("a/b/c");
+    trie.insert("a/+/c");
+    trie.insert("a/#");
+    trie.insert("+/x");
+    trie.insert("#");
+
+    CHECK(matching(trie, "a/b/c") == std::set<std::string>({"a/b/c", "a/+/c", "a/#", "#"}));
+    CHECK(matching(trie, "a/z/c") == std::set<std::string>({"a/+/c", "a/#", "#"}));
+    CHECK(matching(trie, "a") == std::set<std::string>({"a/#", "#"})); // "a/#" includes its parent level
+    CHECK(matching(trie, "b/x") == std::set<std::string>({"+/x", "#"}));
+    CHECK(matching(trie, "a/x") == std::set<std::string>({"+/x", "a/#", "#"}));
+
+    // Empty levels are levels
+    CHECK(matching(trie, "/x") == std::set<std::string>({"+/x", "#"}));
+    CHECK(matching(trie, "a//c") == std::set<std::string>({"a/+/c", "a/#", "#"}));
+}
+
+static void testDollarTopics() {
+    TopicFilterTrie trie;
+    trie.insert("#");
+    trie.insert("+/broker/uptime");
+
+    CHECK(!trie.matches("$SYS/broker/uptime"));
+    CHECK(matching(trie, "$SYS/broker/uptime").empty());
+
+    trie.insert("$SYS/#");
+    trie.insert("$SYS/+/uptime");
+
+    CHECK(trie.matches("$SYS/broker/uptime"));
+    CHECK(matching(trie, "$SYS/broker/uptime") == std::set<std::string>({"$SYS/#", "$SYS/+/uptime"}));
+
+    // Only the first level is special
+    CHECK(matching(trie, "a/$b") == std::set<std::string>({"#"}));
+}
+
+static void testMultiset() {
+    TopicFilterTrie trie;
+    trie.insert("a/b");
+    trie.insert("a/b");
+    trie.insert("a/#");
+
+    CHECK(trie.size() == 3);
+    CHECK(!trie.erase("a/c"));
+    CHECK(!trie.erase("a/b/c"));
+    CHECK(!trie.erase("a"));
+
+    CHECK(trie.erase("a/b"));
+    CHECK(trie.matches("a/b")); // still subscribed once
+    CHECK(trie.erase("a/#"));
+    CHECK(trie.matches("a/b"));
+    CHECK(!trie.matches("a/c"));
+    CHECK(trie.erase("a/b"));
+    CHECK(!trie.erase("a/b"));
+    CHECK(!trie.matches("a/b"));
+    CHECK(trie.size() == 0);
+
+    trie.insert("x/y");
+    trie.clear();
+    CHECK(trie.size() == 0);
+    CHECK(!trie.matches("x/y"));
+}
+
+// Random filters and topics over a small alphabet, thus wildcards, prefixes and empty levels collide often
+static void testAgainstReference() {
+    std::mt19937 random(4711);
+
+    const std::vector<std::string> topicLevels = {"a", "b", "", "$s"};
+    const std::vector<std::string> filterLevels = {"a", "b", "", "$s", "+", "+"};
+
+    const auto randomString = [&random](const std::vector<std::string>& alphabet, bool filter) -> std::string {
+        const std::size_t levels = std::uniform_int_distribution<std::size_t>(1, 4)(random);
+
+        std::string string;
+        for (std::size_t level = 0; level < levels; ++level) {
+            string += (level > 0 ? "/" : "") + alphabet[std::uniform_int_distribution<std::size_t>(0, alphabet.size() - 1)(random)];
+        }
+        if (filter && std::uniform_int_distribution<int>(0, 3)(random) == 0) {
+            string += "/#";
+        }
+
+        return string;
+    };
+
+    for (int round = 0; round < 200; ++round) {
+        TopicFilterTrie trie;
+        std::multiset<std::string> filters;
+
+        for (int i = 0; i < 8; ++i) {
+            const std::string filter = randomString(filterLevels, true);
+            trie.insert(filter);
+            filters.insert(filter);
+        }
+
+        // Erase some again - pruning must not lose the filters sharing a prefix
+        for (int i = 0; i < 3; ++i) {
+            const std::string filter = randomString(filterLevels, true);
+            CHECK(trie.erase(filter) == filters.contains(filter));
+            if (filters.contains(filter)) {
+                filters.erase(filters.find(filter));
+            }
+        }
+
+        CHECK(trie.size() == filters.size());
+
+        for (int i = 0; i < 20; ++i) {
+            const std::string topic = randomString(topicLevels, false);
+
+            std::set<std::string> expected;
+            for (const std::string& filter : filters) {
+                if (referenceMatches(filter, topic)) {
+                    expected.insert(filter);
+                }
+            }
+
+            CHECK(matching(trie, topic) == expected);
+            CHECK(trie.matches(topic) == !expected.empty());
+        }
+    }
+}
+
+int main() {
+    testWildcards();
+    testDollarTopics();
+    testMultiset();
+    testAgainstReference();
+
+    return mqtt::tests::result();
+}